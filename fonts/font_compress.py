@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# --no-compressで作ったフォントのCソースのビットマップを、LVGLの圧縮形式(行の差分 + RLE)に変換する
+# lv_font_convを--no-compress無しで実行したのと同じ形式になるので、LV_USE_FONT_COMPRESSED 1で読める
+#
+#   python3 fonts/font_compress.py fonts/mplus1_regular/mplus1_regular_14.c -o mplus1_regular_14.c
+#   python3 fonts/font_compress.py --report fonts/mplus1_*/*.c    (書き出さずに大きさだけを比べる)
+#
+
+import argparse
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import font_pack  # noqa: E402
+
+BITMAP_FORMAT_COMPRESSED = 1
+
+
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.bits = 0
+
+    def write(self, value, length):
+        for i in range(length - 1, -1, -1):
+            if self.bits % 8 == 0:
+                self.data.append(0)
+            if (value >> i) & 1:
+                self.data[-1] |= 0x80 >> (self.bits % 8)
+            self.bits += 1
+
+
+# LVGLのrle_nextが読み戻せる並びにする
+#   1つずつの値の後、直前と同じ値が来たら繰り返しになり、同じ値の間は1を書く(違う値なら0と値)
+#   1が11個続いたら、残りの繰り返しの数(6bit)を書き、その数だけ進んだ所の値を書く
+def rle_encode(values, bpp):
+    out = BitWriter()
+    prev = None
+    repeating = False
+    count = 0
+    i = 0
+    while i < len(values):
+        value = values[i]
+        if not repeating:
+            out.write(value, bpp)
+            repeating = value == prev
+            count = 0
+            prev = value
+            i += 1
+        elif value == prev:
+            out.write(1, 1)
+            count += 1
+            i += 1
+            if count == 11:
+                run = 0
+                while i + run < len(values) and values[i + run] == prev and run < 62:
+                    run += 1
+                out.write(run + 1, 6)
+                i += run
+                if i < len(values):
+                    out.write(values[i], bpp)
+                    prev = values[i]
+                    i += 1
+                repeating = False
+        else:
+            out.write(0, 1)
+            out.write(value, bpp)
+            prev = value
+            repeating = False
+            i += 1
+    return bytes(out.data)
+
+
+def unpack(data, bpp, count):
+    mask = (1 << bpp) - 1
+    return [(data[(i * bpp) >> 3] >> (8 - bpp - ((i * bpp) & 7))) & mask for i in range(count)]
+
+
+def compress_glyph(data, box_w, box_h, bpp):
+    pixels = unpack(data, bpp, box_w * box_h)
+    values = pixels[:box_w]
+    for y in range(1, box_h):
+        values += [pixels[y * box_w + x] ^ pixels[(y - 1) * box_w + x] for x in range(box_w)]
+    return rle_encode(values, bpp)
+
+
+# 圧縮したビットマップ全体と、グリフごとの位置
+def compress_font(font):
+    bitmap = bytearray()
+    indexes = []
+    chunks = []
+    for glyph_id, (index, _, box_w, box_h, _, _) in enumerate(font['glyphs']):
+        size = font_pack.glyph_size(font, glyph_id)
+        chunk = compress_glyph(font['bitmap'][index:index + size], box_w, box_h, font['bpp']) if size > 0 else b''
+        indexes.append(len(bitmap))
+        chunks.append(chunk)
+        bitmap += chunk
+    # LVGLのget_bitsは最後のグリフの次の1バイトを読むことがある
+    bitmap.append(0)
+    return bytes(bitmap), indexes, chunks
+
+
+def hex_lines(data, indent='    '):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ', '.join('0x%x' % b for b in data[i:i + 16]) + ',')
+    return lines
+
+
+def rewrite_source(text, font, indexes, chunks):
+    # グリフごとのコメント(/* U+XXXX "c" */)を元のビットマップから集め、同じ順に並べる
+    m = re.search(r'(glyph_bitmap\[\] = \{\n)(.*?)(\n\};)', text, re.S)
+    comments = re.findall(r'^\s*(/\* U\+[0-9A-F]+ .*? \*/)$', m.group(2), re.M)
+    lines = []
+    comment_index = 0
+    for glyph_id, chunk in enumerate(chunks):
+        if glyph_id == 0:
+            continue
+        if comment_index < len(comments):
+            lines.append('    ' + comments[comment_index])
+            comment_index += 1
+        lines += hex_lines(chunk)
+        lines.append('')
+    lines += ['    /* end */', '    0x0']
+    text = text[:m.start(2)] + '\n'.join(lines) + text[m.end(2):]
+
+    it = iter(indexes)
+    text = re.sub(r'\.bitmap_index = \d+', lambda _: '.bitmap_index = %d' % next(it), text)
+    text = re.sub(r'\.bitmap_format = \d+', '.bitmap_format = %d' % BITMAP_FORMAT_COMPRESSED, text)
+    return text.replace(' --no-compress', '', 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='compress the glyph bitmaps of lv_font_conv C fonts')
+    parser.add_argument('sources', nargs='+')
+    parser.add_argument('-o', '--output', help='output file (one source only)')
+    parser.add_argument('--report', action='store_true', help='print sizes only')
+    args = parser.parse_args()
+    if args.output is not None and len(args.sources) != 1:
+        parser.error('--output needs exactly one source')
+
+    if args.report:
+        print('%-20s %8s %10s %10s %6s' % ('font', 'glyphs', 'plain', 'compressed', 'ratio'))
+    for source in args.sources:
+        font = font_pack.parse_font(source)
+        if font['bitmap_format'] != 0:
+            raise ValueError(source + ': already compressed')
+        bitmap, indexes, chunks = compress_font(font)
+        name = os.path.splitext(os.path.basename(source))[0]
+        plain = len(font['bitmap'])
+        if args.report:
+            print('%-20s %8d %10d %10d %5.1f%%' % (name, len(font['glyphs']) - 1, plain, len(bitmap), len(bitmap) * 100.0 / plain))
+            continue
+        text = open(source, encoding='utf-8').read()
+        output = args.output or source
+        with open(output, 'w', encoding='utf-8') as f:
+            f.write(rewrite_source(text, font, indexes, chunks))
+        print('%s: bitmap %d -> %d bytes' % (output, plain, len(bitmap)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+#
+# lv_font_convで作ったフォントのCソース(--format lvgl)を、SDカードに置くフォントパック(.fpk)に変換する
+#
+#   python3 fonts/font_pack.py fonts/mplus1_regular/mplus1_regular_14.c -o mplus1_regular_14.fpk
+#   python3 fonts/font_pack.py fonts/mplus1_*/*.c -d sd/fonts
+#
+# 形式はsrc/font_pack.hppを参照。全てリトルエンディアン
+# ビットマップはページ(既定4096バイト)の境界をまたがないように詰める
+#
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = b'LFPK'
+VERSION = 1
+HEADER = struct.Struct('<4sHHhhbbBBHHIBBHIIIII')
+CMAP = struct.Struct('<IHHHBx')
+GLYPH = struct.Struct('<IBBbb')
+
+CMAP_TYPES = {
+    'LV_FONT_FMT_TXT_CMAP_FORMAT0_FULL': 0,
+    'LV_FONT_FMT_TXT_CMAP_SPARSE_FULL': 1,
+    'LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY': 2,
+    'LV_FONT_FMT_TXT_CMAP_SPARSE_TINY': 3,
+}
+
+
+def strip_comments(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    return re.sub(r'//[^\n]*', '', text)
+
+
+def parse_numbers(body):
+    return [int(v, 0) for v in re.findall(r'-?(?:0x[0-9a-fA-F]+|\d+)', body)]
+
+
+def parse_arrays(text):
+    arrays = {}
+    for m in re.finditer(r'static\s+(?:LV_ATTRIBUTE_LARGE_CONST\s+)?const\s+u?int(?:8|16)_t\s+(\w+)\[\]\s*=\s*\{(.*?)\};', text, re.S):
+        arrays[m.group(1)] = parse_numbers(m.group(2))
+    return arrays
+
+
+def field(text, name, default=None):
+    m = re.search(r'\.' + name + r'\s*=\s*(-?&?\w+)', text)
+    if m is None:
+        if default is None:
+            raise ValueError('missing .' + name)
+        return default
+    return m.group(1)
+
+
+def parse_cmaps(text, arrays):
+    cmaps = []
+    m = re.search(r'cmaps\[\]\s*=\s*\{(.*?)\n\};', text, re.S)
+    for c in re.finditer(r'\{(.*?)\}', m.group(1), re.S):
+        body = c.group(1)
+        unicode_list = field(body, 'unicode_list')
+        ofs_list = field(body, 'glyph_id_ofs_list')
+        cmaps.append({
+            'range_start': int(field(body, 'range_start')),
+            'range_length': int(field(body, 'range_length')),
+            'glyph_id_start': int(field(body, 'glyph_id_start')),
+            'list_length': int(field(body, 'list_length')),
+            'type': CMAP_TYPES[field(body, 'type')],
+            'unicode_list': None if unicode_list == 'NULL' else arrays[unicode_list],
+            'glyph_id_ofs_list': None if ofs_list == 'NULL' else arrays[ofs_list],
+        })
+    return cmaps
+
+
+# フォントにある文字の集合。FORMAT0_FULLのリストで0の所(先頭以外)はグリフが無い
+def cmap_codepoints(cmaps):
+    codepoints = set()
+    for cmap in cmaps:
+        if cmap['unicode_list'] is not None:
+            codepoints.update(cmap['range_start'] + rcp for rcp in cmap['unicode_list'])
+        elif cmap['glyph_id_ofs_list'] is not None:
+            codepoints.update(cmap['range_start'] + rcp for rcp, ofs in enumerate(cmap['glyph_id_ofs_list']) if ofs != 0 or rcp == 0)
+        else:
+            codepoints.update(range(cmap['range_start'], cmap['range_start'] + cmap['range_length']))
+    return codepoints
+
+
+# 文字からグリフ番号への対応
+def cmap_glyph_ids(cmaps):
+    glyph_ids = {}
+    for cmap in cmaps:
+        start = cmap['range_start']
+        if cmap['unicode_list'] is not None:
+            for i, rcp in enumerate(cmap['unicode_list']):
+                ofs = cmap['glyph_id_ofs_list'][i] if cmap['glyph_id_ofs_list'] is not None else i
+                glyph_ids.setdefault(start + rcp, cmap['glyph_id_start'] + ofs)
+        elif cmap['glyph_id_ofs_list'] is not None:
+            for rcp, ofs in enumerate(cmap['glyph_id_ofs_list']):
+                if ofs != 0 or rcp == 0:
+                    glyph_ids.setdefault(start + rcp, cmap['glyph_id_start'] + ofs)
+        else:
+            for rcp in range(cmap['range_length']):
+                glyph_ids.setdefault(start + rcp, cmap['glyph_id_start'] + rcp)
+    return glyph_ids
+
+
+def parse_font(path):
+    text = strip_comments(open(path, encoding='utf-8').read())
+    arrays = parse_arrays(text)
+
+    glyphs = []
+    m = re.search(r'glyph_dsc\[\]\s*=\s*\{(.*?)\n\};', text, re.S)
+    for g in re.finditer(r'\{\s*\.bitmap_index\s*=\s*(\d+),\s*\.adv_w\s*=\s*(\d+),\s*\.box_w\s*=\s*(\d+),\s*\.box_h\s*=\s*(\d+),\s*\.ofs_x\s*=\s*(-?\d+),\s*\.ofs_y\s*=\s*(-?\d+)\s*\}', m.group(1)):
+        glyphs.append(tuple(int(v) for v in g.groups()))
+
+    cmaps = parse_cmaps(text, arrays)
+
+    m = re.search(r'lv_font_fmt_txt_dsc_t\s+font_dsc\s*=\s*\{(.*?)\};', text, re.S)
+    dsc = m.group(1)
+    kern_dsc = field(dsc, 'kern_dsc')
+    kern = None
+    if kern_dsc != 'NULL':
+        if int(field(dsc, 'kern_classes')) != 1:
+            raise ValueError('kerning pairs are not supported (use class kerning)')
+        m = re.search(r'kern_classes\s*=\s*\{(.*?)\};', text, re.S)
+        kern = {
+            'left': arrays[field(m.group(1), 'left_class_mapping')],
+            'right': arrays[field(m.group(1), 'right_class_mapping')],
+            'values': arrays[field(m.group(1), 'class_pair_values')],
+            'left_count': int(field(m.group(1), 'left_class_cnt')),
+            'right_count': int(field(m.group(1), 'right_class_cnt')),
+        }
+
+    m = re.search(r'\blv_font_t\s+\w+\s*=\s*\{(.*?)\};', text, re.S)
+    public = m.group(1)
+    return {
+        'bitmap': bytes(arrays['glyph_bitmap']),
+        'glyphs': glyphs,
+        'cmaps': cmaps,
+        'kern': kern,
+        'kern_scale': int(field(dsc, 'kern_scale')),
+        'bpp': int(field(dsc, 'bpp')),
+        'bitmap_format': int(field(dsc, 'bitmap_format')),
+        'line_height': int(field(public, 'line_height')),
+        'base_line': int(field(public, 'base_line')),
+        'underline_position': int(field(public, 'underline_position', '0')),
+        'underline_thickness': int(field(public, 'underline_thickness', '0')),
+    }
+
+
+def glyph_size(font, glyph_id):
+    _, _, box_w, box_h, _, _ = font['glyphs'][glyph_id]
+    return (box_w * box_h * font['bpp'] + 7) // 8
+
+
+# グリフのビットマップをページの境界をまたがないように並べ直し、新しいbitmap_indexの列を返す
+def layout_bitmaps(font, page_size):
+    out = bytearray()
+    indexes = []
+    for glyph_id, glyph in enumerate(font['glyphs']):
+        size = glyph_size(font, glyph_id)
+        if size > page_size:
+            raise ValueError('glyph %d (%d bytes) does not fit in a page' % (glyph_id, size))
+        if size > 0 and len(out) // page_size != (len(out) + size - 1) // page_size:
+            out.extend(b'\0' * (page_size - len(out) % page_size))
+        indexes.append(len(out))
+        out.extend(font['bitmap'][glyph[0]:glyph[0] + size])
+    if len(out) >= 1 << 20:
+        raise ValueError('bitmap is too large (%d bytes)' % len(out))
+    return bytes(out), indexes
+
+
+def align(data, boundary):
+    return data + b'\0' * (-len(data) % boundary)
+
+
+def build_pack(font, page_size):
+    if font['bitmap_format'] != 0:
+        raise ValueError('compressed bitmaps are not supported')
+    bitmap, indexes = layout_bitmaps(font, page_size)
+
+    # cmapの表の後に、cmapの順でunicode_listとglyph_id_ofs_listを置く(2バイト境界)
+    cmap_records = b''
+    cmap_lists = b''
+    for cmap in font['cmaps']:
+        cmap_records += CMAP.pack(cmap['range_start'], cmap['range_length'], cmap['glyph_id_start'], cmap['list_length'], cmap['type'])
+        if cmap['unicode_list'] is not None:
+            cmap_lists += struct.pack('<%dH' % len(cmap['unicode_list']), *cmap['unicode_list'])
+        if cmap['glyph_id_ofs_list'] is not None:
+            code = 'H' if cmap['type'] == CMAP_TYPES['LV_FONT_FMT_TXT_CMAP_SPARSE_FULL'] else 'B'
+            cmap_lists = align(cmap_lists + struct.pack('<%d%s' % (len(cmap['glyph_id_ofs_list']), code), *cmap['glyph_id_ofs_list']), 2)
+
+    glyphs = b''.join(GLYPH.pack(index | (adv_w << 20), box_w, box_h, ofs_x, ofs_y)
+                      for index, (_, adv_w, box_w, box_h, ofs_x, ofs_y) in zip(indexes, font['glyphs']))
+
+    kern = font['kern']
+    kern_data = b''
+    if kern is not None:
+        kern_data = bytes(kern['left']) + bytes(kern['right']) + struct.pack('<%db' % len(kern['values']), *kern['values'])
+
+    cmap_offset = HEADER.size
+    glyph_offset = cmap_offset + len(align(cmap_records + cmap_lists, 4))
+    kern_offset = glyph_offset + len(glyphs)
+    bitmap_offset = kern_offset + len(align(kern_data, 4))
+    header = HEADER.pack(MAGIC, VERSION, page_size,
+                         font['line_height'], font['base_line'], font['underline_position'], font['underline_thickness'],
+                         font['bpp'], 1 if kern is not None else 0, font['kern_scale'], len(font['cmaps']), len(font['glyphs']),
+                         kern['left_count'] if kern is not None else 0, kern['right_count'] if kern is not None else 0, 0,
+                         cmap_offset, glyph_offset, kern_offset, bitmap_offset, len(bitmap))
+    return header + align(cmap_records + cmap_lists, 4) + glyphs + align(kern_data, 4) + bitmap
+
+
+def main():
+    parser = argparse.ArgumentParser(description='convert lv_font_conv C fonts to SD font packs')
+    parser.add_argument('sources', nargs='+')
+    parser.add_argument('-o', '--output', help='output file (one source only)')
+    parser.add_argument('-d', '--directory', default='.', help='output directory')
+    parser.add_argument('--page-size', type=int, default=4096, help='bitmap page size (FONT_PACK_PAGE_SIZE)')
+    args = parser.parse_args()
+    if args.output is not None and len(args.sources) != 1:
+        parser.error('--output needs exactly one source')
+
+    for source in args.sources:
+        font = parse_font(source)
+        pack = build_pack(font, args.page_size)
+        output = args.output or os.path.join(args.directory, os.path.splitext(os.path.basename(source))[0] + '.fpk')
+        with open(output, 'wb') as f:
+            f.write(pack)
+        print('%s: %d glyphs, %d bytes (bitmap %d bytes)' % (output, len(font['glyphs']), len(pack), len(font['bitmap'])))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
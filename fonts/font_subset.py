@@ -0,0 +1,362 @@
+#
+# mplus1_*のフォントを、src/のUIの文字列と翻訳のカタログで使っている文字だけで作り直すPlatformIOのスクリプト
+#
+# platformio.iniの環境に次を書くと、ビルドの前に src/font_subset/<フォント名>.c を作る
+#
+#   extra_scripts = pre:fonts/font_subset.py
+#   custom_font_subset = mplus1_regular_14 mplus1_bold_20    ; 作るフォント
+#   custom_font_reserve = 0x20-0x7e ・ー                     ; 常に入れる文字(範囲か文字そのもの)
+#   custom_font_ttf_dir = fonts/ttf                          ; Mplus1-*.ttfのあるフォルダ
+#   custom_font_exclude = sim/* *_bench.cpp                  ; 文字を集めないsrc/のファイル(ベンチマークの文章など)
+#   custom_font_conv = npx lv_font_conv                      ; lv_font_convのコマンド
+#   custom_font_compress = yes                               ; ビットマップを圧縮する(lv_conf.hのLV_USE_FONT_COMPRESSEDが必要)
+#
+# TTFがあれば、lv_font_convのオプションを fonts/mplus1_<太さ>/<フォント名>.c の先頭のOptsの行と同じにし、--symbolsだけを差し替えて作る
+# TTFが無ければ(リポジトリには含まれない)、fonts/のCソースから使う文字のグリフだけを抜き出し、cmapとカーニングの表を作り直す
+# 元のフォントに無い文字は入れない。文字とオプションが前回と同じなら作り直さない
+# custom_font_subsetが空(既定)なら何もしない。fonts/のフォントは書き換えない
+# 手元で確かめる時は python3 fonts/font_subset.py mplus1_regular_14 で文字の一覧と大きさを表示する
+#
+
+import fnmatch
+import glob
+import hashlib
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+FONT_NAME = re.compile(r'^mplus1_(light|regular|bold)_(\d+)$')
+SOURCE_PATTERNS = ('**/*.c', '**/*.cpp', '**/*.h', '**/*.hpp')
+CATALOGUE_PATTERNS = ('**/*.po', '**/*.json')
+OUTPUT_DIR = 'font_subset'
+DEFAULT_RESERVE = '0x20-0x7e'
+# ベンチマークの文章(glyph_index.cpp、glyph_cache.cpp)とシミュレータはUIに出ない
+DEFAULT_EXCLUDE = 'sim/* *_bench.cpp glyph_index.cpp glyph_cache.cpp'
+SPARSE_RUN = 4  # これ以上続く文字はFORMAT0_TINYのcmapにし、残りはSPARSE_TINYのcmapにまとめる
+
+ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '0': '\0', '\\': '\\', '"': '"', "'": "'"}
+
+
+def unescape(literal):
+    return re.sub(r'\\(x[0-9a-fA-F]+|u[0-9a-fA-F]{4}|U[0-9a-fA-F]{8}|.)',
+                  lambda m: chr(int(m.group(1)[1:], 16)) if m.group(1)[0] in 'xuU' else ESCAPES.get(m.group(1), m.group(1)),
+                  literal)
+
+
+# ソースの文字列リテラル(コメントは除く)
+def source_strings(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'//[^\n]*', '', text)
+    return [unescape(s) for s in re.findall(r'"((?:[^"\\\n]|\\.)*)"', text)]
+
+
+# gettextのカタログのmsgstr、JSONのカタログの値
+def catalogue_strings(path, text):
+    if path.endswith('.po'):
+        return [unescape(s) for s in re.findall(r'^msgstr(?:\[\d+\])?\s+"((?:[^"\\]|\\.)*)"', text, re.M)]
+    strings = []
+
+    def collect(value):
+        if isinstance(value, str):
+            strings.append(value)
+        elif isinstance(value, dict):
+            for v in value.values():
+                collect(v)
+        elif isinstance(value, list):
+            for v in value:
+                collect(v)
+    collect(json.loads(text))
+    return strings
+
+
+# excludeはsrc/からの相対パスのパターンを空白で区切ったもの
+def used_characters(src_dir, exclude=DEFAULT_EXCLUDE):
+    chars = set()
+    excluded = [OUTPUT_DIR + '/*'] + exclude.split()
+    for patterns, extract in ((SOURCE_PATTERNS, lambda path, text: source_strings(text)), (CATALOGUE_PATTERNS, catalogue_strings)):
+        for pattern in patterns:
+            for path in glob.glob(os.path.join(src_dir, pattern), recursive=True):
+                relative = os.path.relpath(path, src_dir).replace(os.sep, '/')
+                if any(fnmatch.fnmatch(relative, e) for e in excluded):
+                    continue
+                with open(path, encoding='utf-8') as f:
+                    for s in extract(path, f.read()):
+                        chars.update(c for c in s if ord(c) >= 0x20)
+    return chars
+
+
+# "0x20-0x7e ・ー" のように、範囲か文字そのものを空白で区切る
+def reserve_characters(spec):
+    chars = set()
+    for token in spec.split():
+        m = re.match(r'^(0x[0-9a-fA-F]+)-(0x[0-9a-fA-F]+)$', token)
+        if m:
+            chars.update(chr(c) for c in range(int(m.group(1), 16), int(m.group(2), 16) + 1))
+        else:
+            chars.update(token)
+    return chars
+
+
+def font_pack_module():
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    import font_pack
+    return font_pack
+
+
+def font_compress_module():
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    import font_compress
+    return font_compress
+
+
+# 元のフォントのlv_font_convのオプション(--symbolsを除く)と、フォントにある文字の集合
+def full_font(fonts_dir, name):
+    font_pack = font_pack_module()
+    weight = FONT_NAME.match(name).group(1)
+    path = os.path.join(fonts_dir, 'mplus1_' + weight, name + '.c')
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    m = re.search(r'^ \* Opts: (.*) --symbols .*? (--format .*)$', text, re.M)
+    if m is None:
+        raise ValueError(path + ': no Opts line')
+    # 文字の表の部分だけを読む(ビットマップは読まない)
+    mapping = font_pack.strip_comments(text[text.index('CHARACTER MAPPING'):text.index('ALL CUSTOM DATA')])
+    cmaps = font_pack.parse_cmaps(mapping, font_pack.parse_arrays(mapping))
+    return path, m.group(1).split() + m.group(2).split(), set(chr(c) for c in font_pack.cmap_codepoints(cmaps))
+
+
+def converter_arguments(options, ttf_dir, symbols, output, compress):
+    args = []
+    i = 0
+    while i < len(options):
+        option = options[i]
+        if option == '--font':
+            args += ['--font', os.path.join(ttf_dir, options[i + 1])]
+            i += 2
+        elif option == '-o':
+            i += 2
+        elif option == '--no-compress' and compress:
+            i += 1
+        else:
+            args.append(option)
+            i += 1
+    return args + ['--symbols', ''.join(sorted(symbols)), '-o', output]
+
+
+# Optsの--fontのTTF
+def ttf_path(options, ttf_dir):
+    return os.path.join(ttf_dir, options[options.index('--font') + 1])
+
+
+def number_lines(values, per_line=8):
+    return ',\n'.join('    ' + ', '.join(values[i:i + per_line]) for i in range(0, len(values), per_line))
+
+
+# 文字の並びをcmapに分ける。グリフ番号は文字の順に1から振る
+def build_cmaps(codepoints):
+    cmaps = []
+    sparse = []
+
+    def add_sparse():
+        if sparse:
+            cmaps.append({'range_start': sparse[0], 'range_length': sparse[-1] - sparse[0] + 1,
+                          'glyph_id_start': codepoints.index(sparse[0]) + 1, 'unicode_list': [cp - sparse[0] for cp in sparse]})
+            del sparse[:]
+
+    i = 0
+    while i < len(codepoints):
+        j = i
+        while j + 1 < len(codepoints) and codepoints[j + 1] == codepoints[j] + 1:
+            j += 1
+        if j - i + 1 >= SPARSE_RUN:
+            add_sparse()
+            cmaps.append({'range_start': codepoints[i], 'range_length': j - i + 1, 'glyph_id_start': i + 1, 'unicode_list': None})
+        else:
+            for cp in codepoints[i:j + 1]:
+                # unicode_listは範囲の先頭からの差を16bitで持つ
+                if sparse and cp - sparse[0] > 0xffff:
+                    add_sparse()
+                sparse.append(cp)
+        i = j + 1
+    add_sparse()
+    return cmaps
+
+
+def cmap_source(cmaps):
+    lines = []
+    entries = []
+    for i, cmap in enumerate(cmaps):
+        if cmap['unicode_list'] is None:
+            entries.append('    {\n        .range_start = %d, .range_length = %d, .glyph_id_start = %d,\n'
+                           '        .unicode_list = NULL, .glyph_id_ofs_list = NULL, .list_length = 0, .type = LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY\n    }'
+                           % (cmap['range_start'], cmap['range_length'], cmap['glyph_id_start']))
+            continue
+        lines += ['static const uint16_t unicode_list_%d[] = {' % i, number_lines(['0x%x' % v for v in cmap['unicode_list']]), '};', '']
+        entries.append('    {\n        .range_start = %d, .range_length = %d, .glyph_id_start = %d,\n'
+                       '        .unicode_list = unicode_list_%d, .glyph_id_ofs_list = NULL, .list_length = %d, .type = LV_FONT_FMT_TXT_CMAP_SPARSE_TINY\n    }'
+                       % (cmap['range_start'], cmap['range_length'], cmap['glyph_id_start'], i, len(cmap['unicode_list'])))
+    lines += ['/*Collect the unicode lists and glyph_id offsets*/', 'static const lv_font_fmt_txt_cmap_t cmaps[] =', '{', ',\n'.join(entries), '};', '']
+    return '\n'.join(lines)
+
+
+def replace_body(text, pattern, body):
+    m = re.search(pattern, text, re.S)
+    if m is None:
+        raise ValueError('no match for ' + pattern)
+    return text[:m.start(2)] + body + text[m.end(2):]
+
+
+# lv_font_convの出力と同じ形のCソースを、symbolsのグリフだけにして書き出す
+def subset_source(full_path, symbols, output, compress):
+    font_pack = font_pack_module()
+    font = font_pack.parse_font(full_path)
+    text = open(full_path, encoding='utf-8').read()
+    glyph_ids = font_pack.cmap_glyph_ids(font['cmaps'])
+    codepoints = sorted(ord(c) for c in symbols if ord(c) in glyph_ids)
+    comments = dict((int(m.group(1), 16), m.group(0)) for m in re.finditer(r'/\* U\+([0-9A-F]+) ".*?" \*/', text))
+
+    bitmap_lines = []
+    dsc_lines = ['    {.bitmap_index = 0, .adv_w = 0, .box_w = 0, .box_h = 0, .ofs_x = 0, .ofs_y = 0} /* id = 0 reserved */']
+    bitmap_size = 0
+    for cp in codepoints:
+        glyph_id = glyph_ids[cp]
+        index, adv_w, box_w, box_h, ofs_x, ofs_y = font['glyphs'][glyph_id]
+        data = font['bitmap'][index:index + font_pack.glyph_size(font, glyph_id)]
+        dsc_lines.append('    {.bitmap_index = %d, .adv_w = %d, .box_w = %d, .box_h = %d, .ofs_x = %d, .ofs_y = %d}'
+                         % (bitmap_size, adv_w, box_w, box_h, ofs_x, ofs_y))
+        bitmap_lines += ['    ' + comments.get(cp, '/* U+%04X */' % cp)]
+        if data:
+            bitmap_lines += [number_lines(['0x%x' % b for b in data]) + ',']
+        bitmap_lines.append('')
+        bitmap_size += len(data)
+    # LVGLのget_bitsは最後のグリフの次の1バイトを読むことがある
+    bitmap_lines += ['    /* end */', '    0x0']
+
+    text = replace_body(text, r'(glyph_bitmap\[\] = \{\n)(.*?)(\n\};)', '\n'.join(bitmap_lines))
+    text = replace_body(text, r'(glyph_dsc\[\] = \{\n)(.*?)(\n\};)', ',\n'.join(dsc_lines))
+    cmaps = build_cmaps(codepoints)
+    text = replace_body(text, r'(CHARACTER MAPPING\n \*-+\*/\n\n)(.*?)(\n/\*-+\n \*\s+(?:KERNING|ALL CUSTOM DATA))', cmap_source(cmaps))
+    text = re.sub(r'\.cmap_num = \d+', '.cmap_num = %d' % len(cmaps), text)
+    # カーニングのクラスはグリフ番号で引くので、並べ直すだけでクラスの値の表はそのまま使える
+    kern = font['kern']
+    if kern is not None:
+        for side in ('left', 'right'):
+            classes = [0] + [kern[side][glyph_ids[cp]] for cp in codepoints]
+            text = replace_body(text, r'(kern_%s_class_mapping\[\] =\n\{\n)(.*?)(\n\};)' % side, number_lines([str(v) for v in classes]))
+    symbols_text = ''.join(chr(cp) for cp in codepoints).replace('*/', '*\\/')
+    text = re.sub(r'--symbols .*? --format', lambda _: '--symbols %s --format' % symbols_text, text, count=1)
+
+    with open(output, 'w', encoding='utf-8') as f:
+        f.write(text)
+    if compress:
+        font_compress = font_compress_module()
+        font = font_pack.parse_font(output)
+        _, indexes, chunks = font_compress.compress_font(font)
+        with open(output, 'w', encoding='utf-8') as f:
+            f.write(font_compress.rewrite_source(text, font, indexes, chunks))
+
+
+def bitmap_size(path):
+    font_pack = font_pack_module()
+    font = font_pack.parse_font(path)
+    if font['bitmap_format'] != 0:
+        return len(font['glyphs']) - 1, len(font['bitmap'])
+    return len(font['glyphs']) - 1, sum(font_pack.glyph_size(font, i) for i in range(len(font['glyphs'])))
+
+
+def subset(name, fonts_dir, src_dir, reserve, exclude, ttf_dir, conv, compress, log):
+    if FONT_NAME.match(name) is None:
+        raise ValueError('unknown font ' + name)
+    full_path, options, available = full_font(fonts_dir, name)
+    wanted = used_characters(src_dir, exclude) | reserve_characters(reserve)
+    symbols = wanted & available
+    missing = sorted(c for c in wanted - available if ord(c) > 0x7e)
+
+    output_dir = os.path.join(src_dir, OUTPUT_DIR)
+    output = os.path.join(output_dir, name + '.c')
+    use_ttf = os.path.exists(ttf_path(options, ttf_dir))
+    if use_ttf:
+        args = converter_arguments(options, ttf_dir, symbols, output, compress)
+        key = [conv, args]
+    else:
+        with open(full_path, 'rb') as f:
+            key = [hashlib.sha1(f.read()).hexdigest(), ''.join(sorted(symbols)), compress]
+    digest = hashlib.sha1(json.dumps(key).encode('utf-8')).hexdigest()
+    stamp = os.path.join(output_dir, name + '.stamp')
+    if os.path.exists(output) and os.path.exists(stamp) and open(stamp).read() == digest:
+        return False
+
+    os.makedirs(output_dir, exist_ok=True)
+    if use_ttf:
+        subprocess.check_call(shlex.split(conv) + args)
+    else:
+        subset_source(full_path, symbols, output, compress)
+    with open(stamp, 'w') as f:
+        f.write(digest)
+    glyphs, size = bitmap_size(output)
+    full_glyphs, full_size = bitmap_size(full_path)
+    log('%s : %d of %d glyphs, bitmap %d of %d bytes (from %s)'
+        % (name, glyphs, full_glyphs, size, full_size, 'ttf' if use_ttf else os.path.relpath(full_path, os.path.dirname(fonts_dir))))
+    if missing:
+        log('%s : not in the font : %s' % (name, ''.join(missing)))
+    return True
+
+
+# custom_font_subsetから外したフォントを消す
+def remove_stale(src_dir, names):
+    for path in glob.glob(os.path.join(src_dir, OUTPUT_DIR, 'mplus1_*')):
+        if os.path.splitext(os.path.basename(path))[0] not in names:
+            os.remove(path)
+
+
+def main():
+    project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    fonts_dir = os.path.join(project_dir, 'fonts')
+    src_dir = os.path.join(project_dir, 'src')
+    reserve = os.environ.get('FONT_RESERVE', DEFAULT_RESERVE)
+    exclude = os.environ.get('FONT_EXCLUDE', DEFAULT_EXCLUDE)
+    font_pack = font_pack_module()
+    for name in sys.argv[1:] or ['mplus1_regular_14']:
+        full_path, _, available = full_font(fonts_dir, name)
+        wanted = used_characters(src_dir, exclude) | reserve_characters(reserve)
+        symbols = wanted & available
+        # Cソースから抜き出した場合のビットマップの大きさ
+        font = font_pack.parse_font(full_path)
+        glyph_ids = font_pack.cmap_glyph_ids(font['cmaps'])
+        size = sum(font_pack.glyph_size(font, glyph_ids[ord(c)]) for c in symbols)
+        print('%s : %d of %d characters, bitmap %d of %d bytes' % (name, len(symbols), len(available), size, len(font['bitmap'])))
+        print(''.join(sorted(c for c in symbols if ord(c) > 0x7e)))
+    return 0
+
+
+try:
+    Import('env')  # noqa: F821 (PlatformIOのSConsが定義する)
+except NameError:
+    env = None
+
+if env is not None:
+    names = env.GetProjectOption('custom_font_subset', '').split()
+    remove_stale(env.subst('$PROJECT_SRC_DIR'), names)
+    if names:
+        project_dir = env.subst('$PROJECT_DIR')
+        for name in names:
+            try:
+                subset(name,
+                       os.path.join(project_dir, 'fonts'),
+                       env.subst('$PROJECT_SRC_DIR'),
+                       env.GetProjectOption('custom_font_reserve', DEFAULT_RESERVE),
+                       env.GetProjectOption('custom_font_exclude', DEFAULT_EXCLUDE),
+                       os.path.join(project_dir, env.GetProjectOption('custom_font_ttf_dir', 'fonts/ttf')),
+                       env.GetProjectOption('custom_font_conv', 'npx lv_font_conv'),
+                       env.GetProjectOption('custom_font_compress', 'no').lower() in ('yes', 'true', '1'),
+                       print)
+            except (OSError, ValueError, subprocess.CalledProcessError) as e:
+                sys.stderr.write('font_subset : %s : %s\n' % (name, e))
+                env.Exit(1)
+        # 作ったフォントは"lvgl/lvgl.h"ではなく"lvgl.h"を読むようにする
+        env.Append(CPPDEFINES=['LV_LVGL_H_INCLUDE_SIMPLE'])
+elif __name__ == '__main__':
+    sys.exit(main())
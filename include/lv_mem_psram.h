@@ -0,0 +1,65 @@
+/**
+ * @file lv_mem_psram.h
+ * LVGLのヒープ(LV_MEM_CUSTOM)
+ *
+ * PSRAMに確保したプールをTLSF(Two-Level Segregated Fit)で管理する
+ * 128バイト以下の確保はサイズクラスごとのスロットから取り、細かいブロックでプールが断片化しないようにする
+ * 描画中の確保(描画の中間バッファやレイヤー)はPSRAMより速い内部RAMから取る
+ *
+ * lv_conf.hのLV_MEM_PSRAMが1の場合に使う。プールの大きさはLV_MEM_PSRAM_SIZE
+ */
+
+#ifndef LV_MEM_PSRAM_H
+#define LV_MEM_PSRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    size_t total_size;         /*プールの大きさ*/
+    size_t used_size;          /*使用中の大きさ(ブロックのヘッダとサイズクラスのページを含む)*/
+    size_t max_used;           /*used_sizeの最大値*/
+    size_t free_size;          /*空きブロックの合計*/
+    size_t free_biggest_size;  /*最大の空きブロック。これより大きい確保はプールからはできない*/
+    uint32_t used_cnt;         /*確保中の数(プールの外にあるものを含む)*/
+    uint32_t free_cnt;         /*空きブロックの数*/
+    uint8_t frag_pct;          /*断片化率(%)。100 - 最大の空きブロック / 空きの合計*/
+    size_t class_size;         /*サイズクラスのページの合計*/
+    size_t class_free;         /*そのうち空いているスロットの合計*/
+    uint32_t outside_cnt;      /*プールの外(描画中の内部RAMなど)にある確保の数*/
+    uint32_t fallback_cnt;     /*プールが足りずに他のヒープから確保した回数*/
+} lv_mem_psram_stats_t;
+
+void * lv_mem_psram_alloc(size_t size);
+void lv_mem_psram_free(void * ptr);
+void * lv_mem_psram_realloc(void * ptr, size_t size);
+
+/**
+ * プールから確保できない時に呼ぶ関数。sizeバイト以上を目安に解放し、解放したバイト数を返す
+ * 0以外を返したらもう一度プールから確保し、それでも足りなければ他のヒープから取る
+ */
+typedef size_t (*lv_mem_psram_pressure_cb_t)(size_t size);
+void lv_mem_psram_set_pressure_cb(lv_mem_psram_pressure_cb_t cb);
+
+/**
+ * beginからendまでの確保は、描画中でも内部RAMではなくプールから取る
+ * 描画の後も持ち続けるもの(画像とグラデーションのキャッシュ)を作る時に使う。入れ子にできる
+ */
+void lv_mem_psram_pool_begin(void);
+void lv_mem_psram_pool_end(void);
+
+/**
+ * 使用量を取得する。プールの空きブロックを全て辿るので、頻繁には呼ばないこと
+ * LV_MEM_PSRAMが0の場合はlv_mem_monitorの値を入れる
+ */
+void lv_mem_psram_get_stats(lv_mem_psram_stats_t * stats);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_MEM_PSRAM_H*/
@@ -27,7 +27,7 @@
 #define LV_COLOR_DEPTH 16
 
 /*Swap the 2 bytes of RGB565 color. Useful if the display has an 8-bit interface (e.g. SPI)*/
-#define LV_COLOR_16_SWAP 0
+#define LV_COLOR_16_SWAP 1
 
 /*Enable features to draw on transparent background.
  *It's required if opa, and transform_* style properties are used.
@@ -45,8 +45,13 @@
    MEMORY SETTINGS
  *=========================*/
 
+/*1: LVGLのヒープをPSRAMのプールに置く(include/lv_mem_psram.h)、0: 内部RAMの`LV_MEM_SIZE`のプールを使う*/
+#ifndef LV_MEM_PSRAM
+#define LV_MEM_PSRAM 1
+#endif
+
 /*1: use custom malloc/free, 0: use the built-in `lv_mem_alloc()` and `lv_mem_free()`*/
-#define LV_MEM_CUSTOM 0
+#define LV_MEM_CUSTOM LV_MEM_PSRAM
 #if LV_MEM_CUSTOM == 0
     /*Size of the memory available for `lv_mem_alloc()` in bytes (>= 2kB)*/
     #define LV_MEM_SIZE (48U * 1024U)          /*[bytes]*/
@@ -60,10 +65,14 @@
     #endif
 
 #else       /*LV_MEM_CUSTOM*/
-    #define LV_MEM_CUSTOM_INCLUDE <stdlib.h>   /*Header for the dynamic memory function*/
-    #define LV_MEM_CUSTOM_ALLOC   malloc
-    #define LV_MEM_CUSTOM_FREE    free
-    #define LV_MEM_CUSTOM_REALLOC realloc
+    /*PSRAMに確保するプールの大きさ。描画中の確保はプールではなく内部RAMから取る*/
+    #ifndef LV_MEM_PSRAM_SIZE
+    #define LV_MEM_PSRAM_SIZE (256U * 1024U)
+    #endif
+    #define LV_MEM_CUSTOM_INCLUDE <lv_mem_psram.h>   /*Header for the dynamic memory function*/
+    #define LV_MEM_CUSTOM_ALLOC   lv_mem_psram_alloc
+    #define LV_MEM_CUSTOM_FREE    lv_mem_psram_free
+    #define LV_MEM_CUSTOM_REALLOC lv_mem_psram_realloc
 #endif     /*LV_MEM_CUSTOM*/
 
 /*Number of the intermediate memory buffer used during rendering and other internal processing mechanisms.
@@ -85,13 +94,17 @@
 
 /*Use a custom tick source that tells the elapsed time in milliseconds.
  *It removes the need to manually update the tick with `lv_tick_inc()`)*/
-#define LV_TICK_CUSTOM 0
+#ifndef UI_SIMULATOR
+#define LV_TICK_CUSTOM 1
+#else
+#define LV_TICK_CUSTOM 0     /*The simulator advances the tick itself with lv_tick_inc()*/
+#endif
 #if LV_TICK_CUSTOM
-    #define LV_TICK_CUSTOM_INCLUDE "Arduino.h"         /*Header for the system time function*/
-    #define LV_TICK_CUSTOM_SYS_TIME_EXPR (millis())    /*Expression evaluating to current system time in ms*/
+    // #define LV_TICK_CUSTOM_INCLUDE "Arduino.h"         /*Header for the system time function*/
+    // #define LV_TICK_CUSTOM_SYS_TIME_EXPR (millis())    /*Expression evaluating to current system time in ms*/
     /*If using lvgl as ESP32 component*/
-    // #define LV_TICK_CUSTOM_INCLUDE "esp_timer.h"
-    // #define LV_TICK_CUSTOM_SYS_TIME_EXPR ((esp_timer_get_time() / 1000LL))
+    #define LV_TICK_CUSTOM_INCLUDE "esp_timer.h"
+    #define LV_TICK_CUSTOM_SYS_TIME_EXPR ((uint32_t)(esp_timer_get_time() / 1000LL))
 #endif   /*LV_TICK_CUSTOM*/
 
 /*Default Dot Per Inch. Used to initialize default sizes such as widgets sized, style paddings.
@@ -114,13 +127,15 @@
     /*Allow buffering some shadow calculation.
     *LV_SHADOW_CACHE_SIZE is the max. shadow size to buffer, where shadow size is `shadow_width + radius`
     *Caching has LV_SHADOW_CACHE_SIZE^2 RAM cost*/
-    #define LV_SHADOW_CACHE_SIZE 0
+    /*ボタンの影(shadow_width + radius)が収まる大きさ。静的な配列なのでcache_budgetの予算の外で1KBを使う*/
+    #define LV_SHADOW_CACHE_SIZE 32
 
     /* Set number of maximally cached circle data.
     * The circumference of 1/4 circle are saved for anti-aliasing
     * radius * 4 bytes are used per circle (the most often used radiuses are saved)
     * 0: to disable caching */
-    #define LV_CIRCLE_CACHE_SIZE 4
+    /*ボタン、スイッチ、スライダーなどの角の半径が入れ替わり続けない数*/
+    #define LV_CIRCLE_CACHE_SIZE 8
 #endif /*LV_DRAW_COMPLEX*/
 
 /**
@@ -157,6 +172,12 @@
  *0 mean no caching.*/
 #define LV_GRAD_CACHE_DEF_SIZE 0
 
+/*画像とグラデーションのキャッシュはLVGLの代わりにsrc/cache_budget.cppが持つ(LV_IMG_CACHE_DEF_SIZEとLV_GRAD_CACHE_DEF_SIZEは使わない)
+ *両方で共有する予算。LV_MEM_PSRAMのプールの中から使う*/
+#ifndef LV_CACHE_BUDGET_SIZE
+#define LV_CACHE_BUDGET_SIZE (64U * 1024U)
+#endif
+
 /*Allow dithering the gradients (to achieve visual smooth color gradients on limited color depth display)
  *LV_DITHER_GRADIENT implies allocating one or two more lines of the object's rendering surface
  *The increase in memory consumption is (32 bits * object width) plus 24 bits * object width if using error diffusion */
@@ -399,7 +420,8 @@
 #define LV_FONT_FMT_TXT_LARGE 0
 
 /*Enables/disables support for compressed fonts.*/
-#define LV_USE_FONT_COMPRESSED 0
+/*fonts/font_compress.pyで圧縮したmplus1_*を使う。描画はsrc/glyph_cache.cppがA8に直接展開し、LVGLの展開はキャッシュを止めた時だけ使う*/
+#define LV_USE_FONT_COMPRESSED 1
 
 /*Enable subpixel rendering*/
 #define LV_USE_FONT_SUBPX 0
@@ -0,0 +1,124 @@
+#ifndef BINDING_HPP
+#define BINDING_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <lvgl.h>
+
+//
+// 値の変化を検出してラベルを更新するバインディング
+//
+// loop()で毎回値をCellにsetし、最後にLabelBinding::applyを呼ぶ
+// 値が変わらなければ文字列の生成もしない。値が変わっても表示する文字列が同じならラベルを更新しない
+//
+
+// 値が変わったことを通知される側
+class Binding {
+public:
+  void markDirty() { dirty = true; }
+  bool isDirty() const { return dirty; }
+
+protected:
+  bool dirty = false;
+};
+
+// 型付きの値。値が変わった時だけバインディングに通知する
+// 浮動小数点数は表示する桁に丸めた整数にしてからsetすること
+template <typename T>
+class Cell {
+public:
+  static const int maxBindings = 4;
+
+  explicit Cell(const T &initial = T()) : value(initial) {}
+
+  void bind(Binding *binding) {
+    if (bindingCount < maxBindings) {
+      bindings[bindingCount++] = binding;
+    }
+  }
+
+  // 値が変わった場合はtrue
+  bool set(const T &newValue) {
+    sets++;
+    if (initialized && (value == newValue)) {
+      return false;
+    }
+    value = newValue;
+    initialized = true;
+    changes++;
+    for (int i = 0; i < bindingCount; i++) {
+      bindings[i]->markDirty();
+    }
+    return true;
+  }
+
+  const T &get() const { return value; }
+  uint32_t setCount() const { return sets; }
+  uint32_t changeCount() const { return changes; }
+
+private:
+  T value;
+  bool initialized = false;
+  Binding *bindings[maxBindings];
+  int bindingCount = 0;
+  uint32_t sets = 0;
+  uint32_t changes = 0;
+};
+
+// ラベルのテキスト。formatterはセルの値から文字列を作り、長さを返す
+// テキストは自分のバッファをlv_label_set_text_staticで渡すので、LVGL側でメモリの確保とコピーが起きない
+template <size_t N = 32>
+class LabelBinding : public Binding {
+public:
+  typedef int (*Formatter)(char *buffer, size_t size);
+
+  explicit LabelBinding(Formatter formatter) : formatter(formatter) {
+    text[0] = '\0';
+  }
+
+  // ラベルを作り直した場合も呼ぶこと。表示したことがあれば次のapplyで新しいラベルに書き込む
+  void attach(lv_obj_t *newLabel) {
+    label = newLabel;
+    text[0] = '\0';
+    dirty = (applied > 0);
+  }
+
+  // 値が変わっていればテキストを作り、前回と違う場合だけラベルを更新する
+  void apply() {
+    if (label == NULL) {
+      return;
+    }
+    if (!dirty) {
+      unchanged++;
+      return;
+    }
+    dirty = false;
+
+    char next[N];
+    formatter(next, sizeof(next));
+    formats++;
+    if ((text[0] != '\0') && (strcmp(next, text) == 0)) {
+      suppressed++;
+      return;
+    }
+    strcpy(text, next);
+    lv_label_set_text_static(label, text);
+    applied++;
+  }
+
+  uint32_t unchangedCount() const { return unchanged; }
+  uint32_t formatCount() const { return formats; }
+  uint32_t suppressedCount() const { return suppressed; }
+  uint32_t appliedCount() const { return applied; }
+
+private:
+  Formatter formatter;
+  lv_obj_t *label = NULL;
+  char text[N];
+  uint32_t unchanged = 0;   // 値が変わらず、文字列も作らなかった回数
+  uint32_t formats = 0;
+  uint32_t suppressed = 0;  // 文字列を作ったが、表示と同じだった回数
+  uint32_t applied = 0;     // ラベルを更新した回数
+};
+
+#endif
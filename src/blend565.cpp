@@ -0,0 +1,297 @@
+#include <string.h>
+#include "blend565.hpp"
+
+#if LV_COLOR_DEPTH == 16
+
+// 1画素を32bitに広げた時のマスク。緑を上位16bitに移すと、各成分の上に5bitの隙間ができる
+static const uint32_t spreadMask = 0x07E0F81F;
+// 2画素を入れたワードを、成分の上に5bitの隙間がある2組に分けるマスク
+// 組1はそのままの位置で画素0の赤と青、画素1の緑
+// 組2は5bit右シフトした位置で画素0の緑、画素1の赤と青
+static const uint32_t pairMaskLo = 0x07E0F81F;
+static const uint32_t pairMaskHi = 0x07C0F83F;
+
+// 合成はRGB565のビット順で行う。LV_COLOR_16_SWAPの場合はメモリ上のバイト順を入れ替える
+// 入れ替えは2回行うと元に戻るので、読み込みと書き込みで同じ関数を使う
+#if LV_COLOR_16_SWAP
+static inline uint16_t byteOrder(uint16_t c) {
+  return (uint16_t)((c >> 8) | (c << 8));
+}
+
+static inline uint32_t byteOrder2(uint32_t w) {
+  return ((w >> 8) & 0x00FF00FF) | ((w & 0x00FF00FF) << 8);
+}
+#else
+static inline uint16_t byteOrder(uint16_t c) {
+  return c;
+}
+
+static inline uint32_t byteOrder2(uint32_t w) {
+  return w;
+}
+#endif
+
+// 8bitの不透明度を合成に使う0..32に変換する(LVGLのlv_color_mixと同じ丸め)
+static inline uint32_t alpha5(uint32_t opa) {
+  return (opa + 4) >> 3;
+}
+
+// 1画素の合成。a は0..32
+static inline uint16_t mix1(uint16_t fg, uint16_t bg, uint32_t a) {
+  uint32_t f = (fg | ((uint32_t)fg << 16)) & spreadMask;
+  uint32_t b = (bg | ((uint32_t)bg << 16)) & spreadMask;
+  uint32_t r = ((f * a + b * (32 - a)) >> 5) & spreadMask;
+  return (uint16_t)(r | (r >> 16));
+}
+
+// 2画素の合成。各組の成分は32倍しても隣の成分にあふれない
+static inline uint32_t mix2(uint32_t fg, uint32_t bg, uint32_t a) {
+  uint32_t lo = (((fg & pairMaskLo) * a + (bg & pairMaskLo) * (32 - a)) >> 5) & pairMaskLo;
+  uint32_t hi = ((((fg >> 5) & pairMaskHi) * a + ((bg >> 5) & pairMaskHi) * (32 - a)) >> 5) & pairMaskHi;
+  return lo | (hi << 5);
+}
+
+void LV_ATTRIBUTE_FAST_MEM blend565Fill(lv_color_t *dest, int32_t len, lv_color_t color) {
+  uint16_t *d = (uint16_t *)dest;
+  if ((len > 0) && ((uintptr_t)d & 2)) {
+    *d++ = color.full;
+    len--;
+  }
+
+  uint32_t pair = color.full | ((uint32_t)color.full << 16);
+  uint32_t *d32 = (uint32_t *)d;
+  while (len >= 8) {
+    d32[0] = pair;
+    d32[1] = pair;
+    d32[2] = pair;
+    d32[3] = pair;
+    d32 += 4;
+    len -= 8;
+  }
+  while (len >= 2) {
+    *d32++ = pair;
+    len -= 2;
+  }
+  if (len > 0) {
+    *(uint16_t *)d32 = color.full;
+  }
+}
+
+void LV_ATTRIBUTE_FAST_MEM blend565FillOpa(lv_color_t *dest, int32_t len, lv_color_t color, lv_opa_t opa) {
+  if (opa >= LV_OPA_MAX) {
+    blend565Fill(dest, len, color);
+    return;
+  }
+  if (opa <= LV_OPA_MIN) {
+    return;
+  }
+
+  uint32_t a = alpha5(opa);
+  uint16_t fg = byteOrder(color.full);
+  uint16_t *d = (uint16_t *)dest;
+  if ((len > 0) && ((uintptr_t)d & 2)) {
+    *d = byteOrder(mix1(fg, byteOrder(*d), a));
+    d++;
+    len--;
+  }
+
+  // 前景色は一定なので、乗算済みの値を使い回す
+  uint32_t fg2 = fg | ((uint32_t)fg << 16);
+  uint32_t fgLo = (fg2 & pairMaskLo) * a;
+  uint32_t fgHi = ((fg2 >> 5) & pairMaskHi) * a;
+  uint32_t ia = 32 - a;
+  uint32_t *d32 = (uint32_t *)d;
+  while (len >= 2) {
+    uint32_t bg = byteOrder2(*d32);
+    uint32_t lo = ((fgLo + (bg & pairMaskLo) * ia) >> 5) & pairMaskLo;
+    uint32_t hi = ((fgHi + ((bg >> 5) & pairMaskHi) * ia) >> 5) & pairMaskHi;
+    *d32++ = byteOrder2(lo | (hi << 5));
+    len -= 2;
+  }
+  if (len > 0) {
+    d = (uint16_t *)d32;
+    *d = byteOrder(mix1(fg, byteOrder(*d), a));
+  }
+}
+
+// マスク付きの1画素
+static inline void maskPixel(uint16_t *d, uint16_t color, uint16_t fg, lv_opa_t m, lv_opa_t opa) {
+  if (opa < LV_OPA_MAX) {
+    m = (lv_opa_t)(((uint32_t)m * opa) >> 8);
+  }
+  if (m >= LV_OPA_MAX) {
+    *d = color;
+  } else if (m > LV_OPA_MIN) {
+    *d = byteOrder(mix1(fg, byteOrder(*d), alpha5(m)));
+  }
+}
+
+void LV_ATTRIBUTE_FAST_MEM blend565FillMask(lv_color_t *dest, int32_t len, lv_color_t color, const lv_opa_t *mask, lv_opa_t opa) {
+  if (opa <= LV_OPA_MIN) {
+    return;
+  }
+
+  uint16_t *d = (uint16_t *)dest;
+  uint16_t fg = byteOrder(color.full);
+  int32_t i = 0;
+  // 文字のマスクはほとんどが透明か不透明なので、4画素分をまとめて調べて1画素ずつの合成を省く
+  while (i + 4 <= len) {
+    uint32_t m4 = mask[i] | ((uint32_t)mask[i + 1] << 8) | ((uint32_t)mask[i + 2] << 16) | ((uint32_t)mask[i + 3] << 24);
+    if (m4 == 0) {
+      // 何もしない
+    } else if ((m4 == 0xFFFFFFFF) && (opa >= LV_OPA_MAX)) {
+      d[i] = color.full;
+      d[i + 1] = color.full;
+      d[i + 2] = color.full;
+      d[i + 3] = color.full;
+    } else {
+      maskPixel(&d[i], color.full, fg, mask[i], opa);
+      maskPixel(&d[i + 1], color.full, fg, mask[i + 1], opa);
+      maskPixel(&d[i + 2], color.full, fg, mask[i + 2], opa);
+      maskPixel(&d[i + 3], color.full, fg, mask[i + 3], opa);
+    }
+    i += 4;
+  }
+  for (; i < len; i++) {
+    maskPixel(&d[i], color.full, fg, mask[i], opa);
+  }
+}
+
+void LV_ATTRIBUTE_FAST_MEM blend565Copy(lv_color_t *dest, const lv_color_t *src, int32_t len) {
+  uint16_t *d = (uint16_t *)dest;
+  const uint16_t *s = (const uint16_t *)src;
+  if (((uintptr_t)d ^ (uintptr_t)s) & 2) {
+    // ワード境界が揃わないのでmemcpyに任せる
+    memcpy(d, s, len * sizeof(uint16_t));
+    return;
+  }
+
+  if ((len > 0) && ((uintptr_t)d & 2)) {
+    *d++ = *s++;
+    len--;
+  }
+  uint32_t *d32 = (uint32_t *)d;
+  const uint32_t *s32 = (const uint32_t *)s;
+  while (len >= 8) {
+    d32[0] = s32[0];
+    d32[1] = s32[1];
+    d32[2] = s32[2];
+    d32[3] = s32[3];
+    d32 += 4;
+    s32 += 4;
+    len -= 8;
+  }
+  while (len >= 2) {
+    *d32++ = *s32++;
+    len -= 2;
+  }
+  if (len > 0) {
+    *(uint16_t *)d32 = *(const uint16_t *)s32;
+  }
+}
+
+void LV_ATTRIBUTE_FAST_MEM blend565CopyOpa(lv_color_t *dest, const lv_color_t *src, int32_t len, lv_opa_t opa) {
+  if (opa >= LV_OPA_MAX) {
+    blend565Copy(dest, src, len);
+    return;
+  }
+  if (opa <= LV_OPA_MIN) {
+    return;
+  }
+
+  uint32_t a = alpha5(opa);
+  uint16_t *d = (uint16_t *)dest;
+  const uint16_t *s = (const uint16_t *)src;
+  if ((len > 0) && ((uintptr_t)d & 2)) {
+    *d = byteOrder(mix1(byteOrder(*s), byteOrder(*d), a));
+    d++;
+    s++;
+    len--;
+  }
+
+  // 書き込み先はワード境界に揃っている。読み込み元は揃っているとは限らないので16bitずつ読む
+  uint32_t *d32 = (uint32_t *)d;
+  while (len >= 2) {
+    uint32_t fg = byteOrder2(s[0] | ((uint32_t)s[1] << 16));
+    *d32 = byteOrder2(mix2(fg, byteOrder2(*d32), a));
+    d32++;
+    s += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    d = (uint16_t *)d32;
+    *d = byteOrder(mix1(byteOrder(*s), byteOrder(*d), a));
+  }
+}
+
+bool blend565(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+  lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+  if ((disp == NULL) || (disp->driver->set_px_cb != NULL) || disp->driver->screen_transp || (dsc->blend_mode != LV_BLEND_MODE_NORMAL)) {
+    return false;
+  }
+
+  const lv_opa_t *mask = dsc->mask_buf;
+  if ((mask != NULL) && (dsc->mask_res == LV_DRAW_MASK_RES_TRANSP)) {
+    return true;
+  }
+  if (dsc->mask_res == LV_DRAW_MASK_RES_FULL_COVER) {
+    mask = NULL;
+  }
+  // マスク付きの画像(角丸の画像など)は少ないのでLVGLに任せる
+  if ((mask != NULL) && (dsc->src_buf != NULL)) {
+    return false;
+  }
+  if (dsc->opa <= LV_OPA_MIN) {
+    return true;
+  }
+
+  lv_area_t area;
+  if (!_lv_area_intersect(&area, dsc->blend_area, draw_ctx->clip_area)) {
+    return true;
+  }
+
+  const lv_area_t *bufArea = draw_ctx->buf_area;
+  lv_coord_t destStride = lv_area_get_width(bufArea);
+  lv_color_t *dest = (lv_color_t *)draw_ctx->buf + destStride * (area.y1 - bufArea->y1) + (area.x1 - bufArea->x1);
+  int32_t width = lv_area_get_width(&area);
+
+  const lv_color_t *src = dsc->src_buf;
+  lv_coord_t srcStride = 0;
+  if (src != NULL) {
+    srcStride = lv_area_get_width(dsc->blend_area);
+    src += srcStride * (area.y1 - dsc->blend_area->y1) + (area.x1 - dsc->blend_area->x1);
+  }
+
+  lv_coord_t maskStride = 0;
+  if (mask != NULL) {
+    maskStride = lv_area_get_width(dsc->mask_area);
+    mask += maskStride * (area.y1 - dsc->mask_area->y1) + (area.x1 - dsc->mask_area->x1);
+  }
+
+  for (lv_coord_t y = area.y1; y <= area.y2; y++) {
+    if (src != NULL) {
+      blend565CopyOpa(dest, src, width, dsc->opa);
+      src += srcStride;
+    } else if (mask != NULL) {
+      blend565FillMask(dest, width, dsc->color, mask, dsc->opa);
+      mask += maskStride;
+    } else {
+      blend565FillOpa(dest, width, dsc->color, dsc->opa);
+    }
+    dest += destStride;
+  }
+  return true;
+}
+
+static void blend565_blend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+  if (!blend565(draw_ctx, dsc)) {
+    lv_draw_sw_blend_basic(draw_ctx, dsc);
+  }
+}
+
+void blend565InitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx) {
+  lv_draw_sw_init_ctx(drv, draw_ctx);
+  ((lv_draw_sw_ctx_t *)draw_ctx)->blend = blend565_blend;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BLEND565_HPP
+#define BLEND565_HPP
+
+#include <stdint.h>
+#include <lvgl.h>
+
+// RGB565の描画カーネル
+// ESP32にSIMD命令は無いので、32bitワードに2画素を入れて(SWAR)塗りつぶしと合成を行う
+// LV_COLOR_16_SWAPのバイト順にも対応する。LV_COLOR_DEPTHが16以外ではLVGLの処理をそのまま使う
+#ifndef DISP_BLEND_SWAR
+#define DISP_BLEND_SWAR (LV_COLOR_DEPTH == 16)
+#endif
+
+void blend565Fill(lv_color_t *dest, int32_t len, lv_color_t color);
+void blend565FillOpa(lv_color_t *dest, int32_t len, lv_color_t color, lv_opa_t opa);
+// A8マスク(4bppのフォントもLVGLが8bitに展開してから渡す)で色を合成する
+void blend565FillMask(lv_color_t *dest, int32_t len, lv_color_t color, const lv_opa_t *mask, lv_opa_t opa);
+void blend565Copy(lv_color_t *dest, const lv_color_t *src, int32_t len);
+void blend565CopyOpa(lv_color_t *dest, const lv_color_t *src, int32_t len, lv_opa_t opa);
+
+// lv_draw_sw_blend_basicの代わりに上のカーネルで描画する。対応しない描画ならfalseを返す
+bool blend565(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc);
+
+// lv_disp_drv_t::draw_ctx_initに設定する(disp_fill.hppを使わない場合)
+void blend565InitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx);
+
+// LVGLのlv_draw_sw_blend_basicとの速度比較。結果を1行ずつprintに渡す
+// microsは経過時間(us)を返す関数。表示ドライバの登録後に、描画中でない時に呼ぶこと
+void blend565Benchmark(int64_t (*micros)(), void (*print)(const char *line));
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "blend565.hpp"
+
+#if LV_COLOR_DEPTH == 16
+
+// 画面幅で4行。ESP32のArduinoでは4096バイトを超えるmallocがPSRAMに置かれるので、それ以下にする
+static const lv_coord_t benchWidth = 320;
+static const lv_coord_t benchHeight = 4;
+static const int benchIterations = 250;
+
+typedef void (*BlendFunc)(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc);
+
+static void stockBlend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+  lv_draw_sw_blend_basic(draw_ctx, dsc);
+}
+
+static void swarBlend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+  blend565(draw_ctx, dsc);
+}
+
+// 1usあたりの画素数
+static double measure(BlendFunc blend, lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc, int64_t (*micros)()) {
+  int64_t start = micros();
+  for (int i = 0; i < benchIterations; i++) {
+    blend(draw_ctx, dsc);
+  }
+  int64_t elapsed = micros() - start;
+  return (double)benchWidth * benchHeight * benchIterations / ((elapsed > 0) ? elapsed : 1);
+}
+
+// 同じ背景に1回ずつ描画し、成分ごとの差の最大値を返す
+static int compare(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc, lv_color_t *stockBuf, lv_color_t *swarBuf, const lv_color_t *background) {
+  uint32_t pixels = benchWidth * benchHeight;
+  lv_memcpy(stockBuf, background, pixels * sizeof(lv_color_t));
+  lv_memcpy(swarBuf, background, pixels * sizeof(lv_color_t));
+
+  draw_ctx->buf = stockBuf;
+  stockBlend(draw_ctx, dsc);
+  draw_ctx->buf = swarBuf;
+  swarBlend(draw_ctx, dsc);
+
+  int maxDiff = 0;
+  for (uint32_t i = 0; i < pixels; i++) {
+    int diffs[3] = {
+      abs((int)LV_COLOR_GET_R(stockBuf[i]) - (int)LV_COLOR_GET_R(swarBuf[i])),
+      abs((int)LV_COLOR_GET_G(stockBuf[i]) - (int)LV_COLOR_GET_G(swarBuf[i])),
+      abs((int)LV_COLOR_GET_B(stockBuf[i]) - (int)LV_COLOR_GET_B(swarBuf[i])),
+    };
+    for (int k = 0; k < 3; k++) {
+      if (diffs[k] > maxDiff) {
+        maxDiff = diffs[k];
+      }
+    }
+  }
+  return maxDiff;
+}
+
+void blend565Benchmark(int64_t (*micros)(), void (*print)(const char *line)) {
+  lv_disp_t *disp = lv_disp_get_default();
+  if (disp == NULL) {
+    print("blend : no display");
+    return;
+  }
+
+  uint32_t pixels = benchWidth * benchHeight;
+  lv_color_t *stockBuf = (lv_color_t *)malloc(pixels * sizeof(lv_color_t));
+  lv_color_t *swarBuf = (lv_color_t *)malloc(pixels * sizeof(lv_color_t));
+  lv_color_t *background = (lv_color_t *)malloc(pixels * sizeof(lv_color_t));
+  lv_color_t *src = (lv_color_t *)malloc(pixels * sizeof(lv_color_t));
+  lv_opa_t *mask = (lv_opa_t *)malloc(pixels);
+  if ((stockBuf == NULL) || (swarBuf == NULL) || (background == NULL) || (src == NULL) || (mask == NULL)) {
+    print("blend : out of memory");
+  } else {
+    // 背景と画像はグラデーション、マスクは文字に近い分布(6割が透明、2割が不透明、残りが中間調)
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < pixels; i++) {
+      background[i] = lv_color_make(i % 256, (i / benchWidth) * 60, 128);
+      src[i] = lv_color_make(255 - (i % 256), 64, (i / benchWidth) * 60);
+      seed = seed * 1103515245 + 12345;
+      uint32_t r = (seed >> 16) % 10;
+      mask[i] = (r < 6) ? LV_OPA_TRANSP : (r < 8) ? LV_OPA_COVER : (lv_opa_t)(seed >> 8);
+    }
+
+    lv_area_t area = {0, 0, (lv_coord_t)(benchWidth - 1), (lv_coord_t)(benchHeight - 1)};
+    lv_draw_ctx_t draw_ctx;
+    lv_memset_00(&draw_ctx, sizeof(draw_ctx));
+    draw_ctx.buf_area = &area;
+    draw_ctx.clip_area = &area;
+
+    struct BenchCase {
+      const char *name;
+      const lv_color_t *src;
+      const lv_opa_t *mask;
+      lv_opa_t opa;
+    };
+    const BenchCase cases[] = {
+      {"fill", NULL, NULL, LV_OPA_COVER},
+      {"fill_opa", NULL, NULL, LV_OPA_50},
+      {"fill_mask", NULL, mask, LV_OPA_COVER},
+      {"copy", src, NULL, LV_OPA_COVER},
+      {"copy_opa", src, NULL, LV_OPA_50},
+    };
+
+    // blend_basicは描画中のディスプレイの設定を参照する
+    lv_disp_t *refreshing = _lv_refr_get_disp_refreshing();
+    _lv_refr_set_disp_refreshing(disp);
+
+    char line[96];
+    snprintf(line, sizeof(line), "blend : %-10s %12s %12s %7s %5s", "case", "stock px/us", "swar px/us", "ratio", "diff");
+    print(line);
+    for (const BenchCase &c : cases) {
+      lv_draw_sw_blend_dsc_t dsc;
+      lv_memset_00(&dsc, sizeof(dsc));
+      dsc.blend_area = &area;
+      dsc.src_buf = c.src;
+      dsc.color = lv_palette_main(LV_PALETTE_BLUE);
+      dsc.mask_buf = c.mask;
+      dsc.mask_res = (c.mask != NULL) ? LV_DRAW_MASK_RES_CHANGED : LV_DRAW_MASK_RES_FULL_COVER;
+      dsc.mask_area = &area;
+      dsc.opa = c.opa;
+      dsc.blend_mode = LV_BLEND_MODE_NORMAL;
+
+      draw_ctx.buf = stockBuf;
+      lv_memcpy(stockBuf, background, pixels * sizeof(lv_color_t));
+      double stock = measure(stockBlend, &draw_ctx, &dsc, micros);
+      draw_ctx.buf = swarBuf;
+      lv_memcpy(swarBuf, background, pixels * sizeof(lv_color_t));
+      double swar = measure(swarBlend, &draw_ctx, &dsc, micros);
+      int diff = compare(&draw_ctx, &dsc, stockBuf, swarBuf, background);
+
+      snprintf(line, sizeof(line), "blend : %-10s %12.2f %12.2f  x%5.2f %5d", c.name, stock, swar, swar / stock, diff);
+      print(line);
+    }
+
+    _lv_refr_set_disp_refreshing(refreshing);
+  }
+
+  free(stockBuf);
+  free(swarBuf);
+  free(background);
+  free(src);
+  free(mask);
+}
+
+#endif
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <string.h>
+#include <lvgl.h>
+
+#include "lv_mem_psram.h"
+#include "cache_budget.hpp"
+
+//
+// 画像とグラデーションは共通のエントリの表に入れる。表はlv_memから一度だけ確保する
+// 優先度は「捨てた最後のエントリの優先度 + 作り直す時間 / 大きさ」で、使うたびに付け直す
+// 捨てる時は優先度が最も低いものを選び、その値まで基準を上げるので、長く使われていないものほど捨てられやすい
+//
+
+extern "C" {
+_lv_img_cache_entry_t *__real__lv_img_cache_open(const void *src, lv_color_t color, int32_t frame_id);
+lv_grad_t *__real_lv_gradient_get(const lv_grad_dsc_t *g, lv_coord_t w, lv_coord_t h);
+void __real_lv_gradient_cleanup(lv_grad_t *grad);
+void __real_lv_draw_mask_radius_init(lv_draw_mask_radius_param_t *param, const lv_area_t *rect, lv_coord_t radius, bool inv);
+void __real_lv_draw_sw_rect(lv_draw_ctx_t *draw_ctx, const lv_draw_rect_dsc_t *dsc, const lv_area_t *coords);
+
+// LV_ENABLE_GCが0の場合のLVGLの円のキャッシュ(lv_gc.c)
+extern _lv_draw_mask_radius_circle_dsc_arr_t _lv_circle_cache;
+}
+
+const char *cacheTypeNames[cacheTypeCount] = {"image", "gradient", "shadow", "circle"};
+
+struct CacheEntry {
+  bool used;
+  bool pinned;      // 描画に使用中。捨てない
+  uint8_t type;
+  uint32_t priority;
+  uint32_t cost;    // 作り直す時間(us)
+  size_t bytes;
+  _lv_img_cache_entry_t image;
+  lv_grad_t *gradient;
+  lv_grad_dsc_t gradientDsc;
+  lv_coord_t gradientW;  // 色の表の大きさを決める幅と高さ
+  lv_coord_t gradientH;
+};
+
+static const int maxEntries = 48;
+static const uint32_t maxValue = 1 << 20;
+static const uint32_t rebaseThreshold = 1u << 30;
+
+static CacheEntry *entries = NULL;
+static size_t limit = 0;
+static size_t used = 0;
+static uint32_t inflation = 0;  // 最後に捨てたエントリの優先度
+static int64_t (*clockMicros)() = NULL;
+static CacheEntry *pinnedImage = NULL;  // 最後に開いた画像。次に画像を開くまで描画に使われる
+static CacheTypeStats typeStats[cacheTypeCount];
+
+// 作り直す時間を1/64KBあたりにした値
+static uint32_t entryValue(const CacheEntry &entry) {
+  uint64_t value = (uint64_t)entry.cost * 64 / (entry.bytes / 64 + 1);
+  return (value < maxValue) ? (uint32_t)value : maxValue;
+}
+
+static void touchEntry(CacheEntry &entry) {
+  // 基準が大きくなり過ぎたら全ての優先度から引いて戻す
+  if (inflation > rebaseThreshold) {
+    for (int i = 0; i < maxEntries; i++) {
+      entries[i].priority = (entries[i].priority > inflation) ? entries[i].priority - inflation : 0;
+    }
+    inflation = 0;
+  }
+  entry.priority = inflation + entryValue(entry);
+}
+
+static void releaseEntry(CacheEntry &entry) {
+  if (entry.type == CACHE_IMAGE) {
+    lv_img_decoder_close(&entry.image.dec_dsc);
+  } else {
+    lv_mem_free(entry.gradient);
+  }
+  used -= entry.bytes;
+  typeStats[entry.type].bytes -= entry.bytes;
+  typeStats[entry.type].entries--;
+  memset(&entry, 0, sizeof(CacheEntry));
+}
+
+static CacheEntry *findVictim() {
+  CacheEntry *victim = NULL;
+  for (int i = 0; i < maxEntries; i++) {
+    CacheEntry &entry = entries[i];
+    if (entry.used && !entry.pinned && ((victim == NULL) || (entry.priority < victim->priority))) {
+      victim = &entry;
+    }
+  }
+  return victim;
+}
+
+static size_t evict(size_t bytes) {
+  size_t freed = 0;
+  while (freed < bytes) {
+    CacheEntry *victim = findVictim();
+    if (victim == NULL) {
+      break;
+    }
+    inflation = victim->priority;
+    freed += victim->bytes;
+    typeStats[victim->type].evictions++;
+    releaseEntry(*victim);
+  }
+  return freed;
+}
+
+static void enforceLimit() {
+  if (used > limit) {
+    evict(used - limit);
+  }
+}
+
+// 空きエントリ。無ければ1つ捨てる
+static CacheEntry *freeEntry() {
+  for (int i = 0; i < maxEntries; i++) {
+    if (!entries[i].used) {
+      return &entries[i];
+    }
+  }
+  CacheEntry *victim = findVictim();
+  if (victim != NULL) {
+    inflation = victim->priority;
+    typeStats[victim->type].evictions++;
+    releaseEntry(*victim);
+  }
+  return victim;
+}
+
+// 使用中の印を付けて加える。予算を超えた分は他のエントリを捨てる
+static void insertEntry(CacheEntry &entry, CacheType type, uint32_t cost, size_t bytes) {
+  entry.used = true;
+  entry.pinned = true;
+  entry.type = type;
+  entry.cost = (cost > 0) ? cost : 1;
+  entry.bytes = bytes;
+  used += bytes;
+  typeStats[type].bytes += bytes;
+  typeStats[type].entries++;
+  touchEntry(entry);
+  enforceLimit();
+}
+
+//
+// 画像
+//
+
+// lv_img_cache_matchと同じ比較。変数は同じポインタ、ファイルは同じパス
+static bool sameSource(const lv_img_decoder_dsc_t &dsc, const void *src) {
+  lv_img_src_t type = lv_img_src_get_type(src);
+  if (type != dsc.src_type) {
+    return false;
+  }
+  if (type == LV_IMG_SRC_VARIABLE) {
+    return dsc.src == src;
+  }
+  if (type == LV_IMG_SRC_FILE) {
+    return strcmp((const char *)dsc.src, (const char *)src) == 0;
+  }
+  return false;
+}
+
+// デコーダが確保した画素の大きさ。フラッシュの配列をそのまま指す場合と1行ずつ読む場合は0
+static size_t imageBytes(const lv_img_decoder_dsc_t &dsc) {
+  if (dsc.img_data == NULL) {
+    return 0;
+  }
+  if ((dsc.src_type == LV_IMG_SRC_VARIABLE) && (dsc.img_data == ((const lv_img_dsc_t *)dsc.src)->data)) {
+    return 0;
+  }
+  return lv_img_buf_get_img_size(dsc.header.w, dsc.header.h, dsc.header.cf);
+}
+
+static void unpinImage() {
+  if (pinnedImage != NULL) {
+    pinnedImage->pinned = false;
+    pinnedImage = NULL;
+    enforceLimit();
+  }
+}
+
+extern "C" _lv_img_cache_entry_t *__wrap__lv_img_cache_open(const void *src, lv_color_t color, int32_t frame_id) {
+  if (entries == NULL) {
+    return __real__lv_img_cache_open(src, color, frame_id);
+  }
+  unpinImage();
+
+  for (int i = 0; i < maxEntries; i++) {
+    CacheEntry &entry = entries[i];
+    if (entry.used && (entry.type == CACHE_IMAGE) && (entry.image.dec_dsc.color.full == color.full) &&
+        (entry.image.dec_dsc.frame_id == frame_id) && sameSource(entry.image.dec_dsc, src)) {
+      typeStats[CACHE_IMAGE].hits++;
+      touchEntry(entry);
+      entry.pinned = true;
+      pinnedImage = &entry;
+      return &entry.image;
+    }
+  }
+
+  typeStats[CACHE_IMAGE].misses++;
+  CacheEntry *entry = freeEntry();
+  if (entry == NULL) {
+    return NULL;
+  }
+  int64_t start = clockMicros();
+  // 描画中に呼ばれるが、持ち続けるのでプールから確保させる(プールの予算と、足りない時の解放の対象にする)
+  lv_mem_psram_pool_begin();
+  lv_res_t res = lv_img_decoder_open(&entry->image.dec_dsc, src, color, frame_id);
+  lv_mem_psram_pool_end();
+  if (res == LV_RES_INV) {
+    LV_LOG_WARN("Image draw cannot open the image resource");
+    memset(entry, 0, sizeof(CacheEntry));
+    return NULL;
+  }
+  insertEntry(*entry, CACHE_IMAGE, clockMicros() - start, imageBytes(entry->image.dec_dsc));
+  pinnedImage = entry;
+  return &entry->image;
+}
+
+extern "C" void __wrap_lv_img_cache_invalidate_src(const void *src) {
+  if (entries == NULL) {
+    return;
+  }
+  for (int i = 0; i < maxEntries; i++) {
+    CacheEntry &entry = entries[i];
+    if (entry.used && (entry.type == CACHE_IMAGE) && ((src == NULL) || sameSource(entry.image.dec_dsc, src))) {
+      if (pinnedImage == &entry) {
+        pinnedImage = NULL;
+      }
+      releaseEntry(entry);
+    }
+  }
+}
+
+//
+// グラデーション
+// LV_GRAD_CACHE_DEF_SIZEが0なので、LVGLは毎回色の表を確保してnot_cachedを付け、lv_gradient_cleanupで解放する
+// not_cachedを外して持ち続け、lv_gradient_cleanupでは使用中の印だけを外す
+//
+
+static bool sameGradient(const lv_grad_dsc_t &a, const lv_grad_dsc_t &b) {
+  if ((a.stops_count != b.stops_count) || (a.dir != b.dir) || (a.dither != b.dither)) {
+    return false;
+  }
+  for (int i = 0; i < a.stops_count; i++) {
+    if ((a.stops[i].color.full != b.stops[i].color.full) || (a.stops[i].frac != b.stops[i].frac)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+extern "C" lv_grad_t *__wrap_lv_gradient_get(const lv_grad_dsc_t *g, lv_coord_t w, lv_coord_t h) {
+  if ((entries == NULL) || (g->dir == LV_GRAD_DIR_NONE)) {
+    return __real_lv_gradient_get(g, w, h);
+  }
+  // 色の表は向きの方の長さだけで決まる。ディザリングする場合は両方で決まる
+#if !LV_DITHER_GRADIENT
+  if (g->dir == LV_GRAD_DIR_HOR) {
+    h = 0;
+  } else {
+    w = 0;
+  }
+#endif
+
+  for (int i = 0; i < maxEntries; i++) {
+    CacheEntry &entry = entries[i];
+    if (entry.used && (entry.type == CACHE_GRADIENT) && (entry.gradientW == w) && (entry.gradientH == h) && sameGradient(entry.gradientDsc, *g)) {
+      typeStats[CACHE_GRADIENT].hits++;
+      touchEntry(entry);
+      entry.pinned = true;
+      return entry.gradient;
+    }
+  }
+
+  typeStats[CACHE_GRADIENT].misses++;
+  CacheEntry *entry = freeEntry();
+  int64_t start = clockMicros();
+  if (entry != NULL) {
+    lv_mem_psram_pool_begin();
+  }
+  lv_grad_t *gradient = __real_lv_gradient_get(g, w, h);
+  if (entry != NULL) {
+    lv_mem_psram_pool_end();
+  }
+  if ((entry == NULL) || (gradient == NULL) || !gradient->not_cached) {
+    return gradient;
+  }
+  gradient->not_cached = 0;
+  entry->gradient = gradient;
+  entry->gradientDsc = *g;
+  entry->gradientW = w;
+  entry->gradientH = h;
+  insertEntry(*entry, CACHE_GRADIENT, clockMicros() - start, sizeof(lv_grad_t) + gradient->size * sizeof(lv_color_t));
+  return gradient;
+}
+
+extern "C" void __wrap_lv_gradient_cleanup(lv_grad_t *grad) {
+  if (entries != NULL) {
+    for (int i = 0; i < maxEntries; i++) {
+      CacheEntry &entry = entries[i];
+      if (entry.used && (entry.type == CACHE_GRADIENT) && (entry.gradient == grad)) {
+        entry.pinned = false;
+        enforceLimit();
+        return;
+      }
+    }
+  }
+  __real_lv_gradient_cleanup(grad);
+}
+
+//
+// 円の縁
+// LVGLのキャッシュに同じ半径があれば当たり、全て埋まっていて無ければLVGLが1つを入れ替える
+//
+
+extern "C" void __wrap_lv_draw_mask_radius_init(lv_draw_mask_radius_param_t *param, const lv_area_t *rect, lv_coord_t radius, bool inv) {
+  // lv_draw_mask_radius_initと同じく短い辺の半分に切り詰める
+  lv_coord_t shortSide = LV_MIN(lv_area_get_width(rect), lv_area_get_height(rect));
+  lv_coord_t r = LV_MIN(radius, shortSide >> 1);
+  if (r > 0) {
+    bool hit = false;
+    bool full = true;
+    for (int i = 0; i < LV_CIRCLE_CACHE_SIZE; i++) {
+      if (_lv_circle_cache[i].radius == r) {
+        hit = true;
+      }
+      if (_lv_circle_cache[i].buf == NULL) {
+        full = false;
+      }
+    }
+    if (hit) {
+      typeStats[CACHE_CIRCLE].hits++;
+    } else {
+      typeStats[CACHE_CIRCLE].misses++;
+      if (full) {
+        typeStats[CACHE_CIRCLE].evictions++;
+      }
+    }
+  }
+  __real_lv_draw_mask_radius_init(param, rect, radius, inv);
+}
+
+//
+// 影の角
+// LVGLのキャッシュ(lv_draw_sw_rect.cの静的な配列)は1つだけで外からは見えないので、
+// draw_shadowと同じ条件で角の大きさと半径を求め、最後にキャッシュされたものと比べる
+//
+
+static int32_t shadowCacheSize = -1;
+static int32_t shadowCacheRadius = -1;
+
+extern "C" void __wrap_lv_draw_sw_rect(lv_draw_ctx_t *draw_ctx, const lv_draw_rect_dsc_t *dsc, const lv_area_t *coords) {
+#if LV_DRAW_COMPLEX && LV_SHADOW_CACHE_SIZE
+  // draw_shadowが影を描かずに戻る条件
+  bool visible = (dsc->shadow_width != 0) && (dsc->shadow_opa > LV_OPA_MIN) &&
+                 !((dsc->shadow_width == 1) && (dsc->shadow_spread <= 0) && (dsc->shadow_ofs_x == 0) && (dsc->shadow_ofs_y == 0));
+  if (visible) {
+    lv_area_t core;
+    core.x1 = coords->x1 + dsc->shadow_ofs_x - dsc->shadow_spread;
+    core.x2 = coords->x2 + dsc->shadow_ofs_x + dsc->shadow_spread;
+    core.y1 = coords->y1 + dsc->shadow_ofs_y - dsc->shadow_spread;
+    core.y2 = coords->y2 + dsc->shadow_ofs_y + dsc->shadow_spread;
+    lv_area_t shadow;
+    shadow.x1 = core.x1 - dsc->shadow_width / 2 - 1;
+    shadow.x2 = core.x2 + dsc->shadow_width / 2 + 1;
+    shadow.y1 = core.y1 - dsc->shadow_width / 2 - 1;
+    shadow.y2 = core.y2 + dsc->shadow_width / 2 + 1;
+    lv_area_t drawArea;
+    if (_lv_area_intersect(&drawArea, &shadow, draw_ctx->clip_area)) {
+      lv_coord_t shortSide = LV_MIN(lv_area_get_width(&core), lv_area_get_height(&core));
+      int32_t r = LV_MIN((int32_t)dsc->radius, (int32_t)(shortSide >> 1));
+      int32_t cornerSize = dsc->shadow_width + r;
+      if ((cornerSize == shadowCacheSize) && (r == shadowCacheRadius)) {
+        typeStats[CACHE_SHADOW].hits++;
+      } else {
+        typeStats[CACHE_SHADOW].misses++;
+        // 入る大きさならLVGLが入れ替える
+        if ((uint32_t)(cornerSize * cornerSize) < LV_SHADOW_CACHE_SIZE * LV_SHADOW_CACHE_SIZE) {
+          if (shadowCacheSize >= 0) {
+            typeStats[CACHE_SHADOW].evictions++;
+          }
+          shadowCacheSize = cornerSize;
+          shadowCacheRadius = r;
+        }
+      }
+    }
+  }
+#endif
+  __real_lv_draw_sw_rect(draw_ctx, dsc, coords);
+}
+
+// lv_memのプールが足りない時に呼ばれる
+static size_t relievePressure(size_t size) {
+  return evict(size);
+}
+
+void cacheBudgetBegin(size_t budget, int64_t (*micros)()) {
+  limit = budget;
+  clockMicros = micros;
+  entries = (CacheEntry *)lv_mem_alloc(maxEntries * sizeof(CacheEntry));
+  if (entries == NULL) {
+    return;
+  }
+  memset(entries, 0, maxEntries * sizeof(CacheEntry));
+  lv_mem_psram_set_pressure_cb(relievePressure);
+}
+
+void cacheBudgetSetLimit(size_t budget) {
+  limit = budget;
+  enforceLimit();
+}
+
+size_t cacheBudgetLimit() {
+  return limit;
+}
+
+size_t cacheBudgetUsed() {
+  return used;
+}
+
+size_t cacheBudgetTrim(size_t bytes) {
+  if (entries == NULL) {
+    return 0;
+  }
+  return evict(bytes);
+}
+
+void cacheBudgetGetStats(CacheType type, CacheTypeStats *stats) {
+  *stats = typeStats[type];
+  if (type == CACHE_SHADOW) {
+    stats->entries = (shadowCacheSize >= 0) ? 1 : 0;
+    stats->bytes = LV_SHADOW_CACHE_SIZE * LV_SHADOW_CACHE_SIZE;
+  } else if (type == CACHE_CIRCLE) {
+    // circ_calc_aa4が半径ごとに確保する大きさ(半径 * 6 + 6)の概算
+    stats->entries = 0;
+    stats->bytes = 0;
+    for (int i = 0; i < LV_CIRCLE_CACHE_SIZE; i++) {
+      if (_lv_circle_cache[i].buf != NULL) {
+        stats->entries++;
+        stats->bytes += _lv_circle_cache[i].radius * 6 + 6;
+      }
+    }
+  }
+}
+
+void cacheBudgetClearStats() {
+  for (int i = 0; i < cacheTypeCount; i++) {
+    typeStats[i].hits = 0;
+    typeStats[i].misses = 0;
+    typeStats[i].evictions = 0;
+  }
+}
+
+void cacheBudgetFormat(CacheType type, char *buffer, size_t size) {
+  CacheTypeStats stats;
+  cacheBudgetGetStats(type, &stats);
+  snprintf(buffer, size, "hits %u misses %u evictions %u entries %u bytes %u",
+           (unsigned)stats.hits, (unsigned)stats.misses, (unsigned)stats.evictions, (unsigned)stats.entries, (unsigned)stats.bytes);
+}
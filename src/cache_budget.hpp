@@ -0,0 +1,54 @@
+#ifndef CACHE_BUDGET_HPP
+#define CACHE_BUDGET_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// LVGLの描画キャッシュの管理
+//
+// 画像(デコード結果)とグラデーションの色の表はLVGLのキャッシュの代わりにここで持ち、LV_CACHE_BUDGET_SIZEの予算を共有する
+// 予算を超えたら、作り直す手間が大きさの割に小さく、長く使われていないものから捨てる(GreedyDual-Size)
+// lv_mem_psramのプールが足りなくなった時と、cacheBudgetTrimが呼ばれた時も捨てる
+// 予算の対象は画像とグラデーションだけ
+// 影と円の縁のキャッシュはLVGLが持ったまま(lv_conf.hのLV_SHADOW_CACHE_SIZE、LV_CIRCLE_CACHE_SIZE)で、予算に含めず回数だけを数える
+//
+// LVGLの関数はリンカの--wrapで置き換える(platformio.iniのbuild_flags)
+//
+
+enum CacheType {
+  CACHE_IMAGE,
+  CACHE_GRADIENT,
+  CACHE_SHADOW,
+  CACHE_CIRCLE,
+  cacheTypeCount,
+};
+
+extern const char *cacheTypeNames[cacheTypeCount];
+
+struct CacheTypeStats {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint32_t entries;
+  size_t bytes;  // 今使っている大きさ。影は静的な配列、円はLVGLが持つバッファの概算
+};
+
+// 予算(バイト)と作り直す時間を計る時計(us)を設定し、lv_mem_psramに解放の関数を登録する。lv_initの後に呼ぶ
+void cacheBudgetBegin(size_t budget, int64_t (*micros)());
+
+// 予算を変える。減らした場合は超えた分をすぐに捨てる
+void cacheBudgetSetLimit(size_t budget);
+size_t cacheBudgetLimit();
+size_t cacheBudgetUsed();
+
+// bytes以上を捨てる(描画に使用中のものは残す)。捨てた大きさを返す
+size_t cacheBudgetTrim(size_t bytes);
+
+void cacheBudgetGetStats(CacheType type, CacheTypeStats *stats);
+void cacheBudgetClearStats();
+
+// "hits misses evictions entries bytes"
+void cacheBudgetFormat(CacheType type, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include "device_list.hpp"
+
+// ESP32のArduinoでは4096バイトを超えるmallocはPSRAMに置かれる
+bool DeviceList::begin() {
+  if (entries != NULL) {
+    return true;
+  }
+
+  uint32_t tableSize = 1;
+  while (tableSize < (uint32_t)entryCapacity * 2) {
+    tableSize *= 2;
+  }
+  entries = (DeviceEntry *)malloc(entryCapacity * sizeof(DeviceEntry));
+  order = (uint16_t *)malloc(entryCapacity * sizeof(uint16_t));
+  freeIndices = (uint16_t *)malloc(entryCapacity * sizeof(uint16_t));
+  table = (int16_t *)malloc(tableSize * sizeof(int16_t));
+  if ((entries == NULL) || (order == NULL) || (freeIndices == NULL) || (table == NULL)) {
+    free(entries);
+    free(order);
+    free(freeIndices);
+    free(table);
+    entries = NULL;
+    order = NULL;
+    freeIndices = NULL;
+    table = NULL;
+    return false;
+  }
+
+  tableMask = tableSize - 1;
+  memset(table, 0xff, tableSize * sizeof(int16_t));
+  // 番号の小さいものから使う
+  for (uint16_t i = 0; i < entryCapacity; i++) {
+    freeIndices[i] = entryCapacity - 1 - i;
+  }
+  freeCount = entryCapacity;
+  count = 0;
+  return true;
+}
+
+DeviceList::~DeviceList() {
+  free(entries);
+  free(order);
+  free(freeIndices);
+  free(table);
+}
+
+// FNV-1a
+uint32_t DeviceList::slot(const uint8_t *address) const {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < bluetoothAddressBytes; i++) {
+    hash = (hash ^ address[i]) * 16777619u;
+  }
+  return hash & tableMask;
+}
+
+int DeviceList::find(const uint8_t *address) const {
+  for (uint32_t i = slot(address);; i = (i + 1) & tableMask) {
+    int16_t index = table[i];
+    if (index < 0) {
+      return -1;
+    }
+    if (memcmp(entries[index].address, address, bluetoothAddressBytes) == 0) {
+      return index;
+    }
+  }
+}
+
+void DeviceList::hashInsert(uint16_t index) {
+  uint32_t i = slot(entries[index].address);
+  while (table[i] >= 0) {
+    i = (i + 1) & tableMask;
+  }
+  table[i] = index;
+}
+
+// 削除した場所より後ろにある同じ探索列の要素を詰めて、探索が途中で止まらないようにする
+void DeviceList::hashRemove(uint16_t index) {
+  uint32_t hole = slot(entries[index].address);
+  while (table[hole] != (int16_t)index) {
+    hole = (hole + 1) & tableMask;
+  }
+  table[hole] = -1;
+
+  for (uint32_t i = (hole + 1) & tableMask; table[i] >= 0; i = (i + 1) & tableMask) {
+    uint32_t home = slot(entries[table[i]].address);
+    // homeからiまでの間にholeがあれば詰められる
+    if (((i - home) & tableMask) >= ((i - hole) & tableMask)) {
+      table[hole] = table[i];
+      table[i] = -1;
+      hole = i;
+    }
+  }
+}
+
+void DeviceList::markChanged(uint16_t first, uint16_t last) {
+  if (!changed) {
+    changed = true;
+    changedFirst = first;
+    changedLast = last;
+    return;
+  }
+  if (first < changedFirst) {
+    changedFirst = first;
+  }
+  if (last > changedLast) {
+    changedLast = last;
+  }
+}
+
+bool DeviceList::takeChanges(uint16_t *first, uint16_t *last) {
+  if (!changed) {
+    return false;
+  }
+  *first = changedFirst;
+  *last = changedLast;
+  changed = false;
+  return true;
+}
+
+// RSSIが変わったデバイスを前後に移動する。RSSIが同じデバイスの間では順番を変えない
+void DeviceList::moveToSortedRank(uint16_t index) {
+  DeviceEntry &entry = entries[index];
+  uint16_t from = entry.rank;
+  uint16_t rank = from;
+  while ((rank > 0) && (entries[order[rank - 1]].rssi < entry.rssi)) {
+    order[rank] = order[rank - 1];
+    entries[order[rank]].rank = rank;
+    rank--;
+  }
+  while ((rank + 1 < count) && (entries[order[rank + 1]].rssi > entry.rssi)) {
+    order[rank] = order[rank + 1];
+    entries[order[rank]].rank = rank;
+    rank++;
+  }
+  order[rank] = index;
+  entry.rank = rank;
+  markChanged((from < rank) ? from : rank, (from < rank) ? rank : from);
+}
+
+void DeviceList::removeRank(uint16_t rank) {
+  uint16_t index = order[rank];
+  hashRemove(index);
+  for (uint16_t i = rank; i + 1 < count; i++) {
+    order[i] = order[i + 1];
+    entries[order[i]].rank = i;
+  }
+  count--;
+  freeIndices[freeCount++] = index;
+  markChanged(rank, count);
+}
+
+void DeviceList::update(const uint8_t *address, int rssi, uint32_t now) {
+  if (entries == NULL) {
+    return;
+  }
+  updates++;
+
+  int index = find(address);
+  if (index < 0) {
+    if (freeCount == 0) {
+      uint16_t oldest = 0;
+      for (uint16_t rank = 1; rank < count; rank++) {
+        if ((int32_t)(at(rank).lastSeen - at(oldest).lastSeen) < 0) {
+          oldest = rank;
+        }
+      }
+      removeRank(oldest);
+      evictions++;
+    }
+    index = freeIndices[--freeCount];
+    DeviceEntry &entry = entries[index];
+    memcpy(entry.address, address, bluetoothAddressBytes);
+    entry.sightings = 0;
+    entry.rank = count;
+    order[count++] = index;
+    hashInsert(index);
+  }
+
+  DeviceEntry &entry = entries[index];
+  entry.rssi = (int8_t)((rssi < -128) ? -128 : (rssi > 127) ? 127 : rssi);
+  entry.lastSeen = now;
+  if (entry.sightings < UINT16_MAX) {
+    entry.sightings++;
+  }
+  moveToSortedRank(index);
+}
+
+// 1回で詰めるので、まとめて消えても一覧の長さに比例する時間で終わる
+void DeviceList::expire(uint32_t now, uint32_t maxAge) {
+  if (entries == NULL) {
+    return;
+  }
+  uint16_t kept = 0;
+  uint16_t firstRemoved = count;
+  for (uint16_t rank = 0; rank < count; rank++) {
+    uint16_t index = order[rank];
+    if (now - entries[index].lastSeen >= maxAge) {
+      hashRemove(index);
+      freeIndices[freeCount++] = index;
+      if (firstRemoved == count) {
+        firstRemoved = rank;
+      }
+    } else {
+      order[kept] = index;
+      entries[index].rank = kept;
+      kept++;
+    }
+  }
+  if (kept != count) {
+    markChanged(firstRemoved, count - 1);
+    count = kept;
+  }
+}
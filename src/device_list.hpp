@@ -0,0 +1,78 @@
+#ifndef DEVICE_LIST_HPP
+#define DEVICE_LIST_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// 周辺のBLEデバイスの一覧
+//
+// 容量は固定で、最初に一度だけメモリを確保する。満杯の時に新しいデバイスが来たら最も長く受信していないものと入れ替える
+// RSSIの降順の並びを常に保ち、更新されたデバイスだけを並びの中で移動する
+// 前回takeChangesを呼んでから並びが変わった範囲を記録するので、表示側は変わった行だけを更新できる
+//
+
+static const int bluetoothAddressBytes = 6;
+
+struct DeviceEntry {
+  uint8_t address[bluetoothAddressBytes];
+  int8_t rssi;
+  uint8_t reserved;
+  uint16_t rank;      // RSSIの降順の並びでの位置
+  uint16_t sightings; // 受信回数(65535で止まる)
+  uint32_t lastSeen;  // 最後に受信した時刻(ms)
+};
+
+class DeviceList {
+public:
+  // capacityは32767以下。メモリはbeginで確保する
+  explicit DeviceList(uint16_t capacity) : entryCapacity(capacity) {}
+  ~DeviceList();
+
+  // 一覧のメモリを確保する。確保できなければfalse
+  bool begin();
+
+  // 受信したデバイスを追加、または更新する
+  void update(const uint8_t *address, int rssi, uint32_t now);
+  // maxAge(ms)以上受信していないデバイスを消す
+  void expire(uint32_t now, uint32_t maxAge);
+
+  uint16_t size() const { return count; }
+  uint16_t capacity() const { return entryCapacity; }
+  // RSSIの降順でrank番目のデバイス
+  const DeviceEntry &at(uint16_t rank) const { return entries[order[rank]]; }
+
+  // 前回から並びが変わった範囲[first, last]を返して記録を消す。変化が無ければfalse
+  // 数が変わった場合は、減った分の行もlastに含める
+  bool takeChanges(uint16_t *first, uint16_t *last);
+
+  uint32_t updateCount() const { return updates; }
+  uint32_t evictionCount() const { return evictions; }
+
+private:
+  int find(const uint8_t *address) const;
+  uint32_t slot(const uint8_t *address) const;
+  void hashInsert(uint16_t index);
+  void hashRemove(uint16_t index);
+  void removeRank(uint16_t rank);
+  void moveToSortedRank(uint16_t index);
+  void markChanged(uint16_t first, uint16_t last);
+
+  uint16_t entryCapacity;
+  uint16_t count = 0;
+  DeviceEntry *entries = NULL;
+  uint16_t *order = NULL;        // RSSIの降順に並べたentriesの番号
+  uint16_t *freeIndices = NULL;  // 使っていないentriesの番号
+  uint16_t freeCount = 0;
+  int16_t *table = NULL;         // アドレスからentriesの番号を引くハッシュ表(線形探索、空きは-1)
+  uint32_t tableMask = 0;
+
+  bool changed = false;
+  uint16_t changedFirst = 0;
+  uint16_t changedLast = 0;
+
+  uint32_t updates = 0;
+  uint32_t evictions = 0;
+};
+
+#endif
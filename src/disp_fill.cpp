@@ -0,0 +1,142 @@
+#include "disp_fill.hpp"
+#include "blend565.hpp"
+
+// 行の状態
+enum {
+  ROW_EMPTY = 0,  // 転送後に何も描画されていない
+  ROW_FILL,       // 全幅が単色で塗りつぶされていて、描画バッファには書き込んでいない
+  ROW_PIXELS,     // 描画バッファの内容を転送する
+};
+
+struct DispFillRow {
+  uint8_t state;
+  lv_color_t color;
+};
+
+struct DispFillCtx {
+  lv_draw_sw_ctx_t base;
+  DispFillRow *rows;  // 画面の行ごとの状態。画面のy座標で引く
+};
+
+// 画面の描画バッファに描画中であればtrue。レイヤーやスナップショットのバッファは対象外
+static bool isScreenBuffer(lv_draw_ctx_t *draw_ctx) {
+  lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+  return (disp != NULL) && (draw_ctx->buf == disp->driver->draw_buf->buf_act);
+}
+
+// 塗りつぶしを記録しただけの行を描画バッファに書き込む
+static void materializeRows(DispFillCtx *ctx, lv_coord_t y1, lv_coord_t y2) {
+  const lv_area_t *bufArea = ctx->base.base_draw.buf_area;
+  lv_coord_t bufWidth = lv_area_get_width(bufArea);
+  lv_color_t *buf = (lv_color_t *)ctx->base.base_draw.buf;
+
+  for (lv_coord_t y = y1; y <= y2; y++) {
+    DispFillRow &row = ctx->rows[y];
+    if (row.state == ROW_FILL) {
+#if DISP_BLEND_SWAR
+      blend565Fill(&buf[(y - bufArea->y1) * bufWidth], bufWidth, row.color);
+#else
+      lv_color_fill(&buf[(y - bufArea->y1) * bufWidth], row.color, bufWidth);
+#endif
+    }
+    row.state = ROW_PIXELS;
+  }
+}
+
+static void blendBuffer(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+#if DISP_BLEND_SWAR
+  if (blend565(draw_ctx, dsc)) {
+    return;
+  }
+#endif
+  lv_draw_sw_blend_basic(draw_ctx, dsc);
+}
+
+static void disp_fill_blend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc) {
+  DispFillCtx *ctx = (DispFillCtx *)draw_ctx;
+  if (!isScreenBuffer(draw_ctx)) {
+    blendBuffer(draw_ctx, dsc);
+    return;
+  }
+
+  if ((dsc->mask_buf != NULL) && (dsc->mask_res == LV_DRAW_MASK_RES_TRANSP)) {
+    return;
+  }
+  lv_area_t area;
+  if (!_lv_area_intersect(&area, dsc->blend_area, draw_ctx->clip_area)) {
+    return;
+  }
+
+  bool opaqueFill = (dsc->src_buf == NULL) && (dsc->opa >= LV_OPA_MAX) && (dsc->blend_mode == LV_BLEND_MODE_NORMAL) &&
+                    ((dsc->mask_buf == NULL) || (dsc->mask_res == LV_DRAW_MASK_RES_FULL_COVER));
+
+  if (opaqueFill) {
+    const lv_area_t *bufArea = draw_ctx->buf_area;
+    if ((area.x1 == bufArea->x1) && (area.x2 == bufArea->x2)) {
+      // 全幅の塗りつぶしはそれまでの描画を全て覆うので、記録を置き換えるだけでよい
+      for (lv_coord_t y = area.y1; y <= area.y2; y++) {
+        ctx->rows[y].state = ROW_FILL;
+        ctx->rows[y].color = dsc->color;
+      }
+      return;
+    }
+
+    // 同じ色で塗りつぶし済みの行への塗りつぶし(親と同じ背景色のコンテナなど)は何もしなくてよい
+    bool covered = true;
+    for (lv_coord_t y = area.y1; y <= area.y2 && covered; y++) {
+      covered = (ctx->rows[y].state == ROW_FILL) && (ctx->rows[y].color.full == dsc->color.full);
+    }
+    if (covered) {
+      return;
+    }
+  }
+
+  materializeRows(ctx, area.y1, area.y2);
+  blendBuffer(draw_ctx, dsc);
+}
+
+// レイヤーは画面のバッファを読むことがあるので、作る前に記録した行を全て書き込む
+static lv_draw_layer_ctx_t *disp_fill_layer_init(lv_draw_ctx_t *draw_ctx, lv_draw_layer_ctx_t *layer_ctx, lv_draw_layer_flags_t flags) {
+  if (isScreenBuffer(draw_ctx)) {
+    materializeRows((DispFillCtx *)draw_ctx, draw_ctx->buf_area->y1, draw_ctx->buf_area->y2);
+  }
+  return lv_draw_sw_layer_create(draw_ctx, layer_ctx, flags);
+}
+
+void dispFillInitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx) {
+  lv_draw_sw_init_ctx(drv, draw_ctx);
+
+  DispFillCtx *ctx = (DispFillCtx *)draw_ctx;
+  ctx->base.blend = disp_fill_blend;
+  ctx->base.base_draw.layer_init = disp_fill_layer_init;
+  ctx->rows = (DispFillRow *)lv_mem_alloc(drv->ver_res * sizeof(DispFillRow));
+  LV_ASSERT_MALLOC(ctx->rows);
+  lv_memset_00(ctx->rows, drv->ver_res * sizeof(DispFillRow));
+}
+
+void dispFillDeinitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx) {
+  DispFillCtx *ctx = (DispFillCtx *)draw_ctx;
+  lv_mem_free(ctx->rows);
+  ctx->rows = NULL;
+  lv_draw_sw_deinit_ctx(drv, draw_ctx);
+}
+
+size_t dispFillCtxSize() {
+  return sizeof(DispFillCtx);
+}
+
+int dispFillTakeRows(lv_disp_drv_t *drv, const lv_area_t *area, lv_coord_t y, bool *fill, lv_color_t *color) {
+  DispFillRow *rows = ((DispFillCtx *)drv->draw_ctx)->rows;
+  *fill = (rows[y].state == ROW_FILL);
+  *color = rows[y].color;
+
+  int count = 0;
+  for (; y <= area->y2; y++, count++) {
+    bool rowFill = (rows[y].state == ROW_FILL);
+    if ((rowFill != *fill) || (rowFill && (rows[y].color.full != color->full))) {
+      break;
+    }
+    rows[y].state = ROW_EMPTY;
+  }
+  return count;
+}
@@ -0,0 +1,25 @@
+#ifndef DISP_FILL_HPP
+#define DISP_FILL_HPP
+
+#include <lvgl.h>
+
+// 単色の塗りつぶしをパネルへの塗りつぶしコマンドに置き換える描画コンテキスト
+//
+// 描画バッファの幅全体を不透明な単色で塗りつぶす描画は、バッファに書き込まずに行ごとに記録する
+// その行に他の描画が重なった場合だけ、その時点でバッファを塗りつぶしてから描画する
+// 転送時にdispFillTakeRowsで行の状態を調べ、塗りつぶしの行はlcd.fillRectで送る
+//
+// 描画バッファの内容が転送後も残るdirect_modeやfull_refreshでは使わないこと
+
+// lv_disp_drv_t::draw_ctx_initに設定する
+void dispFillInitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx);
+// lv_disp_drv_t::draw_ctx_deinitに設定する
+void dispFillDeinitCtx(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx);
+// lv_disp_drv_t::draw_ctx_sizeに設定する
+size_t dispFillCtxSize();
+
+// 転送する領域areaのy行目から続く同じ種類の行の数を返し、その行の記録を消す
+// 単色で塗りつぶされた行ならfillにtrue、colorにその色をセットする。その行の描画バッファの内容は不定
+int dispFillTakeRows(lv_disp_drv_t *drv, const lv_area_t *area, lv_coord_t y, bool *fill, lv_color_t *color);
+
+#endif
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifndef UI_SIMULATOR
+#include <esp_heap_caps.h>
+#endif
+
+#include "font_pack.hpp"
+#include "glyph_index.hpp"
+#include "glyph_cache.hpp"
+
+struct FontPackHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t pageSize;
+  int16_t lineHeight;
+  int16_t baseLine;
+  int8_t underlinePosition;
+  int8_t underlineThickness;
+  uint8_t bpp;
+  uint8_t kernClasses;
+  uint16_t kernScale;
+  uint16_t cmapNum;
+  uint32_t glyphCount;
+  uint8_t leftClassCount;
+  uint8_t rightClassCount;
+  uint16_t reserved;
+  uint32_t cmapOffset;
+  uint32_t glyphOffset;
+  uint32_t kernOffset;
+  uint32_t bitmapOffset;
+  uint32_t bitmapSize;
+};
+
+struct FontPackCmap {
+  uint32_t rangeStart;
+  uint16_t rangeLength;
+  uint16_t glyphIdStart;
+  uint16_t listLength;
+  uint8_t type;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(FontPackHeader) == 48, "font pack header must match fonts/font_pack.py");
+static_assert(sizeof(FontPackCmap) == 12, "font pack cmap must match fonts/font_pack.py");
+// グリフの情報はファイルの8バイトの並びをその場でLVGLの構造体に置き換える(LV_FONT_FMT_TXT_LARGE 0の大きさ)
+static_assert(sizeof(lv_font_fmt_txt_glyph_dsc_t) == 8, "glyph descriptors are converted in place");
+
+static const char packMagic[4] = {'L', 'F', 'P', 'K'};
+static const uint16_t packVersion = 1;
+static const int maxPacks = 32;
+
+struct FontPack {
+  lv_font_t font;
+  lv_font_fmt_txt_dsc_t dsc;
+  lv_font_fmt_txt_glyph_cache_t cache;
+  lv_font_fmt_txt_kern_classes_t kern;
+  lv_fs_file_t file;
+  uint32_t bitmapOffset;
+  uint32_t bitmapSize;
+  uint8_t *cmapData;     // ファイルのcmapの部分。同じcmapのパックで共有する
+  uint32_t cmapSize;
+  size_t bytes;
+  char name[32];
+};
+
+// ページのキャッシュの1枚。packがNULLなら空き
+struct Page {
+  FontPack *pack;
+  uint32_t index;
+  uint32_t lastUse;
+  uint8_t *data;
+};
+
+static FontPack *packs[maxPacks];
+static int packCount = 0;
+static Page pages[FONT_PACK_PAGE_COUNT];
+static uint8_t *pageData = NULL;
+static uint32_t useCounter = 0;
+static void (*readHook)() = NULL;
+static int64_t (*microsFunc)() = NULL;
+static FontPackStats stats;
+
+#ifdef UI_SIMULATOR
+static void *psramAlloc(size_t size) {
+  return malloc(size);
+}
+#else
+static void *psramAlloc(size_t size) {
+  return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+#endif
+
+static bool readAt(lv_fs_file_t *file, uint32_t position, void *buffer, uint32_t length) {
+  if (readHook != NULL) {
+    readHook();
+  }
+  if (lv_fs_seek(file, position, LV_FS_SEEK_SET) != LV_FS_RES_OK) {
+    return false;
+  }
+  uint32_t read = 0;
+  return (lv_fs_read(file, buffer, length, &read) == LV_FS_RES_OK) && (read == length);
+}
+
+static FontPack *packOf(const lv_font_fmt_txt_dsc_t *fdsc) {
+  return (FontPack *)((uint8_t *)fdsc - offsetof(FontPack, dsc));
+}
+
+//
+// ページのキャッシュ
+//
+
+// 最も長く使われていないページ(空きがあれば空き)に読む
+static uint8_t *loadPage(FontPack *pack, uint32_t index) {
+  useCounter++;
+  Page *victim = &pages[0];
+  for (int i = 0; i < FONT_PACK_PAGE_COUNT; i++) {
+    Page &page = pages[i];
+    if ((page.pack == pack) && (page.index == index)) {
+      page.lastUse = useCounter;
+      stats.hits++;
+      return page.data;
+    }
+    if (page.lastUse < victim->lastUse) {
+      victim = &page;
+    }
+  }
+
+  stats.misses++;
+  if (pageData == NULL) {
+    pageData = (uint8_t *)psramAlloc(FONT_PACK_PAGE_SIZE * FONT_PACK_PAGE_COUNT);
+    if (pageData == NULL) {
+      return NULL;
+    }
+    for (int i = 0; i < FONT_PACK_PAGE_COUNT; i++) {
+      pages[i].data = pageData + i * FONT_PACK_PAGE_SIZE;
+    }
+  }
+  if (victim->pack != NULL) {
+    stats.evictions++;
+  }
+  victim->pack = NULL;
+  victim->lastUse = 0;
+
+  uint32_t start = index * FONT_PACK_PAGE_SIZE;
+  if (start >= pack->bitmapSize) {
+    return NULL;
+  }
+  uint32_t length = (pack->bitmapSize - start < FONT_PACK_PAGE_SIZE) ? pack->bitmapSize - start : FONT_PACK_PAGE_SIZE;
+  int64_t begin = (microsFunc != NULL) ? microsFunc() : 0;
+  if (!readAt(&pack->file, pack->bitmapOffset + start, victim->data, length)) {
+    return NULL;
+  }
+  if (microsFunc != NULL) {
+    stats.readMicros += microsFunc() - begin;
+  }
+  stats.readBytes += length;
+  victim->pack = pack;
+  victim->index = index;
+  victim->lastUse = useCounter;
+  return victim->data;
+}
+
+// フォントのbppのままのビットマップ。ページの中を指すので、次に別のグリフを読むまでに使うこと
+static const uint8_t *pageBitmap(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId) {
+  uint32_t offset = fdsc->glyph_dsc[glyphId].bitmap_index;
+  uint8_t *page = loadPage(packOf(fdsc), offset / FONT_PACK_PAGE_SIZE);
+  return (page != NULL) ? page + offset % FONT_PACK_PAGE_SIZE : NULL;
+}
+
+// lv_font_t.get_glyph_bitmap。グリフの情報はLVGLのlv_font_get_glyph_dsc_fmt_txt(glyph_index.cppの置き換え)が返す
+static const uint8_t *getGlyphBitmap(const lv_font_t *font, uint32_t unicode_letter) {
+  const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+  uint32_t glyphId = glyphIndexGlyphId(font, (unicode_letter == '\t') ? ' ' : unicode_letter);
+  if (glyphId == 0) {
+    return NULL;
+  }
+  if (glyphCacheApplies(fdsc)) {
+    return glyphCacheGetFrom(fdsc, glyphId, pageBitmap);
+  }
+  return pageBitmap(fdsc, glyphId);
+}
+
+//
+// パックを開く
+//
+
+// cmapの部分を読み、LVGLのcmapの表を作る。同じcmapのパックが開いてあれば共有する
+static bool loadCmaps(FontPack *pack, const FontPackHeader &header) {
+  uint32_t size = header.glyphOffset - header.cmapOffset;
+  if ((header.cmapNum == 0) || (size < header.cmapNum * sizeof(FontPackCmap))) {
+    return false;
+  }
+  uint8_t *data = (uint8_t *)psramAlloc(size);
+  if (data == NULL) {
+    return false;
+  }
+  if (!readAt(&pack->file, header.cmapOffset, data, size)) {
+    free(data);
+    return false;
+  }
+  for (int i = 0; i < packCount; i++) {
+    if ((packs[i]->cmapSize == size) && (memcmp(packs[i]->cmapData, data, size) == 0)) {
+      free(data);
+      pack->cmapData = packs[i]->cmapData;
+      pack->cmapSize = size;
+      pack->dsc.cmaps = packs[i]->dsc.cmaps;
+      return true;
+    }
+  }
+
+  lv_font_fmt_txt_cmap_t *cmaps = (lv_font_fmt_txt_cmap_t *)psramAlloc(header.cmapNum * sizeof(lv_font_fmt_txt_cmap_t));
+  if (cmaps == NULL) {
+    free(data);
+    return false;
+  }
+  const FontPackCmap *records = (const FontPackCmap *)data;
+  uint32_t position = header.cmapNum * sizeof(FontPackCmap);
+  for (int i = 0; i < header.cmapNum; i++) {
+    const FontPackCmap &record = records[i];
+    lv_font_fmt_txt_cmap_t &cmap = cmaps[i];
+    memset(&cmap, 0, sizeof(cmap));
+    cmap.range_start = record.rangeStart;
+    cmap.range_length = record.rangeLength;
+    cmap.glyph_id_start = record.glyphIdStart;
+    cmap.list_length = record.listLength;
+    cmap.type = (lv_font_fmt_txt_cmap_type_t)record.type;
+    uint32_t listSize = 0;
+    if ((cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_TINY) || (cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_FULL)) {
+      cmap.unicode_list = (const uint16_t *)(data + position);
+      position += cmap.list_length * sizeof(uint16_t);
+    }
+    if (cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_FULL) {
+      listSize = cmap.list_length * sizeof(uint16_t);
+    } else if (cmap.type == LV_FONT_FMT_TXT_CMAP_FORMAT0_FULL) {
+      listSize = (cmap.list_length + 1) & ~1;
+    }
+    if (listSize > 0) {
+      cmap.glyph_id_ofs_list = data + position;
+      position += listSize;
+    }
+    if (position > size) {
+      free(cmaps);
+      free(data);
+      return false;
+    }
+  }
+  pack->cmapData = data;
+  pack->cmapSize = size;
+  pack->dsc.cmaps = cmaps;
+  pack->bytes += size + header.cmapNum * sizeof(lv_font_fmt_txt_cmap_t);
+  return true;
+}
+
+// グリフの情報とカーニングを読む
+static bool loadGlyphs(FontPack *pack, const FontPackHeader &header) {
+  uint32_t glyphSize = header.glyphCount * 8;
+  uint32_t kernSize = header.kernClasses ? header.glyphCount * 2 + header.leftClassCount * header.rightClassCount : 0;
+  if ((header.glyphCount == 0) || (header.kernOffset - header.glyphOffset != glyphSize) ||
+      (header.bitmapOffset - header.kernOffset < kernSize)) {
+    return false;
+  }
+  uint8_t *data = (uint8_t *)psramAlloc(glyphSize + kernSize);
+  if (data == NULL) {
+    return false;
+  }
+  if (!readAt(&pack->file, header.glyphOffset, data, glyphSize) ||
+      ((kernSize > 0) && !readAt(&pack->file, header.kernOffset, data + glyphSize, kernSize))) {
+    free(data);
+    return false;
+  }
+
+  lv_font_fmt_txt_glyph_dsc_t *glyphs = (lv_font_fmt_txt_glyph_dsc_t *)data;
+  for (uint32_t i = 0; i < header.glyphCount; i++) {
+    const uint8_t *record = data + i * 8;
+    uint32_t word = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+    lv_font_fmt_txt_glyph_dsc_t glyph;
+    glyph.bitmap_index = word & 0xfffff;
+    glyph.adv_w = word >> 20;
+    glyph.box_w = record[4];
+    glyph.box_h = record[5];
+    glyph.ofs_x = (int8_t)record[6];
+    glyph.ofs_y = (int8_t)record[7];
+    uint32_t size = ((uint32_t)glyph.box_w * glyph.box_h * header.bpp + 7) / 8;
+    if ((size > 0) && ((glyph.bitmap_index + size > header.bitmapSize) ||
+                       (glyph.bitmap_index / FONT_PACK_PAGE_SIZE != (glyph.bitmap_index + size - 1) / FONT_PACK_PAGE_SIZE))) {
+      free(data);
+      return false;
+    }
+    glyphs[i] = glyph;
+  }
+  pack->dsc.glyph_dsc = glyphs;
+
+  if (kernSize > 0) {
+    pack->kern.left_class_mapping = data + glyphSize;
+    pack->kern.right_class_mapping = data + glyphSize + header.glyphCount;
+    pack->kern.class_pair_values = (const int8_t *)(data + glyphSize + header.glyphCount * 2);
+    pack->kern.left_class_cnt = header.leftClassCount;
+    pack->kern.right_class_cnt = header.rightClassCount;
+    pack->dsc.kern_dsc = &pack->kern;
+    pack->dsc.kern_classes = 1;
+  }
+  pack->bytes += glyphSize + kernSize;
+  return true;
+}
+
+static void setName(FontPack *pack, const char *path) {
+  const char *start = strrchr(path, '/');
+  start = (start != NULL) ? start + 1 : path;
+  const char *end = strrchr(start, '.');
+  size_t length = (end != NULL) ? (size_t)(end - start) : strlen(start);
+  if (length >= sizeof(pack->name)) {
+    length = sizeof(pack->name) - 1;
+  }
+  memcpy(pack->name, start, length);
+  pack->name[length] = '\0';
+}
+
+void fontPackBegin(void (*beforeRead)(), int64_t (*micros)()) {
+  readHook = beforeRead;
+  microsFunc = micros;
+}
+
+const lv_font_t *fontPackOpen(const char *path) {
+  if (packCount >= maxPacks) {
+    return NULL;
+  }
+  FontPack *pack = (FontPack *)psramAlloc(sizeof(FontPack));
+  if (pack == NULL) {
+    return NULL;
+  }
+  memset(pack, 0, sizeof(FontPack));
+  if (lv_fs_open(&pack->file, path, LV_FS_MODE_RD) != LV_FS_RES_OK) {
+    free(pack);
+    return NULL;
+  }
+
+  FontPackHeader header;
+  bool valid = readAt(&pack->file, 0, &header, sizeof(header)) && (memcmp(header.magic, packMagic, sizeof(packMagic)) == 0) &&
+               (header.version == packVersion) && (header.pageSize == FONT_PACK_PAGE_SIZE) &&
+               ((header.bpp == 1) || (header.bpp == 2) || (header.bpp == 4) || (header.bpp == 8)) &&
+               (header.cmapOffset <= header.glyphOffset) && (header.glyphOffset <= header.kernOffset) && (header.kernOffset <= header.bitmapOffset);
+  if (!valid || !loadCmaps(pack, header)) {
+    lv_fs_close(&pack->file);
+    free(pack);
+    return NULL;
+  }
+  if (!loadGlyphs(pack, header)) {
+    // cmapは共有しているかもしれないので、このパックだけが持つものだけを返す
+    bool shared = false;
+    for (int i = 0; i < packCount; i++) {
+      shared = shared || (packs[i]->cmapData == pack->cmapData);
+    }
+    if (!shared) {
+      free((void *)pack->dsc.cmaps);
+      free(pack->cmapData);
+    }
+    lv_fs_close(&pack->file);
+    free(pack);
+    return NULL;
+  }
+
+  pack->bitmapOffset = header.bitmapOffset;
+  pack->bitmapSize = header.bitmapSize;
+  pack->dsc.glyph_bitmap = NULL;
+  pack->dsc.kern_scale = header.kernScale;
+  pack->dsc.cmap_num = header.cmapNum;
+  pack->dsc.bpp = header.bpp;
+  pack->dsc.bitmap_format = LV_FONT_FMT_TXT_PLAIN;
+  pack->dsc.cache = &pack->cache;
+
+  pack->font.get_glyph_dsc = lv_font_get_glyph_dsc_fmt_txt;
+  pack->font.get_glyph_bitmap = getGlyphBitmap;
+  pack->font.line_height = header.lineHeight;
+  pack->font.base_line = header.baseLine;
+  pack->font.subpx = LV_FONT_SUBPX_NONE;
+  pack->font.underline_position = header.underlinePosition;
+  pack->font.underline_thickness = header.underlineThickness;
+  pack->font.dsc = &pack->dsc;
+  pack->bytes += sizeof(FontPack);
+  setName(pack, path);
+
+  // ビットマップはグリフ番号で読むので、表を必ず使う
+  if (!glyphIndexAttach(&pack->font)) {
+    LV_LOG_WARN("font pack %s: no glyph index", pack->name);
+  }
+  packs[packCount++] = pack;
+  return &pack->font;
+}
+
+const lv_font_t *fontPackFind(const char *name) {
+  for (int i = 0; i < packCount; i++) {
+    if (strcmp(packs[i]->name, name) == 0) {
+      return &packs[i]->font;
+    }
+  }
+  return NULL;
+}
+
+void fontPackGetStats(FontPackStats *result) {
+  *result = stats;
+  result->packs = packCount;
+  result->bytes = 0;
+  for (int i = 0; i < packCount; i++) {
+    result->bytes += packs[i]->bytes;
+  }
+  result->pages = 0;
+  for (int i = 0; i < FONT_PACK_PAGE_COUNT; i++) {
+    if (pages[i].pack != NULL) {
+      result->pages++;
+    }
+  }
+}
+
+void fontPackClearStats() {
+  stats.hits = 0;
+  stats.misses = 0;
+  stats.evictions = 0;
+  stats.readBytes = 0;
+  stats.readMicros = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef FONT_PACK_HPP
+#define FONT_PACK_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lvgl.h>
+
+//
+// SDカードのフォントパック
+//
+// fonts/font_pack.pyでフォントのCソースから作った.fpkをLVGLのファイルシステム('S:')から読む
+// ヘッダ、cmap、グリフの情報、カーニングは開いた時にPSRAMに読み、グリフのビットマップは描画する時にページ単位で読む
+// ページのキャッシュは全てのパックで共有するので、パックの数や大きさに関わらずFONT_PACK_PAGE_SIZE * FONT_PACK_PAGE_COUNTに収まる
+// 文字からグリフ番号はglyph_indexの表で引き、グリフのキャッシュ(glyph_cache)が使える時は展開したマスクを返す
+//
+// 形式(リトルエンディアン)
+//   ヘッダ(48バイト) : "LFPK"、版(1)、ページの大きさ、行の高さ、ベースライン、下線の位置と太さ、bpp、カーニングの有無、
+//                      カーニングの倍率、cmapの数、グリフの数、左右のクラスの数、各部の位置、ビットマップの大きさ
+//   cmap : 12バイトの表をcmapの数だけ並べ、その後にcmapの順でunicode_listとglyph_id_ofs_listを置く
+//   グリフの情報 : 8バイト(bitmap_index 20bit | adv_w 12bit、box_w、box_h、ofs_x、ofs_y)をグリフの数だけ並べる
+//   カーニング : 左のクラス、右のクラス(グリフの数ずつ)、クラスの組の値(左 * 右)
+//   ビットマップ : 圧縮しないビット列。グリフはページの境界をまたがない
+//
+
+// ビットマップのページの大きさ(バイト)。fonts/font_pack.pyの--page-sizeと同じにする
+#ifndef FONT_PACK_PAGE_SIZE
+#define FONT_PACK_PAGE_SIZE 4096
+#endif
+
+// キャッシュに置くページの数
+#ifndef FONT_PACK_PAGE_COUNT
+#define FONT_PACK_PAGE_COUNT 16
+#endif
+
+struct FontPackStats {
+  uint32_t packs;
+  size_t bytes;          // 常に置いているヘッダ、cmap、グリフの情報、カーニングの合計
+  uint32_t pages;        // キャッシュにあるページの数
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint64_t readBytes;    // SDカードから読んだビットマップの大きさ
+  uint64_t readMicros;   // ビットマップを読むのにかかった時間
+};
+
+// beforeReadはSDカードを読む前に呼ぶ関数(LCDとSPIバスを共有するので、転送が終わるのを待つ)。NULLなら呼ばない
+// microsは経過時間(us)を返す関数。フォントパックを開く前に呼ぶこと
+void fontPackBegin(void (*beforeRead)(), int64_t (*micros)());
+
+// フォントパックを開いてフォントを返す(例: "S:/fonts/mplus1_regular_14.fpk")。開けなければNULL
+// 開いたフォントは閉じない。名前は拡張子を除いたファイル名になる
+const lv_font_t *fontPackOpen(const char *path);
+
+// 開いたフォントを名前(例: "mplus1_regular_14")で探す。無ければNULL
+const lv_font_t *fontPackFind(const char *name);
+
+void fontPackGetStats(FontPackStats *stats);
+void fontPackClearStats();
+
+#endif
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef UI_SIMULATOR
+#include <esp_heap_caps.h>
+#endif
+
+#include "glyph_cache.hpp"
+
+extern "C" {
+const uint8_t *__real_lv_font_get_bitmap_fmt_txt(const lv_font_t *font, uint32_t unicode_letter);
+}
+
+//
+// エントリはPSRAMに1つずつ確保し、(フォント, グリフ番号)のハッシュ表と、使った順の双方向リストに入れる
+//
+
+struct GlyphEntry {
+  const lv_font_fmt_txt_dsc_t *font;
+  uint32_t glyphId;
+  size_t bytes;          // ヘッダを含む大きさ
+  GlyphEntry *hashNext;
+  GlyphEntry *newer;
+  GlyphEntry *older;
+  // 後ろにbox_w * box_hのマスクが続く
+};
+
+static const int bucketCount = 256;
+
+static GlyphEntry **buckets = NULL;
+static GlyphEntry *newest = NULL;
+static GlyphEntry *oldest = NULL;
+static size_t used = 0;
+static bool cacheEnabled = true;
+static GlyphCacheStats stats;
+
+// キャッシュに置けない時に展開する場所
+static uint8_t *scratch = NULL;
+static size_t scratchSize = 0;
+static uint8_t emptyMask[1];
+
+#ifdef UI_SIMULATOR
+static void *psramAlloc(size_t size) {
+  return malloc(size);
+}
+#else
+static void *psramAlloc(size_t size) {
+  return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+#endif
+
+static uint8_t *entryMask(GlyphEntry *entry) {
+  return (uint8_t *)(entry + 1);
+}
+
+static GlyphEntry **bucket(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId) {
+  uint32_t hash = ((uint32_t)(uintptr_t)fdsc >> 2) ^ (glyphId * 2654435761u);
+  return &buckets[(hash >> 16) & (bucketCount - 1)];
+}
+
+static void unlinkEntry(GlyphEntry *entry) {
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  } else {
+    newest = entry->older;
+  }
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  } else {
+    oldest = entry->newer;
+  }
+}
+
+static void pushNewest(GlyphEntry *entry) {
+  entry->newer = NULL;
+  entry->older = newest;
+  if (newest != NULL) {
+    newest->newer = entry;
+  } else {
+    oldest = entry;
+  }
+  newest = entry;
+}
+
+static void evictOldest() {
+  GlyphEntry *entry = oldest;
+  GlyphEntry **link = bucket(entry->font, entry->glyphId);
+  while (*link != entry) {
+    link = &(*link)->hashNext;
+  }
+  *link = entry->hashNext;
+  unlinkEntry(entry);
+  used -= entry->bytes;
+  stats.entries--;
+  stats.evictions++;
+  free(entry);
+}
+
+struct BitReader {
+  const uint8_t *src;
+  uint32_t buffer;  // 上位のビットから読む
+  uint32_t available;
+};
+
+// 上位のビットから順にlength(8以下)ビット読む。必要な分だけ1バイトずつ読み足すので、グリフの後ろは読まない
+static inline uint32_t readBits(BitReader &reader, uint32_t length) {
+  while (reader.available < length) {
+    reader.buffer |= (uint32_t)*reader.src++ << (24 - reader.available);
+    reader.available += 8;
+  }
+  uint32_t value = reader.buffer >> (32 - length);
+  reader.buffer <<= length;
+  reader.available -= length;
+  return value;
+}
+
+// LVGLの圧縮形式(lv_font_fmt_txt.cのrle_next)を、bppの値に戻さずにA8のマスクへ直接展開する
+// A8の値はbppのビットを繰り返したもの(4bppは17倍)なので、前の行とのXOR(prefilter)は展開したマスクの上で取れる
+static void decodeCompressed(const lv_font_fmt_txt_dsc_t *fdsc, const lv_font_fmt_txt_glyph_dsc_t *gdsc, const uint8_t *src, uint8_t *mask) {
+  enum RleState { rleSingle, rleRepeat, rleCounter };
+  uint32_t bpp = fdsc->bpp;
+  uint32_t scale = 255 / ((1 << bpp) - 1);
+  uint32_t width = gdsc->box_w;
+  uint32_t count = width * gdsc->box_h;
+  bool prefilter = (fdsc->bitmap_format == LV_FONT_FMT_TXT_COMPRESSED);
+  BitReader reader = {src, 0, 0};
+  RleState state = rleSingle;
+  uint32_t prev = 0;
+  uint32_t repeats = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t value;
+    if (state == rleSingle) {
+      // 直前と同じ値が続いたら、次からは繰り返すかどうかを1bitで読む(最初の値は比べない)
+      value = readBits(reader, bpp);
+      if ((i > 0) && (value == prev)) {
+        state = rleRepeat;
+        repeats = 0;
+      }
+      prev = value;
+    } else if (state == rleRepeat) {
+      repeats++;
+      if (readBits(reader, 1) != 0) {
+        value = prev;
+        if (repeats == 11) {
+          // 11回続いたら、残りの数を6bitで読む
+          repeats = readBits(reader, 6);
+          if (repeats != 0) {
+            state = rleCounter;
+          } else {
+            value = prev = readBits(reader, bpp);
+            state = rleSingle;
+          }
+        }
+      } else {
+        value = prev = readBits(reader, bpp);
+        state = rleSingle;
+      }
+    } else {
+      value = prev;
+      if (--repeats == 0) {
+        value = prev = readBits(reader, bpp);
+        state = rleSingle;
+      }
+    }
+    uint8_t alpha = value * scale;
+    mask[i] = (prefilter && (i >= width)) ? alpha ^ mask[i - width] : alpha;
+  }
+}
+
+// フォントのbppのビット列(行の区切りは無い)を8bitに広げる。LVGLのbpp 8の表と同じ値にする
+static void decode(const lv_font_fmt_txt_dsc_t *fdsc, const lv_font_fmt_txt_glyph_dsc_t *gdsc, const uint8_t *src, uint8_t *mask) {
+  if (fdsc->bitmap_format != LV_FONT_FMT_TXT_PLAIN) {
+    decodeCompressed(fdsc, gdsc, src, mask);
+    return;
+  }
+  uint32_t count = (uint32_t)gdsc->box_w * gdsc->box_h;
+  if (fdsc->bpp == 4) {
+    for (uint32_t i = 0; i + 1 < count; i += 2) {
+      uint8_t byte = *src++;
+      mask[i] = (byte >> 4) * 17;
+      mask[i + 1] = (byte & 0x0f) * 17;
+    }
+    if (count & 1) {
+      mask[count - 1] = (*src >> 4) * 17;
+    }
+    return;
+  }
+  uint32_t bpp = fdsc->bpp;
+  uint32_t max = (1 << bpp) - 1;
+  uint32_t bit = 0;
+  for (uint32_t i = 0; i < count; i++, bit += bpp) {
+    uint32_t value = (src[bit >> 3] >> (8 - bpp - (bit & 7))) & max;
+    mask[i] = value * 255 / max;
+  }
+}
+
+static const uint8_t *decodeToScratch(const lv_font_fmt_txt_dsc_t *fdsc, const lv_font_fmt_txt_glyph_dsc_t *gdsc, const uint8_t *src, size_t size) {
+  if (size > scratchSize) {
+    free(scratch);
+    scratch = (uint8_t *)psramAlloc(size);
+    scratchSize = (scratch != NULL) ? size : 0;
+    if (scratch == NULL) {
+      return NULL;
+    }
+  }
+  decode(fdsc, gdsc, src, scratch);
+  return scratch;
+}
+
+bool glyphCacheApplies(const lv_font_fmt_txt_dsc_t *fdsc) {
+  return cacheEnabled && ((fdsc->bpp == 1) || (fdsc->bpp == 2) || (fdsc->bpp == 4));
+}
+
+static const uint8_t *flashBitmap(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId) {
+  return fdsc->glyph_bitmap + fdsc->glyph_dsc[glyphId].bitmap_index;
+}
+
+const uint8_t *glyphCacheGet(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId) {
+  return glyphCacheGetFrom(fdsc, glyphId, flashBitmap);
+}
+
+const uint8_t *glyphCacheGetFrom(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId, GlyphBitmapSource source) {
+  if (glyphId == 0) {
+    return NULL;
+  }
+  const lv_font_fmt_txt_glyph_dsc_t *gdsc = &fdsc->glyph_dsc[glyphId];
+  size_t size = (size_t)gdsc->box_w * gdsc->box_h;
+  if (size == 0) {
+    return emptyMask;
+  }
+
+  if (buckets == NULL) {
+    buckets = (GlyphEntry **)psramAlloc(bucketCount * sizeof(GlyphEntry *));
+    if (buckets == NULL) {
+      const uint8_t *src = source(fdsc, glyphId);
+      return (src != NULL) ? decodeToScratch(fdsc, gdsc, src, size) : NULL;
+    }
+    memset(buckets, 0, bucketCount * sizeof(GlyphEntry *));
+  }
+
+  GlyphEntry **link = bucket(fdsc, glyphId);
+  for (GlyphEntry *entry = *link; entry != NULL; entry = entry->hashNext) {
+    if ((entry->font == fdsc) && (entry->glyphId == glyphId)) {
+      stats.hits++;
+      stats.flashBytes += (size * fdsc->bpp + 7) / 8;
+      if (entry != newest) {
+        unlinkEntry(entry);
+        pushNewest(entry);
+      }
+      return entryMask(entry);
+    }
+  }
+
+  stats.misses++;
+  const uint8_t *src = source(fdsc, glyphId);
+  if (src == NULL) {
+    return NULL;
+  }
+  size_t bytes = sizeof(GlyphEntry) + size;
+  if (bytes > GLYPH_CACHE_SIZE) {
+    return decodeToScratch(fdsc, gdsc, src, size);
+  }
+  while ((used + bytes > GLYPH_CACHE_SIZE) && (oldest != NULL)) {
+    evictOldest();
+  }
+  GlyphEntry *entry = (GlyphEntry *)psramAlloc(bytes);
+  if (entry == NULL) {
+    return decodeToScratch(fdsc, gdsc, src, size);
+  }
+  entry->font = fdsc;
+  entry->glyphId = glyphId;
+  entry->bytes = bytes;
+  entry->hashNext = *link;
+  *link = entry;
+  pushNewest(entry);
+  used += bytes;
+  stats.entries++;
+  decode(fdsc, gdsc, src, entryMask(entry));
+  return entryMask(entry);
+}
+
+void glyphCacheSetEnabled(bool enabled) {
+  cacheEnabled = enabled;
+}
+
+bool glyphCacheEnabled() {
+  return cacheEnabled;
+}
+
+void glyphCacheGetStats(GlyphCacheStats *result) {
+  *result = stats;
+  result->bytes = used;
+}
+
+void glyphCacheClearStats() {
+  stats.hits = 0;
+  stats.misses = 0;
+  stats.evictions = 0;
+  stats.flashBytes = 0;
+}
+
+//
+// ベンチマーク
+//
+
+static const char *settingsTexts[] = {
+  "無線の設定", "名前と暗号を入力してください", "接続先と番号", "証明書のファイルを選ぶ",
+  "時刻を合わせる機器", "周辺の機器を検索する", "受信の強さの下限", "温度と湿度を記録する間隔",
+  "設定を保存しました", "保存", "取消",
+};
+static const int settingsTextCount = sizeof(settingsTexts) / sizeof(settingsTexts[0]);
+static const int benchFrames = 10;
+static const int decodeRounds = 3;
+static const uint32_t decodeLetter = 0x10ffff;  // LVGLの1文字のキャッシュに入れて、グリフ番号で引かせる文字
+
+// 画面全体を描画し直して、1回あたりの時間(us)を返す
+static uint32_t measure(lv_obj_t *screen, int64_t (*micros)()) {
+  int64_t start = micros();
+  for (int i = 0; i < benchFrames; i++) {
+    lv_obj_invalidate(screen);
+    lv_refr_now(NULL);
+  }
+  return (uint32_t)((micros() - start) / benchFrames);
+}
+
+// フォントのグリフの数(最大のグリフ番号 + 1)
+static uint32_t glyphCount(const lv_font_fmt_txt_dsc_t *fdsc) {
+  uint32_t count = 1;
+  for (int i = 0; i < fdsc->cmap_num; i++) {
+    const lv_font_fmt_txt_cmap_t &cmap = fdsc->cmaps[i];
+    uint32_t end = cmap.glyph_id_start;
+    if (cmap.type == LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY) {
+      end += cmap.range_length;
+    } else if (cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_TINY) {
+      end += cmap.list_length;
+    } else {
+      for (uint32_t j = 0; j < cmap.list_length; j++) {
+        uint32_t ofs = (cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_FULL) ? ((const uint16_t *)cmap.glyph_id_ofs_list)[j] : ((const uint8_t *)cmap.glyph_id_ofs_list)[j];
+        if (cmap.glyph_id_start + ofs + 1 > end) {
+          end = cmap.glyph_id_start + ofs + 1;
+        }
+      }
+    }
+    if (end > count) {
+      count = end;
+    }
+  }
+  return count;
+}
+
+// 全てのグリフを展開して、1グリフあたりの時間(ns)を返す
+// lvglならLVGLのlv_font_get_bitmap_fmt_txt(平文はそのまま返し、圧縮はbppのビット列に展開する。A8への変換は描画の時)
+static uint32_t measureDecode(const lv_font_t *font, bool lvgl, int64_t (*micros)()) {
+  const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+  uint32_t count = glyphCount(fdsc);
+  uint32_t glyphs = 0;
+  int64_t start = micros();
+  for (int round = 0; round < decodeRounds; round++) {
+    for (uint32_t glyphId = 1; glyphId < count; glyphId++) {
+      const lv_font_fmt_txt_glyph_dsc_t *gdsc = &fdsc->glyph_dsc[glyphId];
+      size_t size = (size_t)gdsc->box_w * gdsc->box_h;
+      if (size == 0) {
+        continue;
+      }
+      if (lvgl) {
+        fdsc->cache->last_letter = decodeLetter;
+        fdsc->cache->last_glyph_id = glyphId;
+        __real_lv_font_get_bitmap_fmt_txt(font, decodeLetter);
+      } else {
+        decodeToScratch(fdsc, gdsc, fdsc->glyph_bitmap + gdsc->bitmap_index, size);
+      }
+      glyphs++;
+    }
+  }
+  int64_t elapsed = micros() - start;
+  if (lvgl) {
+    fdsc->cache->last_letter = 0;
+    fdsc->cache->last_glyph_id = 0;
+  }
+  return (glyphs > 0) ? (uint32_t)(elapsed * 1000 / glyphs) : 0;
+}
+
+void glyphCacheBenchmark(const lv_font_t *font, int64_t (*micros)(), void (*print)(const char *line)) {
+  char line[128];
+
+  lv_obj_t *previous = lv_scr_act();
+  lv_obj_t *screen = lv_obj_create(NULL);
+  lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_ROW_WRAP);
+  lv_obj_set_style_pad_all(screen, 4, 0);
+  lv_obj_set_style_pad_gap(screen, 6, 0);
+  for (int i = 0; i < settingsTextCount; i++) {
+    lv_obj_t *label = lv_label_create(screen);
+    lv_obj_set_style_text_font(label, font, 0);
+    lv_label_set_text_static(label, settingsTexts[i]);
+  }
+  lv_scr_load(screen);
+  lv_refr_now(NULL);
+
+  bool enabled = cacheEnabled;
+  cacheEnabled = false;
+  uint32_t stockMicros = measure(screen, micros);
+  cacheEnabled = true;
+  GlyphCacheStats before = stats;
+  uint32_t cachedMicros = measure(screen, micros);
+  cacheEnabled = enabled;
+
+  uint32_t hits = stats.hits - before.hits;
+  uint32_t misses = stats.misses - before.misses;
+  uint64_t flashBytes = stats.flashBytes - before.flashBytes;
+  snprintf(line, sizeof(line), "settings screen : %d frames, no cache %u us/frame, cache %u us/frame",
+           benchFrames, (unsigned)stockMicros, (unsigned)cachedMicros);
+  print(line);
+  snprintf(line, sizeof(line), "glyph cache : hits %u misses %u (%u%%), flash bytes avoided %u (%u per frame)",
+           (unsigned)hits, (unsigned)misses, (unsigned)((hits + misses > 0) ? hits * 100 / (hits + misses) : 0),
+           (unsigned)flashBytes, (unsigned)(flashBytes / benchFrames));
+  print(line);
+  snprintf(line, sizeof(line), "glyph cache : %u entries %u / %u bytes", (unsigned)stats.entries, (unsigned)used, (unsigned)GLYPH_CACHE_SIZE);
+  print(line);
+
+  // キャッシュに無いグリフを1つ展開する時間。圧縮したフォントと圧縮していないフォントで比べる
+  const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+  if ((fdsc->glyph_bitmap != NULL) && (fdsc->cache != NULL)) {
+    snprintf(line, sizeof(line), "decode %s : %u glyphs, lvgl %u ns/glyph, A8 %u ns/glyph",
+             (fdsc->bitmap_format == LV_FONT_FMT_TXT_PLAIN) ? "plain" : "compressed", (unsigned)(glyphCount(fdsc) - 1),
+             (unsigned)measureDecode(font, true, micros), (unsigned)measureDecode(font, false, micros));
+    print(line);
+  }
+
+  lv_scr_load(previous);
+  lv_obj_del(screen);
+}
@@ -0,0 +1,55 @@
+#ifndef GLYPH_CACHE_HPP
+#define GLYPH_CACHE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lvgl.h>
+
+//
+// 描画したグリフのキャッシュ
+//
+// glyph_indexの表を使うフォント(mplus1_*)のグリフを、フラッシュの4bppから8bit(A8)のマスクに展開してPSRAMに置く
+// LVGLにはbpp 8のグリフとして渡すので、描画のたびにフラッシュから読んで4bitずつ取り出す手間が無くなる
+// 圧縮したフォント(LV_USE_FONT_COMPRESSED)は、展開した値をそのままマスクに書くので、LVGLの展開用の行の表を使わない
+// (フォント, グリフ番号)で引き、GLYPH_CACHE_SIZEを超えたら最も長く使われていないものから捨てる
+// glyph_index.cppのlv_font_get_glyph_dsc_fmt_txtとlv_font_get_bitmap_fmt_txtの置き換えから呼ばれる
+//
+
+// キャッシュに置くマスクの合計(バイト)
+#ifndef GLYPH_CACHE_SIZE
+#define GLYPH_CACHE_SIZE (48 * 1024)
+#endif
+
+struct GlyphCacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint32_t entries;
+  size_t bytes;          // 置いているマスクの合計
+  uint64_t flashBytes;   // 当たった分だけフラッシュ(フォントパックではSDのページ)から読まずに済んだ大きさ
+};
+
+// キャッシュを使うフォントか(1, 2, 4bppのフォント。圧縮の有無は問わない)
+bool glyphCacheApplies(const lv_font_fmt_txt_dsc_t *fdsc);
+
+// A8のマスクを返す。キャッシュに無ければ展開して加える。glyphIdが0ならNULL
+const uint8_t *glyphCacheGet(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId);
+
+// フォントのbppのままのビットマップを返す関数。読めなければNULL
+typedef const uint8_t *(*GlyphBitmapSource)(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId);
+
+// glyphCacheGetと同じ。キャッシュに無い時はsourceからビットマップを読む(glyph_bitmapを持たないSDのフォントパック用)
+const uint8_t *glyphCacheGetFrom(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t glyphId, GlyphBitmapSource source);
+
+// falseの間はキャッシュを使わず、LVGLがフォントのbppのまま描画する(ベンチマーク用)
+void glyphCacheSetEnabled(bool enabled);
+bool glyphCacheEnabled();
+
+void glyphCacheGetStats(GlyphCacheStats *stats);
+void glyphCacheClearStats();
+
+// fontで日本語の設定画面を描画し、キャッシュを使わない場合と使う場合の描画時間、当たりの率、読まずに済んだフラッシュの大きさを比べる
+// 結果を1行ずつprintに渡す。表示ドライバの登録後に、描画中でない時に呼ぶこと
+void glyphCacheBenchmark(const lv_font_t *font, int64_t (*micros)(), void (*print)(const char *line));
+
+#endif
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph_index.hpp"
+#include "glyph_cache.hpp"
+
+extern "C" {
+bool __real_lv_font_get_glyph_dsc_fmt_txt(const lv_font_t *font, lv_font_glyph_dsc_t *dsc_out, uint32_t unicode_letter, uint32_t unicode_letter_next);
+const uint8_t *__real_lv_font_get_bitmap_fmt_txt(const lv_font_t *font, uint32_t unicode_letter);
+}
+
+static const int pageShift = 8;
+static const uint32_t pageSize = 1 << pageShift;
+static const uint32_t pageMask = pageSize - 1;
+static const uint16_t minSparseLength = 256;  // これより短い疎なcmapしか無いフォントは二分探索のままにする
+static const int maxFonts = 32;
+
+struct GlyphIndex {
+  const lv_font_fmt_txt_dsc_t *source;  // 表を作ったフォント。cmapが同じか比べる
+  uint32_t letterCount;                 // 表が覆う文字の数(最後の文字 + 1)
+  uint16_t *directory;                  // 256文字ごとのページ番号。0は全てグリフが無いページ
+  uint16_t *pages;
+  size_t bytes;
+};
+
+struct IndexedFont {
+  const void *dsc;
+  GlyphIndex *index;  // 表を使わないフォントはNULL
+};
+
+static IndexedFont fonts[maxFonts];
+static int fontCount = 0;
+static GlyphIndex *indexes[maxFonts];
+static int indexCount = 0;
+static const void *lastDsc = NULL;
+static GlyphIndex *lastIndex = NULL;
+static bool indexEnabled = true;  // ベンチマークでLVGLの探索と比べる時だけfalse
+static uint32_t lookups = 0;
+static uint32_t glyphDscCalls = 0;
+
+static size_t glyphIdOfsSize(const lv_font_fmt_txt_cmap_t &cmap) {
+  if (cmap.glyph_id_ofs_list == NULL) {
+    return 0;
+  }
+  return cmap.list_length * ((cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_FULL) ? sizeof(uint16_t) : sizeof(uint8_t));
+}
+
+static bool sameCmaps(const lv_font_fmt_txt_dsc_t *a, const lv_font_fmt_txt_dsc_t *b) {
+  if (a->cmap_num != b->cmap_num) {
+    return false;
+  }
+  for (int i = 0; i < a->cmap_num; i++) {
+    const lv_font_fmt_txt_cmap_t &ca = a->cmaps[i];
+    const lv_font_fmt_txt_cmap_t &cb = b->cmaps[i];
+    if ((ca.range_start != cb.range_start) || (ca.range_length != cb.range_length) || (ca.glyph_id_start != cb.glyph_id_start) ||
+        (ca.list_length != cb.list_length) || (ca.type != cb.type) ||
+        ((ca.unicode_list == NULL) != (cb.unicode_list == NULL)) || ((ca.glyph_id_ofs_list == NULL) != (cb.glyph_id_ofs_list == NULL))) {
+      return false;
+    }
+    if ((ca.unicode_list != NULL) && (memcmp(ca.unicode_list, cb.unicode_list, ca.list_length * sizeof(uint16_t)) != 0)) {
+      return false;
+    }
+    if ((ca.glyph_id_ofs_list != NULL) && (memcmp(ca.glyph_id_ofs_list, cb.glyph_id_ofs_list, glyphIdOfsSize(ca)) != 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 表を使うフォントか。カーニングはクラスの表だけを計算する
+// forceなら疎なcmapの長さに関わらず表を使う
+static bool indexable(const lv_font_fmt_txt_dsc_t *fdsc, bool force) {
+  if ((fdsc->cache == NULL) || ((fdsc->kern_dsc != NULL) && (fdsc->kern_classes == 0))) {
+    return false;
+  }
+  if (force) {
+    return true;
+  }
+  for (int i = 0; i < fdsc->cmap_num; i++) {
+    const lv_font_fmt_txt_cmap_t &cmap = fdsc->cmaps[i];
+    if (((cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_TINY) || (cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_FULL)) && (cmap.list_length >= minSparseLength)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 1文字1要素の表を作り、グリフのあるページだけを残す
+// LVGLのget_glyph_dsc_idは先頭のcmapから順に範囲を調べ(範囲の終わりの次の文字も含む)、最初に入った範囲の結果を返す
+// 後ろのcmapから順に上書きして同じ結果にする。疎なcmapはリストに無い文字も0で上書きする
+static GlyphIndex *buildIndex(const lv_font_fmt_txt_dsc_t *fdsc) {
+  uint32_t letterCount = 0;
+  for (int i = 0; i < fdsc->cmap_num; i++) {
+    uint32_t end = fdsc->cmaps[i].range_start + fdsc->cmaps[i].range_length + 1;
+    if (end > letterCount) {
+      letterCount = end;
+    }
+  }
+  uint16_t *flat = (uint16_t *)calloc(letterCount, sizeof(uint16_t));
+  if (flat == NULL) {
+    return NULL;
+  }
+
+  for (int i = fdsc->cmap_num - 1; i >= 0; i--) {
+    const lv_font_fmt_txt_cmap_t &cmap = fdsc->cmaps[i];
+    uint16_t *range = flat + cmap.range_start;
+    switch (cmap.type) {
+      case LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY:
+        for (uint32_t rcp = 0; rcp <= cmap.range_length; rcp++) {
+          range[rcp] = cmap.glyph_id_start + rcp;
+        }
+        break;
+      case LV_FONT_FMT_TXT_CMAP_FORMAT0_FULL: {
+        // 範囲の終わりの次の文字はLVGLではリストの外を読むので、グリフ無しにする
+        const uint8_t *ofs = (const uint8_t *)cmap.glyph_id_ofs_list;
+        for (uint32_t rcp = 0; rcp < cmap.range_length; rcp++) {
+          range[rcp] = cmap.glyph_id_start + ofs[rcp];
+        }
+        range[cmap.range_length] = 0;
+        break;
+      }
+      case LV_FONT_FMT_TXT_CMAP_SPARSE_TINY:
+      case LV_FONT_FMT_TXT_CMAP_SPARSE_FULL: {
+        memset(range, 0, (cmap.range_length + 1) * sizeof(uint16_t));
+        const uint16_t *ofs = (const uint16_t *)cmap.glyph_id_ofs_list;
+        for (uint32_t j = 0; j < cmap.list_length; j++) {
+          uint32_t rcp = cmap.unicode_list[j];
+          if (rcp <= cmap.range_length) {
+            range[rcp] = cmap.glyph_id_start + ((cmap.type == LV_FONT_FMT_TXT_CMAP_SPARSE_TINY) ? j : ofs[j]);
+          }
+        }
+        break;
+      }
+    }
+  }
+  flat[0] = 0;
+
+  uint32_t directorySize = (letterCount + pageMask) >> pageShift;
+  uint32_t pageCount = 1;
+  for (uint32_t start = 0; start < letterCount; start += pageSize) {
+    for (uint32_t letter = start; (letter < start + pageSize) && (letter < letterCount); letter++) {
+      if (flat[letter] != 0) {
+        pageCount++;
+        break;
+      }
+    }
+  }
+
+  size_t bytes = sizeof(GlyphIndex) + directorySize * sizeof(uint16_t) + pageCount * pageSize * sizeof(uint16_t);
+  GlyphIndex *index = (GlyphIndex *)malloc(bytes);
+  if (index == NULL) {
+    free(flat);
+    return NULL;
+  }
+  index->source = fdsc;
+  index->letterCount = letterCount;
+  index->directory = (uint16_t *)(index + 1);
+  index->pages = index->directory + directorySize;
+  index->bytes = bytes;
+  memset(index->pages, 0, pageSize * sizeof(uint16_t));
+
+  uint16_t page = 1;
+  for (uint32_t d = 0; d < directorySize; d++) {
+    uint32_t start = d << pageShift;
+    uint32_t length = (letterCount - start < pageSize) ? letterCount - start : pageSize;
+    bool empty = true;
+    for (uint32_t k = 0; k < length; k++) {
+      if (flat[start + k] != 0) {
+        empty = false;
+        break;
+      }
+    }
+    if (empty) {
+      index->directory[d] = 0;
+      continue;
+    }
+    uint16_t *dest = index->pages + page * pageSize;
+    memset(dest, 0, pageSize * sizeof(uint16_t));
+    memcpy(dest, flat + start, length * sizeof(uint16_t));
+    index->directory[d] = page++;
+  }
+  free(flat);
+  return index;
+}
+
+// フォントの表。初めて使ったフォントは、cmapが同じ表があれば共有し、無ければ作る
+static GlyphIndex *attachIndex(const lv_font_t *font, bool force) {
+  if (font->dsc == lastDsc) {
+    return lastIndex;
+  }
+  GlyphIndex *index = NULL;
+  bool found = false;
+  for (int i = 0; i < fontCount; i++) {
+    if (fonts[i].dsc == font->dsc) {
+      index = fonts[i].index;
+      found = true;
+      break;
+    }
+  }
+  if (!found && (fontCount < maxFonts)) {
+    const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+    if (indexable(fdsc, force)) {
+      for (int i = 0; (i < indexCount) && (index == NULL); i++) {
+        if (sameCmaps(indexes[i]->source, fdsc)) {
+          index = indexes[i];
+        }
+      }
+      if (index == NULL) {
+        index = buildIndex(fdsc);
+        if (index != NULL) {
+          indexes[indexCount++] = index;
+        }
+      }
+    }
+    fonts[fontCount].dsc = font->dsc;
+    fonts[fontCount].index = index;
+    fontCount++;
+  }
+  lastDsc = font->dsc;
+  lastIndex = index;
+  return index;
+}
+
+static GlyphIndex *findIndex(const lv_font_t *font) {
+  if (!indexEnabled) {
+    return NULL;
+  }
+  return attachIndex(font, false);
+}
+
+static inline uint32_t lookup(const GlyphIndex *index, uint32_t letter) {
+  lookups++;
+  if (letter >= index->letterCount) {
+    return 0;
+  }
+  return index->pages[(index->directory[letter >> pageShift] << pageShift) | (letter & pageMask)];
+}
+
+// LVGLの1文字のキャッシュに入れておくと、元の関数は探索せずにその番号を使う
+static void primeCache(const lv_font_fmt_txt_dsc_t *fdsc, uint32_t letter, uint32_t glyphId) {
+  fdsc->cache->last_letter = letter;
+  fdsc->cache->last_glyph_id = glyphId;
+}
+
+extern "C" bool __wrap_lv_font_get_glyph_dsc_fmt_txt(const lv_font_t *font, lv_font_glyph_dsc_t *dsc_out, uint32_t unicode_letter, uint32_t unicode_letter_next) {
+  glyphDscCalls++;
+  GlyphIndex *index = findIndex(font);
+  if (index == NULL) {
+    return __real_lv_font_get_glyph_dsc_fmt_txt(font, dsc_out, unicode_letter, unicode_letter_next);
+  }
+
+  // タブは空白の2倍の幅にする(LVGLと同じ)
+  const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+  bool tab = (unicode_letter == '\t');
+  uint32_t letter = tab ? ' ' : unicode_letter;
+  uint32_t glyphId = lookup(index, letter);
+  primeCache(fdsc, letter, glyphId);
+  // 次の文字を0にして、カーニングのための探索をさせない
+  if (!__real_lv_font_get_glyph_dsc_fmt_txt(font, dsc_out, unicode_letter, 0)) {
+    return false;
+  }
+  // グリフのキャッシュはA8のマスクを返す
+  if (glyphCacheApplies(fdsc)) {
+    dsc_out->bpp = 8;
+  }
+  if ((fdsc->kern_dsc == NULL) || (unicode_letter_next == 0)) {
+    return true;
+  }
+
+  uint32_t nextGlyphId = lookup(index, unicode_letter_next);
+  if (nextGlyphId == 0) {
+    return true;
+  }
+  const lv_font_fmt_txt_kern_classes_t *kdsc = (const lv_font_fmt_txt_kern_classes_t *)fdsc->kern_dsc;
+  uint8_t leftClass = kdsc->left_class_mapping[glyphId];
+  uint8_t rightClass = kdsc->right_class_mapping[nextGlyphId];
+  if ((leftClass == 0) || (rightClass == 0)) {
+    return true;
+  }
+  int8_t value = kdsc->class_pair_values[(leftClass - 1) * kdsc->right_class_cnt + (rightClass - 1)];
+  if (value != 0) {
+    // lv_font_get_glyph_dsc_fmt_txtと同じく1/16画素単位で足して丸める
+    uint32_t advance = fdsc->glyph_dsc[glyphId].adv_w;
+    if (tab) {
+      advance *= 2;
+    }
+    advance += ((int32_t)value * fdsc->kern_scale) >> 4;
+    dsc_out->adv_w = (advance + (1 << 3)) >> 4;
+  }
+  return true;
+}
+
+extern "C" const uint8_t *__wrap_lv_font_get_bitmap_fmt_txt(const lv_font_t *font, uint32_t unicode_letter) {
+  GlyphIndex *index = findIndex(font);
+  if (index != NULL) {
+    const lv_font_fmt_txt_dsc_t *fdsc = (const lv_font_fmt_txt_dsc_t *)font->dsc;
+    uint32_t letter = (unicode_letter == '\t') ? ' ' : unicode_letter;
+    uint32_t glyphId = lookup(index, letter);
+    if (glyphCacheApplies(fdsc)) {
+      return glyphCacheGet(fdsc, glyphId);
+    }
+    primeCache(fdsc, letter, glyphId);
+  }
+  return __real_lv_font_get_bitmap_fmt_txt(font, unicode_letter);
+}
+
+bool glyphIndexAttach(const lv_font_t *font) {
+  return attachIndex(font, true) != NULL;
+}
+
+uint32_t glyphIndexGlyphId(const lv_font_t *font, uint32_t letter) {
+  GlyphIndex *index = attachIndex(font, false);
+  return (index != NULL) ? lookup(index, letter) : 0;
+}
+
+void glyphIndexGetStats(GlyphIndexStats *stats) {
+  memset(stats, 0, sizeof(GlyphIndexStats));
+  for (int i = 0; i < fontCount; i++) {
+    if (fonts[i].index != NULL) {
+      stats->fonts++;
+    }
+  }
+  stats->indexes = indexCount;
+  for (int i = 0; i < indexCount; i++) {
+    stats->bytes += indexes[i]->bytes;
+  }
+  stats->lookups = lookups;
+}
+
+//
+// ベンチマーク
+//
+
+// 設定画面やお知らせのような、かなと漢字の混ざった文
+static const char *benchPage =
+  "設定を保存しました 温度と湿度の履歴は三日分を記録します "
+  "周辺の機器を検索しています 通信が切断された場合は自動で再接続します "
+  "証明書のファイルを選んでください 時刻は日本標準時で表示します "
+  "電池の残量が少なくなっています 充電してから使ってください "
+  "無線の設定を変更すると接続し直します 画面に触れると操作できます";
+static const lv_coord_t benchWidth = 300;
+static const int benchRounds = 20;
+
+// ページを並べて、1秒あたりにグリフを引いた回数を返す
+static uint32_t measure(const lv_font_t *font, int64_t (*micros)(), uint32_t *calls) {
+  uint32_t before = glyphDscCalls;
+  int64_t start = micros();
+  for (int i = 0; i < benchRounds; i++) {
+    lv_point_t size;
+    lv_txt_get_size(&size, benchPage, font, 0, 0, benchWidth, LV_TEXT_FLAG_NONE);
+  }
+  int64_t elapsed = micros() - start;
+  *calls = glyphDscCalls - before;
+  return (uint32_t)((int64_t)*calls * 1000000 / ((elapsed > 0) ? elapsed : 1));
+}
+
+// 表の全ての文字で、表を使う場合と使わない場合のグリフの情報を比べる。異なる文字の数を返す
+// グリフのキャッシュはbppとマスクの場所が変わるので止めておく
+static uint32_t compare(const lv_font_t *font, uint32_t letterCount) {
+  bool cacheEnabled = glyphCacheEnabled();
+  glyphCacheSetEnabled(false);
+  uint32_t mismatches = 0;
+  for (uint32_t letter = 1; letter < letterCount; letter++) {
+    // 次の文字はカーニングのある組み合わせを含むように英字とかなにする
+    uint32_t next = (letter & 1) ? 'A' : 0x3042;
+    lv_font_glyph_dsc_t stock;
+    lv_font_glyph_dsc_t indexed;
+    memset(&stock, 0, sizeof(stock));
+    memset(&indexed, 0, sizeof(indexed));
+    indexEnabled = false;
+    bool stockFound = font->get_glyph_dsc(font, &stock, letter, next);
+    const uint8_t *stockBitmap = stockFound ? font->get_glyph_bitmap(font, letter) : NULL;
+    indexEnabled = true;
+    bool indexedFound = font->get_glyph_dsc(font, &indexed, letter, next);
+    const uint8_t *indexedBitmap = indexedFound ? font->get_glyph_bitmap(font, letter) : NULL;
+    if ((stockFound != indexedFound) || (memcmp(&stock, &indexed, sizeof(stock)) != 0) || (stockBitmap != indexedBitmap)) {
+      mismatches++;
+    }
+  }
+  glyphCacheSetEnabled(cacheEnabled);
+  return mismatches;
+}
+
+void glyphIndexBenchmark(const lv_font_t *font, int64_t (*micros)(), void (*print)(const char *line)) {
+  char line[128];
+
+  indexEnabled = true;
+  int64_t start = micros();
+  GlyphIndex *index = findIndex(font);
+  int64_t buildMicros = micros() - start;
+  if (index == NULL) {
+    print("glyph index : font is not indexed");
+    return;
+  }
+  int shared = 0;
+  for (int i = 0; i < fontCount; i++) {
+    if (fonts[i].index == index) {
+      shared++;
+    }
+  }
+  snprintf(line, sizeof(line), "glyph index : %u bytes, %u letters, shared by %d font(s), first use %lld us",
+           (unsigned)index->bytes, (unsigned)index->letterCount, shared, (long long)buildMicros);
+  print(line);
+
+  uint32_t stockCalls;
+  uint32_t indexedCalls;
+  indexEnabled = false;
+  uint32_t stockRate = measure(font, micros, &stockCalls);
+  indexEnabled = true;
+  uint32_t indexedRate = measure(font, micros, &indexedCalls);
+  snprintf(line, sizeof(line), "layout %d x %u letters : lvgl %u lookups/s, index %u lookups/s (x%.2f)",
+           benchRounds, (unsigned)(indexedCalls / benchRounds), (unsigned)stockRate, (unsigned)indexedRate,
+           (double)indexedRate / ((stockRate > 0) ? stockRate : 1));
+  print(line);
+
+  snprintf(line, sizeof(line), "mismatches : %u", (unsigned)compare(font, index->letterCount));
+  print(line);
+}
@@ -0,0 +1,40 @@
+#ifndef GLYPH_INDEX_HPP
+#define GLYPH_INDEX_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lvgl.h>
+
+//
+// 文字からグリフ番号を引く表
+//
+// mplus1_*のフォントは漢字をU+30F2からの疎なcmap(2154文字)に持つので、LVGLは文字ごとに二分探索する
+// LVGLのフォントの1文字のキャッシュは、幅を求める時に次の文字を引くので日本語ではほとんど当たらない
+// 256文字ごとのページに分けた表を作り、ページ番号とページの中の位置の2回の参照でグリフ番号を引く
+// 表はフォントを初めて使った時にcmapから作り、cmapが同じフォント(mplus1は全ての太さと大きさ)で共有する
+//
+// lv_font_get_glyph_dsc_fmt_txtとlv_font_get_bitmap_fmt_txtはリンカの--wrapで置き換える(platformio.iniのbuild_flags)
+//
+
+struct GlyphIndexStats {
+  uint32_t fonts;    // 表を使っているフォントの数
+  uint32_t indexes;  // 作った表の数
+  size_t bytes;      // 表の大きさの合計
+  uint32_t lookups;  // 表で引いた回数
+};
+
+void glyphIndexGetStats(GlyphIndexStats *stats);
+
+// fontの表を、疎なcmapの長さに関わらず作る。表を使えないフォント(キャッシュが無い、カーニングが組の表)ならfalse
+// 表で引いたグリフ番号でビットマップを読むフォント(SDのフォントパック)が、最初に使う前に呼ぶ
+bool glyphIndexAttach(const lv_font_t *font);
+
+// 表でグリフ番号を引く。表の無いフォントとグリフの無い文字は0
+uint32_t glyphIndexGlyphId(const lv_font_t *font, uint32_t letter);
+
+// fontのページ分のテキストを、表を使わない場合と使う場合で並べて1秒あたりの引いた回数を比べる
+// 表の全ての文字でLVGLと同じ結果になるかも確かめる。結果を1行ずつprintに渡す
+// microsは経過時間(us)を返す関数。描画中でない時に呼ぶこと
+void glyphIndexBenchmark(const lv_font_t *font, int64_t (*micros)(), void (*print)(const char *line));
+
+#endif
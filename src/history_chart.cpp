@@ -0,0 +1,234 @@
+#include <string.h>
+#include "history_chart.hpp"
+
+static const int maxColumns = 320;
+
+struct ChartSeries {
+  const SensorHistory *history;
+  lv_chart_series_t *series;
+  lv_chart_axis_t axis;
+  int16_t minSpan;
+  lv_coord_t points[maxColumns * 2];  // 列ごとに最小値、最大値の順
+};
+
+static ChartSeries chartSeries[historyChartMaxSeries];
+static int chartSeriesCount;
+static lv_obj_t *chart;
+static int32_t columnCount;
+static uint32_t samplesPerColumn = 1;
+static int32_t endColumn;          // 右端の列の次の列の番号
+static bool following = true;      // 右端を最新の標本に合わせる
+
+// 前回計算した時の状態
+static bool cacheValid;
+static uint32_t cachedSamplesPerColumn;
+static int32_t cachedEndColumn;
+static uint32_t cachedEnd;
+static uint32_t cachedFirst;
+
+// 左からindex番目の列を計算する
+static void computeColumn(int32_t index) {
+  int32_t column = endColumn - columnCount + index;
+  for (int s = 0; s < chartSeriesCount; s++) {
+    ChartSeries &series = chartSeries[s];
+    int16_t min;
+    int16_t max;
+    if ((column >= 0) && series.history->minMax(column * samplesPerColumn, (column + 1) * samplesPerColumn, &min, &max)) {
+      series.points[index * 2] = min;
+      series.points[index * 2 + 1] = max;
+    } else {
+      series.points[index * 2] = LV_CHART_POINT_NONE;
+      series.points[index * 2 + 1] = LV_CHART_POINT_NONE;
+    }
+  }
+}
+
+// 番号が[from, to)の列のうち見えているものを計算する
+static void computeColumns(int32_t from, int32_t to) {
+  int32_t start = endColumn - columnCount;
+  from = LV_MAX(from, start);
+  to = LV_MIN(to, endColumn);
+  for (int32_t column = from; column < to; column++) {
+    computeColumn(column - start);
+  }
+}
+
+// 計算済みの列をshift列だけ左にずらす(負なら右)
+static void shiftColumns(int32_t shift) {
+  int32_t kept = columnCount - LV_ABS(shift);
+  for (int s = 0; s < chartSeriesCount; s++) {
+    lv_coord_t *points = chartSeries[s].points;
+    if (shift > 0) {
+      memmove(points, points + shift * 2, kept * 2 * sizeof(lv_coord_t));
+    } else {
+      memmove(points - shift * 2, points, kept * 2 * sizeof(lv_coord_t));
+    }
+  }
+}
+
+// 見えている値が収まるようにY軸の範囲を決める
+static void updateRanges() {
+  for (int s = 0; s < chartSeriesCount; s++) {
+    ChartSeries &series = chartSeries[s];
+    lv_coord_t low = LV_COORD_MAX;
+    lv_coord_t high = LV_COORD_MIN;
+    for (int32_t i = 0; i < columnCount * 2; i++) {
+      lv_coord_t value = series.points[i];
+      if (value == LV_CHART_POINT_NONE) {
+        continue;
+      }
+      low = LV_MIN(low, value);
+      high = LV_MAX(high, value);
+    }
+    if (low > high) {
+      low = 0;
+      high = 0;
+    }
+    lv_coord_t span = high - low;
+    if (span < series.minSpan) {
+      low -= (series.minSpan - span) / 2;
+      high = low + series.minSpan;
+    }
+    lv_chart_set_range(chart, series.axis, low, high);
+  }
+}
+
+// 見えている列を更新する。何も変わっていなければfalse
+static bool update() {
+  const SensorHistory *history = chartSeries[0].history;
+  uint32_t end = history->end();
+  uint32_t first = history->first();
+  int32_t latestEndColumn = (end + samplesPerColumn - 1) / samplesPerColumn;
+  int32_t oldestEndColumn = LV_MIN(first / samplesPerColumn + columnCount, latestEndColumn);
+  if (following || (endColumn >= latestEndColumn)) {
+    endColumn = latestEndColumn;
+    following = true;
+  } else if (endColumn < oldestEndColumn) {
+    endColumn = oldestEndColumn;
+  }
+
+  if (!cacheValid || (samplesPerColumn != cachedSamplesPerColumn) || (LV_ABS(endColumn - cachedEndColumn) >= columnCount)) {
+    for (int32_t i = 0; i < columnCount; i++) {
+      computeColumn(i);
+    }
+  } else {
+    int32_t shift = endColumn - cachedEndColumn;
+    if ((shift == 0) && (end == cachedEnd)) {
+      return false;
+    }
+    if (shift != 0) {
+      shiftColumns(shift);
+      if (shift > 0) {
+        computeColumns(endColumn - shift, endColumn);
+      } else {
+        computeColumns(endColumn - columnCount, endColumn - columnCount - shift);
+      }
+    }
+    // 標本が増えた列と、古い標本が消えた列
+    computeColumns(cachedEnd / samplesPerColumn, latestEndColumn);
+    if (first > cachedFirst) {
+      computeColumns(cachedFirst / samplesPerColumn, first / samplesPerColumn + 1);
+    }
+  }
+
+  cacheValid = true;
+  cachedSamplesPerColumn = samplesPerColumn;
+  cachedEndColumn = endColumn;
+  cachedEnd = end;
+  cachedFirst = first;
+
+  updateRanges();
+  lv_chart_refresh(chart);
+  return true;
+}
+
+// グラフが削除されたら(タブやスクリーンの削除を含む)、以後の更新で触らないように忘れる
+static void history_chart_delete_cb(lv_event_t *event) {
+  if (lv_event_get_target(event) != chart) {
+    return;
+  }
+  chart = NULL;
+  chartSeriesCount = 0;
+  cacheValid = false;
+}
+
+static void history_chart_event_cb(lv_event_t *event) {
+  lv_point_t vect;
+  lv_indev_get_vect(lv_indev_get_act(), &vect);
+  if (vect.x != 0) {
+    historyChartPan(vect.x);
+  }
+}
+
+lv_obj_t *historyChartCreate(lv_obj_t *parent, lv_coord_t width, lv_coord_t height, const HistoryChartSeries *series, int seriesCount) {
+  chart = lv_chart_create(parent);
+  lv_obj_set_size(chart, width, height);
+  lv_chart_set_type(chart, LV_CHART_TYPE_LINE);
+  lv_chart_set_div_line_count(chart, 0, 0);
+  lv_obj_set_style_pad_all(chart, 0, 0);
+  lv_obj_set_style_size(chart, 0, LV_PART_INDICATOR);
+  // 横のドラッグはタブの切り替えではなくパンにする
+  lv_obj_clear_flag(chart, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_clear_flag(chart, LV_OBJ_FLAG_SCROLL_CHAIN_HOR);
+  lv_obj_add_event_cb(chart, history_chart_event_cb, LV_EVENT_PRESSING, NULL);
+  lv_obj_add_event_cb(chart, history_chart_delete_cb, LV_EVENT_DELETE, NULL);
+
+  lv_obj_update_layout(chart);
+  columnCount = LV_MIN(lv_obj_get_content_width(chart), maxColumns);
+  lv_chart_set_point_count(chart, columnCount * 2);
+
+  chartSeriesCount = LV_MIN(seriesCount, historyChartMaxSeries);
+  for (int s = 0; s < chartSeriesCount; s++) {
+    ChartSeries &target = chartSeries[s];
+    target.history = series[s].history;
+    target.axis = series[s].axis;
+    target.minSpan = series[s].minSpan;
+    target.series = lv_chart_add_series(chart, series[s].color, series[s].axis);
+    lv_chart_set_ext_y_array(chart, target.series, target.points);
+  }
+
+  following = true;
+  cacheValid = false;
+  update();
+  return chart;
+}
+
+void historyChartRefresh() {
+  if (chart != NULL) {
+    update();
+  }
+}
+
+void historyChartZoom(int zoom) {
+  if (chart == NULL) {
+    return;
+  }
+  // 最も縮小した時に履歴全体が収まる
+  uint32_t maxSamplesPerColumn = 1;
+  while (maxSamplesPerColumn * columnCount < chartSeries[0].history->capacity()) {
+    maxSamplesPerColumn *= 2;
+  }
+  uint32_t next = samplesPerColumn;
+  if ((zoom > 0) && (next > 1)) {
+    next /= 2;
+  } else if ((zoom < 0) && (next < maxSamplesPerColumn)) {
+    next *= 2;
+  }
+  if (next == samplesPerColumn) {
+    return;
+  }
+  // 右端の標本の位置を保つ
+  uint32_t endSample = endColumn * samplesPerColumn;
+  samplesPerColumn = next;
+  endColumn = (endSample + samplesPerColumn - 1) / samplesPerColumn;
+  update();
+}
+
+void historyChartPan(int32_t columns) {
+  if (chart == NULL) {
+    return;
+  }
+  endColumn -= columns;
+  following = false;
+  update();
+}
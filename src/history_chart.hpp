@@ -0,0 +1,34 @@
+#ifndef HISTORY_CHART_HPP
+#define HISTORY_CHART_HPP
+
+#include <lvgl.h>
+#include "sensor_history.hpp"
+
+// センサの履歴のグラフ
+//
+// 横1画素を1列とし、列に入る標本の最小値と最大値を縦線で結んで描く(min/max decimation)
+// 点の数は列の数の2倍で固定なので、描画の手間は履歴の長さによらない
+// 列は標本の番号を1列の標本数で割った位置に固定する。標本の追加やパンで列がずれた時は
+// 計算済みの列をずらして使い、新しく見えた列と標本が増減した列だけを計算し直す
+// 拡大、縮小では全ての列を計算し直すが、SensorHistory::minMaxを使うので履歴は走査しない
+
+static const int historyChartMaxSeries = 2;
+
+struct HistoryChartSeries {
+  const SensorHistory *history;  // 全ての系列は同じ周期で同時に記録すること
+  lv_color_t color;
+  lv_chart_axis_t axis;
+  int16_t minSpan;               // Y軸の範囲の最小の幅
+};
+
+// グラフを作る。列の数はグラフの内側の幅(画素)。右端は最新の標本
+// 同時に作れるのは1つだけ。削除されると以後の更新、拡大、パンは何もしない
+lv_obj_t *historyChartCreate(lv_obj_t *parent, lv_coord_t width, lv_coord_t height, const HistoryChartSeries *series, int seriesCount);
+// 追加された標本を反映する。変化が無ければ何もしない
+void historyChartRefresh();
+// 正なら拡大(1列の標本数を半分にする)、負なら縮小する
+void historyChartZoom(int zoom);
+// 列単位で動かす。正なら古い方へ。最新の標本まで戻すと、以後は新しい標本に合わせて動く
+void historyChartPan(int32_t columns);
+
+#endif
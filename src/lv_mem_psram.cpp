@@ -0,0 +1,533 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <lvgl.h>
+#include "lv_mem_psram.h"
+
+#if LV_MEM_CUSTOM
+
+#ifndef UI_SIMULATOR
+#include <esp_heap_caps.h>
+#endif
+
+//
+// TLSF
+// 空きブロックを大きさの2のべき(第1レベル)と、それを16等分した範囲(第2レベル)で分類したリストに入れる
+// 確保する大きさ以上が入っているリストをビットマップで探すので、確保も解放も空きブロックの数によらず一定時間で終わる
+//
+
+struct Block {
+  Block *prevPhys;  // アドレスが直前のブロック。先頭のブロックはNULL
+  size_t size;      // データ部分の大きさ。下位2ビットはフラグ
+  Block *nextFree;  // 以下は空きブロックの場合だけ使う。データ部分に重なる
+  Block *prevFree;
+};
+
+static const size_t freeBit = 1;
+static const size_t slotBit = 2;  // サイズクラスのスロットの印。データの直前のワードがBlock::sizeではなくスロットのタグ
+
+static const size_t alignSize = sizeof(void *);
+static const int alignShift = (sizeof(void *) == 8) ? 3 : 2;
+static const size_t blockOverhead = offsetof(Block, nextFree);
+static const size_t minBlockSize = sizeof(Block) - offsetof(Block, nextFree);
+
+static const int slShift = 4;
+static const int slCount = 1 << slShift;
+static const int flShift = slShift + alignShift;
+static const size_t smallBlockSize = (size_t)1 << flShift;  // これより小さいブロックは第1レベル0に入れる
+static const int flMax = 24;                                // 16MBまで
+static const int flCount = flMax - flShift + 1;
+
+static Block *freeLists[flCount][slCount];
+static uint32_t flBitmap = 0;
+static uint32_t slBitmaps[flCount];
+
+static char *poolStart = NULL;
+static char *poolEnd = NULL;
+static Block *firstBlock = NULL;
+static bool initialized = false;
+
+// プールが足りない時に呼び、キャッシュなどを解放してもらう
+static lv_mem_psram_pressure_cb_t pressureCb = NULL;
+static bool relieving = false;
+
+// 0以外の間は描画中でもプールから確保する(キャッシュに持ち続けるもの)
+static int poolOnlyDepth = 0;
+
+// 統計
+static size_t poolUsed = 0;
+static size_t poolMaxUsed = 0;
+static uint32_t usedCount = 0;
+static uint32_t outsideCount = 0;
+static uint32_t fallbackCount = 0;
+
+//
+// サイズクラス
+// LVGLのオブジェクトやスタイル、イベントの配列のような小さな確保は、1KBのページを同じ大きさのスロットに分けて使う
+// ページはプールに返さず、解放されたスロットは同じクラスで再利用する
+//
+static const uint16_t classSizes[] = {8, 16, 24, 32, 48, 64, 96, 128};
+static const int classCount = sizeof(classSizes) / sizeof(classSizes[0]);
+static const size_t classPageSize = 1024;
+
+struct SizeClass {
+  void *freeSlots;  // 空きスロットの先頭。スロットのデータ部分に次の空きスロットを書く
+  uint32_t pages;
+  uint32_t freeCount;
+};
+
+static SizeClass sizeClasses[classCount];
+
+static int highestBit(size_t size) {
+  return (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl((unsigned long)size);
+}
+
+static int lowestBit(uint32_t bits) {
+  return __builtin_ctz(bits);
+}
+
+static size_t blockSize(const Block *block) {
+  return block->size & ~(freeBit | slotBit);
+}
+
+static bool isFree(const Block *block) {
+  return (block->size & freeBit) != 0;
+}
+
+static void *blockData(Block *block) {
+  return (char *)block + blockOverhead;
+}
+
+static Block *dataBlock(void *ptr) {
+  return (Block *)((char *)ptr - blockOverhead);
+}
+
+static Block *nextPhys(Block *block) {
+  return (Block *)((char *)blockData(block) + blockSize(block));
+}
+
+static size_t adjustSize(size_t size) {
+  size = (size + alignSize - 1) & ~(alignSize - 1);
+  return (size < minBlockSize) ? minBlockSize : size;
+}
+
+static void mapping(size_t size, int *fl, int *sl) {
+  if (size < smallBlockSize) {
+    *fl = 0;
+    *sl = (int)(size / (smallBlockSize / slCount));
+  } else {
+    int bit = highestBit(size);
+    *sl = (int)(size >> (bit - slShift)) ^ slCount;
+    *fl = bit - (flShift - 1);
+  }
+}
+
+static void insertFree(Block *block) {
+  int fl;
+  int sl;
+  mapping(blockSize(block), &fl, &sl);
+  Block *head = freeLists[fl][sl];
+  block->prevFree = NULL;
+  block->nextFree = head;
+  if (head != NULL) {
+    head->prevFree = block;
+  }
+  freeLists[fl][sl] = block;
+  flBitmap |= 1U << fl;
+  slBitmaps[fl] |= 1U << sl;
+  block->size |= freeBit;
+}
+
+static void removeFree(Block *block) {
+  int fl;
+  int sl;
+  mapping(blockSize(block), &fl, &sl);
+  if (block->prevFree != NULL) {
+    block->prevFree->nextFree = block->nextFree;
+  } else {
+    freeLists[fl][sl] = block->nextFree;
+    if (block->nextFree == NULL) {
+      slBitmaps[fl] &= ~(1U << sl);
+      if (slBitmaps[fl] == 0) {
+        flBitmap &= ~(1U << fl);
+      }
+    }
+  }
+  if (block->nextFree != NULL) {
+    block->nextFree->prevFree = block->prevFree;
+  }
+  block->size &= ~freeBit;
+}
+
+// size以上の空きブロックを探す。リストの範囲の下限で選ぶので、見つかったブロックは必ずsize以上
+static Block *findFree(size_t size) {
+  if (size >= smallBlockSize) {
+    size += ((size_t)1 << (highestBit(size) - slShift)) - 1;
+  }
+  int fl;
+  int sl;
+  mapping(size, &fl, &sl);
+  if (fl >= flCount) {
+    return NULL;
+  }
+
+  uint32_t slMap = slBitmaps[fl] & (~0U << sl);
+  if (slMap == 0) {
+    uint32_t flMap = (fl + 1 < 32) ? (flBitmap & (~0U << (fl + 1))) : 0;
+    if (flMap == 0) {
+      return NULL;
+    }
+    fl = lowestBit(flMap);
+    slMap = slBitmaps[fl];
+  }
+  return freeLists[fl][lowestBit(slMap)];
+}
+
+// 使用中のブロックを前後の空きブロックとまとめて空きリストに入れる
+static void releaseBlock(Block *block) {
+  Block *prev = block->prevPhys;
+  if ((prev != NULL) && isFree(prev)) {
+    removeFree(prev);
+    prev->size = blockSize(prev) + blockOverhead + blockSize(block);
+    block = prev;
+    nextPhys(block)->prevPhys = block;
+  }
+  Block *next = nextPhys(block);
+  if (isFree(next)) {
+    removeFree(next);
+    block->size = blockSize(block) + blockOverhead + blockSize(next);
+    nextPhys(block)->prevPhys = block;
+  }
+  insertFree(block);
+}
+
+// 使用中のブロックをsizeに縮め、余りが十分あれば空きブロックにする
+static void trimBlock(Block *block, size_t size) {
+  if (blockSize(block) < size + blockOverhead + minBlockSize) {
+    return;
+  }
+  Block *rest = (Block *)((char *)blockData(block) + size);
+  rest->size = blockSize(block) - size - blockOverhead;
+  rest->prevPhys = block;
+  block->size = size;
+  nextPhys(rest)->prevPhys = rest;
+  releaseBlock(rest);
+}
+
+static void addPoolUsed(size_t size) {
+  poolUsed += size;
+  if (poolUsed > poolMaxUsed) {
+    poolMaxUsed = poolUsed;
+  }
+}
+
+static void *poolAlloc(size_t size) {
+  size_t adjusted = adjustSize(size);
+  Block *block = findFree(adjusted);
+  if (block == NULL) {
+    return NULL;
+  }
+  removeFree(block);
+  trimBlock(block, adjusted);
+  addPoolUsed(blockSize(block) + blockOverhead);
+  return blockData(block);
+}
+
+static void poolFree(void *ptr) {
+  Block *block = dataBlock(ptr);
+  poolUsed -= blockSize(block) + blockOverhead;
+  releaseBlock(block);
+}
+
+// 後ろの空きブロックを使って広げるか、その場で縮める。できなければfalse
+static bool poolResize(void *ptr, size_t size) {
+  Block *block = dataBlock(ptr);
+  size_t adjusted = adjustSize(size);
+  size_t oldSize = blockSize(block);
+  if (adjusted > oldSize) {
+    Block *next = nextPhys(block);
+    if (!isFree(next) || (oldSize + blockOverhead + blockSize(next) < adjusted)) {
+      return false;
+    }
+    removeFree(next);
+    block->size = oldSize + blockOverhead + blockSize(next);
+    nextPhys(block)->prevPhys = block;
+  }
+  trimBlock(block, adjusted);
+  poolUsed -= oldSize;
+  addPoolUsed(blockSize(block));
+  return true;
+}
+
+static int sizeClassIndex(size_t size) {
+  for (int i = 0; i < classCount; i++) {
+    if (size <= classSizes[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// スロットはタグ(size_t)とデータ部分。タグの下位ビットがslotBitなのでBlock::sizeと区別できる
+static size_t slotStride(int index) {
+  return sizeof(size_t) + classSizes[index];
+}
+
+static void *slotAlloc(int index) {
+  SizeClass &sizeClass = sizeClasses[index];
+  if (sizeClass.freeSlots == NULL) {
+    char *page = (char *)poolAlloc(classPageSize);
+    if (page == NULL) {
+      return NULL;
+    }
+    sizeClass.pages++;
+    size_t stride = slotStride(index);
+    for (size_t offset = 0; offset + stride <= classPageSize; offset += stride) {
+      *(size_t *)(page + offset) = ((size_t)index << 2) | slotBit;
+      void *slot = page + offset + sizeof(size_t);
+      *(void **)slot = sizeClass.freeSlots;
+      sizeClass.freeSlots = slot;
+      sizeClass.freeCount++;
+    }
+  }
+  void *slot = sizeClass.freeSlots;
+  sizeClass.freeSlots = *(void **)slot;
+  sizeClass.freeCount--;
+  return slot;
+}
+
+static void slotFree(void *ptr, int index) {
+  SizeClass &sizeClass = sizeClasses[index];
+  *(void **)ptr = sizeClass.freeSlots;
+  sizeClass.freeSlots = ptr;
+  sizeClass.freeCount++;
+}
+
+static bool isSlot(void *ptr) {
+  return (((size_t *)ptr)[-1] & slotBit) != 0;
+}
+
+static int slotClass(void *ptr) {
+  return (int)(((size_t *)ptr)[-1] >> 2);
+}
+
+static bool inPool(void *ptr) {
+  return ((char *)ptr >= poolStart) && ((char *)ptr < poolEnd);
+}
+
+#ifdef UI_SIMULATOR
+static void *poolMemory(size_t size) {
+  return malloc(size);
+}
+
+static void *internalAlloc(size_t size) {
+  return malloc(size);
+}
+#else
+static void *poolMemory(size_t size) {
+  return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+static void *internalAlloc(size_t size) {
+  return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+#endif
+
+static void initPool() {
+  initialized = true;
+
+  // PSRAMが無い場合は確保できる大きさまで小さくする。確保できなければ全て他のヒープから取る
+  size_t size = LV_MEM_PSRAM_SIZE;
+  void *memory = NULL;
+  while ((memory == NULL) && (size >= 16 * 1024)) {
+    memory = poolMemory(size);
+    if (memory == NULL) {
+      size /= 2;
+    }
+  }
+  if (memory == NULL) {
+    return;
+  }
+
+  poolStart = (char *)memory;
+  poolEnd = poolStart + (size & ~(alignSize - 1));
+
+  // 全体を1つの空きブロックにし、最後に使用中の番兵を置いて後ろとの結合を止める
+  firstBlock = (Block *)poolStart;
+  firstBlock->prevPhys = NULL;
+  firstBlock->size = (poolEnd - poolStart) - 2 * blockOverhead;
+  Block *sentinel = nextPhys(firstBlock);
+  sentinel->prevPhys = firstBlock;
+  sentinel->size = 0;
+  insertFree(firstBlock);
+}
+
+// 描画中か。描画中の確保は描画が終わると解放されるものが多く、速さが必要なので内部RAMに置く
+static bool drawing() {
+  if (poolOnlyDepth > 0) {
+    return false;
+  }
+  lv_disp_t *disp = lv_disp_get_default();
+  return (disp != NULL) && disp->rendering_in_progress;
+}
+
+extern "C" void *lv_mem_psram_alloc(size_t size) {
+  if (!initialized) {
+    initPool();
+  }
+
+  void *ptr = NULL;
+  bool outside = false;
+  if (drawing()) {
+    ptr = internalAlloc(size);
+    outside = (ptr != NULL);
+  }
+  if ((ptr == NULL) && (poolStart != NULL)) {
+    int index = sizeClassIndex(size);
+    if (index >= 0) {
+      ptr = slotAlloc(index);
+    }
+    if (ptr == NULL) {
+      ptr = poolAlloc(size);
+    }
+    // 解放してもらえたらもう一度プールから取る。解放の中からは呼ばない
+    if ((ptr == NULL) && (pressureCb != NULL) && !relieving) {
+      relieving = true;
+      if (pressureCb(size) > 0) {
+        ptr = poolAlloc(size);
+      }
+      relieving = false;
+    }
+  }
+  if (ptr == NULL) {
+    ptr = malloc(size);
+    outside = (ptr != NULL);
+    fallbackCount++;
+  }
+
+  if (ptr != NULL) {
+    usedCount++;
+    if (outside) {
+      outsideCount++;
+    }
+  }
+  return ptr;
+}
+
+extern "C" void lv_mem_psram_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  usedCount--;
+  if (!inPool(ptr)) {
+    outsideCount--;
+    free(ptr);
+  } else if (isSlot(ptr)) {
+    slotFree(ptr, slotClass(ptr));
+  } else {
+    poolFree(ptr);
+  }
+}
+
+extern "C" void *lv_mem_psram_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return lv_mem_psram_alloc(size);
+  }
+  if (size == 0) {
+    lv_mem_psram_free(ptr);
+    return NULL;
+  }
+  // プールの外のものはそのヒープで広げる
+  if (!inPool(ptr)) {
+    return realloc(ptr, size);
+  }
+
+  size_t oldSize;
+  if (isSlot(ptr)) {
+    oldSize = classSizes[slotClass(ptr)];
+    if (size <= oldSize) {
+      return ptr;
+    }
+  } else {
+    if (poolResize(ptr, size)) {
+      return ptr;
+    }
+    oldSize = blockSize(dataBlock(ptr));
+  }
+
+  void *newPtr = lv_mem_psram_alloc(size);
+  if (newPtr == NULL) {
+    return NULL;
+  }
+  memcpy(newPtr, ptr, (oldSize < size) ? oldSize : size);
+  lv_mem_psram_free(ptr);
+  return newPtr;
+}
+
+extern "C" void lv_mem_psram_set_pressure_cb(lv_mem_psram_pressure_cb_t cb) {
+  pressureCb = cb;
+}
+
+extern "C" void lv_mem_psram_pool_begin(void) {
+  poolOnlyDepth++;
+}
+
+extern "C" void lv_mem_psram_pool_end(void) {
+  poolOnlyDepth--;
+}
+
+extern "C" void lv_mem_psram_get_stats(lv_mem_psram_stats_t *stats) {
+  memset(stats, 0, sizeof(lv_mem_psram_stats_t));
+  if (firstBlock != NULL) {
+    stats->total_size = poolEnd - poolStart;
+    for (Block *block = firstBlock; blockSize(block) > 0; block = nextPhys(block)) {
+      if (isFree(block)) {
+        stats->free_cnt++;
+        stats->free_size += blockSize(block);
+        if (blockSize(block) > stats->free_biggest_size) {
+          stats->free_biggest_size = blockSize(block);
+        }
+      }
+    }
+  }
+  stats->used_size = poolUsed;
+  stats->max_used = poolMaxUsed;
+  stats->used_cnt = usedCount;
+  if (stats->free_size > 0) {
+    stats->frag_pct = 100 - (uint8_t)(stats->free_biggest_size * 100 / stats->free_size);
+  }
+  for (int i = 0; i < classCount; i++) {
+    stats->class_size += sizeClasses[i].pages * classPageSize;
+    stats->class_free += sizeClasses[i].freeCount * classSizes[i];
+  }
+  stats->outside_cnt = outsideCount;
+  stats->fallback_cnt = fallbackCount;
+}
+
+#else
+
+// 内蔵のヒープには足りない時に呼ぶ仕組みが無い
+extern "C" void lv_mem_psram_set_pressure_cb(lv_mem_psram_pressure_cb_t cb) {
+}
+
+extern "C" void lv_mem_psram_pool_begin(void) {
+}
+
+extern "C" void lv_mem_psram_pool_end(void) {
+}
+
+extern "C" void lv_mem_psram_get_stats(lv_mem_psram_stats_t *stats) {
+  lv_mem_monitor_t mon;
+  lv_mem_monitor(&mon);
+  memset(stats, 0, sizeof(lv_mem_psram_stats_t));
+  stats->total_size = mon.total_size;
+  stats->used_size = mon.total_size - mon.free_size;
+  stats->max_used = mon.max_used;
+  stats->free_size = mon.free_size;
+  stats->free_biggest_size = mon.free_biggest_size;
+  stats->used_cnt = mon.used_cnt;
+  stats->free_cnt = mon.free_cnt;
+  stats->frag_pct = mon.frag_pct;
+}
+
+#endif
@@ -42,6 +42,7 @@ static lv_fs_res_t fs_dir_close(lv_fs_drv_t * drv, void * rddir_p);
 /**********************
  *  STATIC VARIABLES
  **********************/
+static void (*before_access)(void) = NULL;
 
 /**********************
  * GLOBAL PROTOTYPES
@@ -86,10 +87,23 @@ void lv_port_fs_sd_init(void)
     lv_fs_drv_register(&fs_drv);
 }
 
+void lv_port_fs_sd_set_before_access(void (*callback)(void))
+{
+    before_access = callback;
+}
+
 /**********************
  *   STATIC FUNCTIONS
  **********************/
 
+/*SPIバスをLCDの転送から解放する*/
+static void release_bus(void)
+{
+    if(before_access != NULL) {
+        before_access();
+    }
+}
+
 /*Initialize your Storage device and File system.*/
 static void fs_init(void)
 {
@@ -110,6 +124,8 @@ static void * fs_open(lv_fs_drv_t * drv, const char * path, lv_fs_mode_t mode)
 {
     //Serial.println("fs_open");
 
+    release_bus();
+
     File f;
 
     if(mode == LV_FS_MODE_WR) {
@@ -137,6 +153,8 @@ static lv_fs_res_t fs_close(lv_fs_drv_t * drv, void * file_p)
 {
     //Serial.println("fs_close");
 
+    release_bus();
+
     File* f_p = (File*)file_p;
 
     f_p->close();
@@ -157,6 +175,8 @@ static lv_fs_res_t fs_read(lv_fs_drv_t * drv, void * file_p, void * buf, uint32_
 {
     //Serial.println("fs_read");
 
+    release_bus();
+
     File* f_p = (File*)file_p;
 
     *br = f_p->read((uint8_t*)buf, btr);
@@ -177,6 +197,8 @@ static lv_fs_res_t fs_write(lv_fs_drv_t * drv, void * file_p, const void * buf,
 {
     //Serial.println("fs_write");
 
+    release_bus();
+
     File* f_p = (File*)file_p;
 
     *bw = f_p->write((uint8_t*)buf, btw);
@@ -196,6 +218,8 @@ static lv_fs_res_t fs_seek(lv_fs_drv_t * drv, void * file_p, uint32_t pos, lv_fs
 {
     //Serial.println("fs_seek");
 
+    release_bus();
+
     File* f_p = (File*)file_p;
 
     if (whence == LV_FS_SEEK_SET) {
@@ -22,6 +22,9 @@
  **********************/
 void lv_port_fs_sd_init(void);
 
+/*SDカードを触る前に呼ぶ関数(LCDとSPIバスを共有するので、転送中のバスを解放する)。NULLなら呼ばない*/
+void lv_port_fs_sd_set_before_access(void (*before_access)(void));
+
 /**********************
  *      MACROS
  **********************/
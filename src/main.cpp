@@ -4,7 +4,6 @@
 #include <M5Core2.h>
 #include <M5UnitENV.h>
 #include <NimBLEDevice.h>
-#include <Preferences.h>
 #include <PubSubClient.h>
 #include <HardwareSerial.h>
 #include <TinyGPSPlus.h>
@@ -12,7 +11,9 @@
 #include <WiFiClientSecure.h>
 #include <lvgl.h>
 #include <lwip/ip.h>
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include <LGFX_AUTODETECT.hpp>
 #include <LovyanGFX.hpp>
@@ -26,6 +27,23 @@
 #include <TinyGSM.h>
 
 #include "sim7080g_client.hpp"
+#include "perf_stats.hpp"
+#include "lv_mem_psram.h"
+#include "disp_fill.hpp"
+#include "blend565.hpp"
+#include "redraw_heatmap.hpp"
+#include "binding.hpp"
+#include "ui.hpp"
+#include "settings.hpp"
+#include "device_list.hpp"
+#include "sensor_history.hpp"
+#include "touch_input.hpp"
+#include "touch_latency.hpp"
+#include "wifi_scan.hpp"
+#include "cache_budget.hpp"
+#include "glyph_index.hpp"
+#include "glyph_cache.hpp"
+#include "font_pack.hpp"
 
 #define JST 3600 * 9
 
@@ -33,29 +51,39 @@ static const char * TAG = "main";
 
 HardwareSerial portASerial(2);
 
-// Preference
-Preferences preferences;
-
 // SystemBar
 static const char *systemBarFormat = "%s %s %s %d%%";
-char systemBarText[16];
+char systemBarText[24];  // LV_SYMBOL_*は3バイト
 
 // Status
-static const char *booting = "Booting...";
 static const char *stopped = "Stopped...";
 static const char *running = "Running...";
 
-char dashboardTempratureBuffer[16];
-char dashboardHumidityBuffer[16];
+// 画面に表示する値。loop()で毎回setし、変わった時だけラベルを更新する
+Cell<bool> gpsReadyCell;
+Cell<bool> gsmReadyCell;
+Cell<bool> wifiConnectedCell;
+Cell<int> batteryLevelCell;
+Cell<bool> linkRunningCell;
+Cell<int> temperatureCell;  // 0.1°C単位
+Cell<int> humidityCell;     // 0.1%単位
+
+// 温度と湿度の履歴(ui.cppのホームタブのグラフが参照する)。0.1単位でhistoryPeriodごとに記録する
+#ifndef SENSOR_HISTORY_DAYS
+#define SENSOR_HISTORY_DAYS 3
+#endif
+static const uint32_t historyPeriod = 10 * 1000;
+static const uint32_t historyCapacity = SENSOR_HISTORY_DAYS * 24 * 60 * 60 * 1000UL / historyPeriod;
+SensorHistory temperatureHistory(historyCapacity);
+SensorHistory humidityHistory(historyCapacity);
+static uint32_t lastHistoryMillis;
 
 // WiFi
-static const char *ssidKey = "ssid";
-static const char *passKey = "pass";
 static const int macAddressLength = 12;
 
-char ssid[33] = {0};
-char pass[65] = {0};
-String ssids = "";
+// スキャンの結果を入れるドロップダウン。スキャンが終わるか、ドロップダウンが削除されたらNULL
+static lv_obj_t *ssidDropdown = NULL;
+static bool ssidDropdownCleared = false;  // 最初の結果が来るまでは今のSSIDを表示しておく
 
 static const IPAddress googleDNS(8, 8, 8, 8);
 static const IPAddress googleDNS2(8, 8, 4, 4);
@@ -66,19 +94,6 @@ WiFiClientSecure wifiClientSecure = WiFiClientSecure();
 bool wifiReady = false;
 
 // Mobile
-static const char *gsmPortKey = "apnPort";
-static const char *apnKey = "apn";
-static const char *apnUserKey = "apnUser";
-static const char *apnPassKey = "apnPass";
-
-static const int gsmPortNone = 0;
-static const int gsmPortA = 1;
-
-int gsmPort = gsmPortNone;
-char apn[32] = {0};
-char apnUser[32] = {0};
-char apnPass[32] = {0};
-
 static const char *modemRootCaFileName = "rootCa.pem";
 static const char *modemCertFileName = "cert.pem";
 static const char *modemPrivateKeyFileName = "key.pem";
@@ -118,20 +133,10 @@ bool gsmReady = false;
 bool gsmGPSReady = false;
 
 // MQTT
-static const char *urlKey = "url";
-static const char *portKey = "port";
-static const char *clientIdKey = "clientId";
-static const char *tlsKey = "tls";
-static const char *topicKey = "topic";
-
-char url[64];
-int port = 0;
-bool tls;
-
-char clientId[32];
-char topic[32];
 static const char *notificationTopic = "notify";
-char message[1024];
+static const char *perfCommand = "perf";
+static const char *perfTopicSuffix = "/perf";
+char message[1536];  // ビーコンのJSON。計測値のJSONはこれより大きいので使わない
 JsonDocument messageJson;
 static const int sourceTypeBeacon = 0;
 static const int sourceTypeTimer = 1;
@@ -140,27 +145,17 @@ int retry = 0;
 PubSubClient mqttClient = PubSubClient(wifiClientSecure);
 
 // Cert
-static const char *rootCAKey = "rootCA";
-static const char *certKey = "cert";
-static const char *keyKey = "key";
-
-char *rootCA;
-char *cert;
-char *key;
+String files = "";
 
 // NTP
-static const char *ntpKey = "ntp";
 static const char *nictNTP = "ntp.nict.jp";
 static const char *mfeedNTP = "ntp.jst.mfeed.ad.jp";
+static const char *ntpServerList[] = {nictNTP, mfeedNTP};  // settings.cppの選択肢と同じ順番
 
 // BLE
-static const char *scanEnableKey = "scanEnable";
-static const char *activeScanKey = "activeScan";
-static const char *rssiThresholdKey = "rssiThreshold";
 static const int bluetoothAddressLength = macAddressLength;
 static const int advertisingPayloadLength = 31 * 2;
 static const int scanResponsePayloadLength = advertisingPayloadLength;
-bool scanEnable = true;
 
 struct Beacon {
   int source;
@@ -170,15 +165,37 @@ struct Beacon {
   long timestamp;
 };
 QueueHandle_t queue;
+
+// 周辺のデバイスの一覧(ui.cppのデバイスタブが参照する)
+// 受信はBLEのタスクでsightingQueueに入れ、loopでGUIのロックを取ってまとめて一覧に反映する
+#ifndef DEVICE_LIST_CAPACITY
+#define DEVICE_LIST_CAPACITY 2048
+#endif
+static const int sightingQueueLength = 64;
+static const uint32_t deviceMaxAge = 5 * 60 * 1000;  // 5分受信しなければ一覧から消す
+
+struct Sighting {
+  uint8_t address[bluetoothAddressBytes];
+  int8_t rssi;
+};
+QueueHandle_t sightingQueue;
+DeviceList deviceList(DEVICE_LIST_CAPACITY);
+
+// 内部RAMのヒープの空きがこれより少ない間は描画のキャッシュを持たない(PSRAMは数えない)
+static const size_t lowMemoryBytes = 64 * 1024;
+static bool lowMemory = false;
+
+// グリフ番号の表のベンチマークに使うフォント(例: -DGLYPH_INDEX_BENCH_FONT=mplus1_regular_14)
+#ifdef GLYPH_INDEX_BENCH_FONT
+LV_FONT_DECLARE(GLYPH_INDEX_BENCH_FONT)
+#endif
+
 NimBLEScan *bleScan;
 static const int scanTime = 3;
 static const int scanInterval = scanTime * 1000;
 static const int scanWindow = scanInterval - 100;
-bool activeScan = false;
-int rssiThreshold = -100;
 
 // Port
-static const char *supportedUnits = "None\nGPS\nENV IV Unit";
 static const int none = 0;
 static const int gpsUnit = 1;
 static const int env4Unit = 2;
@@ -199,107 +216,382 @@ struct Port {
 };
 
 // Port A
-static const char *portAKey = "portA";
 Port portA;
 
 // Timer
-static const char *timerIntervalKey = "timerInterval";
-static const char *timerIntervals ="None\n10 min\n30 min\n60 min";
-
 static const uint64_t sec = 1000000;
 static const uint64_t timerIntervalNone = 0;
 static const uint64_t timerInterval10min = 10 * 60 * sec;
 static const uint64_t timerInterval30min = 30 * 60 * sec;
 static const uint64_t timerInterval60min = 60 * 60 * sec;
+// タイマー間隔のドロップダウンの並び順
+static const uint64_t timerIntervalList[] = {timerIntervalNone, timerInterval10min, timerInterval30min, timerInterval60min};  // settings.cppの選択肢と同じ順番
+static const int timerIntervalCount = sizeof(timerIntervalList) / sizeof(timerIntervalList[0]);
 
 uint64_t timerInterval = timerInterval10min;
 hw_timer_t* timer;
 
 // LVGL
+// 描画モード
+#define DISP_MODE_BAND 0      // 単一バッファ、同期転送
+#define DISP_MODE_BAND_DMA 1  // ダブルバッファ、DMA転送中に次のバンドを描画する
+#define DISP_MODE_DIRECT 2    // PSRAM上のフレームバッファ(direct_mode)、変更領域のみ転送する
+#ifndef DISP_MODE
+#define DISP_MODE DISP_MODE_BAND_DMA
+#endif
+// 単色で塗りつぶされた行をlcd.fillRectで送る(disp_fill.hpp)。描画バッファが残るDIRECTモードでは使えない
+#ifndef DISP_SOLID_FILL
+#define DISP_SOLID_FILL (DISP_MODE != DISP_MODE_DIRECT)
+#endif
+#if DISP_SOLID_FILL && (DISP_MODE == DISP_MODE_DIRECT)
+#error "DISP_SOLID_FILL requires a band mode"
+#endif
+// 再描画のヒートマップ(redraw_heatmap.hpp)を使う場合はbuild_flagsに-DUI_DEBUG_HEATMAPを追加する
+
 static const uint16_t screenWidth = 320;
 static const uint16_t screenHeight = 240;
-static const uint16_t tabWidth = 50;
-static const uint16_t padding = 10;
-
-static const char *wifiText = "WiFi";
-static const char *ssidText = "SSID";
-static const char *passText = "PASS";
-static const char *gsmText = "Mobile";
-static const char *apnText = "APN";
-static const char *userText = "USER";
-static const char *mqttText = "MQTT";
-static const char *urlText = "URL";
-static const char *portText = "PORT";
-static const char *tlsText = "TLS";
-static const char *clientIdText = "ID";
-static const char *topicText = "TOPIC";
-static const char *certText = "Cert";
-static const char *rootCAText = "Root";
-static const char *keyText = "Key";
-static const char *ntpText = "NTP";
-static const char *bluetoothText = "Bluetooth";
-static const char *scanText = "Scan";
-static const char *activeScanText = "Active";
-static const char *rssiText = "RSSI";
-static const char *sensorsText = "Sensors";
-static const char *timerText = "Timer";
-static const char *portAText = "Port A";
-static const char *unitText = "Type";
-static const char *gpsText = "GPS";
-static const char *enableText = "Enable";
-static const char *saveText = "Save";
-static const char *okText = "OK";
-static const char *cancelText = "Cancel";
-
+// DMAモードのバンドの高さ(行数)。内部RAM使用量は screenWidth * bandHeight * 2 * 2 bytes
+static const uint16_t bandHeight = 20;
+// DIRECTモードで1回のリフレッシュに保持する変更領域の数
+static const int maxDirtyAreas = 16;
+// 矩形を結合してもよい余分な画素数。1回のアドレス設定のコストに相当する
+static const uint32_t dirtyAreaMergeSlack = 256;
+// 転送量をログに出力する間隔
+static const uint32_t flushStatsInterval = 10000;
+
+// GUIタスク
+// Arduinoのloop()はコア1で動くので、LVGLはもう一方のコアで動かす
+static const BaseType_t guiTaskCore = 0;
+static const UBaseType_t guiTaskPriority = 1;
+static const uint32_t guiTaskStackSize = 8192;
+// LVGLのタイマーが無い場合でもこの時間で一度起きる
+static const uint32_t guiTaskMaxSleep = 500;
+
+// loop()の周期。ビーコンが届いた場合はすぐに起きる
+static const uint32_t loopPeriod = 20;
 static lv_disp_draw_buf_t draw_buf;
+#if DISP_MODE == DISP_MODE_BAND_DMA
+static lv_color_t *buf1;
+static lv_color_t *buf2;
+static lv_disp_drv_t *flushingDisp = NULL;
+static uint32_t flushingPixels = 0;
+static bool flushingLast = false;  // 転送中の領域がリフレッシュの最後のものか
+#elif DISP_MODE == DISP_MODE_DIRECT
+static lv_color_t *frameBuffer;
+static lv_area_t dirtyAreas[maxDirtyAreas];
+static int dirtyAreaCount = 0;
+#endif
+// BANDモードの描画バッファ。他のモードでバッファを確保できなかった時もこれを使い、BANDモードとして動く
 static lv_color_t buf[screenWidth * 3];
+static bool dispFallback = false;
 static LGFX lcd;
 
-static lv_obj_t *rootScreen;
-static lv_obj_t *systemBar;
-static lv_obj_t *connectionStatus;
-static lv_obj_t *dashboardTempertature;
-static lv_obj_t *dashboardHumidity;
-static lv_obj_t *keyboard;
-lv_obj_t *messageBox;
+#if LV_COLOR_16_SWAP
+// LVGLがパネルと同じバイト順のRGB565で描画するので、変換せずにそのまま転送する
+typedef lgfx::swap565_t disp_pixel_t;
+static const bool dispPixelSwap = false;
+static const uint8_t dispColorDepth = 16;
+#else
+// 転送時にCPUでバイト順の入れ替えと24bitへの変換を行う
+typedef lgfx::rgb565_t disp_pixel_t;
+static const bool dispPixelSwap = true;
+static const uint8_t dispColorDepth = 24;
+#endif
+
+// 転送の計測
+static int64_t flushStartMicros = 0;
+static uint32_t flushStatsPixels = 0;
+static uint32_t flushStatsFillPixels = 0;  // うちfillRectで送った画素数
+static int64_t flushStatsMicros = 0;
+static uint32_t flushStatsLastLog = 0;
+
+// 描画の計測
+PerfStats perfStats;
+static int64_t refreshStartMicros = 0;
+static int64_t refreshBlockedMicros = 0;  // リフレッシュ中に転送を待っていた時間
+static int64_t waitStartMicros = 0;
+static uint32_t refreshPixels = 0;
+static uint32_t refreshAreas = 0;
+static bool refreshed = false;
+static int64_t firstFrameMillis = 0;  // 起動から最初のリフレッシュが終わるまでの時間
+bool perfDumpRequested = false;
+
+static SemaphoreHandle_t guiMutex;
+static TaskHandle_t guiTaskHandle;
+
+static void disp_flush_stats_begin() {
+  flushStartMicros = esp_timer_get_time();
+}
 
-static void disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) {
+// 転送した画素数と経過時間を積算し、一定間隔で通信量と1画素あたりの時間を出力する
+// 経過時間は転送の開始から完了を確認するまで。BAND_DMAでは確認が次のバンドの描画の後になることがあり、実際の転送時間より長い
+static void disp_flush_stats_end(uint32_t pixels) {
+  int64_t elapsed = esp_timer_get_time() - flushStartMicros;
+  flushStatsPixels += pixels;
+  flushStatsMicros += elapsed;
+  perfStats.flushReadyMicros.add(elapsed);
+  if ((DISP_MODE != DISP_MODE_BAND_DMA) || dispFallback) {
+    // 同期転送の間は描画が止まっている
+    refreshBlockedMicros += elapsed;
+  }
+
+  if (millis() - flushStatsLastLog >= flushStatsInterval) {
+    if (flushStatsPixels > 0) {
+      ESP_LOGI(TAG, "flush : %u px (%u filled)  %u bytes on wire  %.3f us/px", flushStatsPixels, flushStatsFillPixels, flushStatsPixels * (dispColorDepth / 8), (double)flushStatsMicros / flushStatsPixels);
+    }
+    flushStatsPixels = 0;
+    flushStatsFillPixels = 0;
+    flushStatsMicros = 0;
+    flushStatsLastLog = millis();
+  }
+}
+
+#if DISP_MODE == DISP_MODE_DIRECT
+// 変更領域を記録する。結合した方が転送量とアドレス設定の合計が少なければ結合する
+static void disp_add_dirty_area(const lv_area_t *area) {
+  lv_area_t merged = *area;
+  int i = 0;
+  while (i < dirtyAreaCount) {
+    lv_area_t joined;
+    _lv_area_join(&joined, &merged, &dirtyAreas[i]);
+    if (lv_area_get_size(&joined) <= lv_area_get_size(&merged) + lv_area_get_size(&dirtyAreas[i]) + dirtyAreaMergeSlack) {
+      // 結合した矩形はさらに他の矩形と結合できる可能性があるので最初から調べ直す
+      merged = joined;
+      dirtyAreas[i] = dirtyAreas[--dirtyAreaCount];
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+
+  if (dirtyAreaCount < maxDirtyAreas) {
+    dirtyAreas[dirtyAreaCount++] = merged;
+  } else {
+    _lv_area_join(&dirtyAreas[maxDirtyAreas - 1], &dirtyAreas[maxDirtyAreas - 1], &merged);
+  }
+}
+
+// 記録した変更領域をフレームバッファから転送する
+static void disp_push_dirty_areas() {
+  uint32_t pixels = 0;
+  disp_flush_stats_begin();
+  lcd.startWrite();
+  for (int i = 0; i < dirtyAreaCount; i++) {
+    const lv_area_t *area = &dirtyAreas[i];
+    int32_t width = lv_area_get_width(area);
+    int32_t height = lv_area_get_height(area);
+    lv_color_t *src = &frameBuffer[area->y1 * screenWidth + area->x1];
+    lcd.setAddrWindow(area->x1, area->y1, width, height);
+    if (width == screenWidth) {
+      // 全幅の領域はフレームバッファ上で連続しているので一度に送る
+      lcd.pushPixels((uint16_t *)src, width * height, dispPixelSwap);
+    } else {
+      for (int32_t y = 0; y < height; y++) {
+        lcd.pushPixels((uint16_t *)&src[y * screenWidth], width, dispPixelSwap);
+      }
+    }
+    pixels += width * height;
+  }
+  lcd.endWrite();
+  disp_flush_stats_end(pixels);
+  refreshPixels += pixels;
+  refreshAreas += dirtyAreaCount;
+  dirtyAreaCount = 0;
+}
+#endif
+
+#if DISP_SOLID_FILL
+// 単色で塗りつぶされた行はfillRectで、それ以外の行は描画バッファから送る
+// パネル(ILI9342)に塗りつぶしコマンドは無いので通信量は変わらないが、描画バッファへの書き込みとDMAの準備が不要になる
+static void disp_push_rows(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) {
+  int32_t width = area->x2 - area->x1 + 1;
+  lv_coord_t y = area->y1;
+  while (y <= area->y2) {
+    bool fill;
+    lv_color_t color;
+    int rows = dispFillTakeRows(disp, area, y, &fill, &color);
+    lv_color_t *src = &color_p[(y - area->y1) * width];
+    if (fill) {
+      lcd.fillRect(area->x1, y, width, rows, *(disp_pixel_t *)&color);
+      flushStatsFillPixels += width * rows;
+#if DISP_MODE == DISP_MODE_BAND_DMA
+    } else if (!dispFallback) {
+      lcd.pushImageDMA(area->x1, y, width, rows, (disp_pixel_t *)&src->full);
+#endif
+    } else {
+      lcd.setAddrWindow(area->x1, y, width, rows);
+      lcd.pushPixels((uint16_t *)src, width * rows, dispPixelSwap);
+    }
+    y += rows;
+  }
+}
+#endif
+
+// 描画バッファの領域を同期転送する(BANDモードと、バッファを確保できなかった時)
+static void disp_flush_band(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) {
   int32_t width = area->x2 - area->x1 + 1;
   int32_t height = area->y2 - area->y1 + 1;
+  disp_flush_stats_begin();
+#if DISP_SOLID_FILL
+  disp_push_rows(disp, area, color_p);
+#else
   lcd.setAddrWindow(area->x1, area->y1, width, height);
-  lcd.pushPixels((uint16_t *)color_p, width * height, true);
+  lcd.pushPixels((uint16_t *)color_p, width * height, dispPixelSwap);
+#endif
+  disp_flush_stats_end(width * height);
+  touchLatencyFlushed(lv_disp_flush_is_last(disp), esp_timer_get_time());
+  refreshPixels += width * height;
+  refreshAreas++;
 
   lv_disp_flush_ready(disp);
 }
 
-static void touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data) {
-  if (M5.Touch.ispressed()) {
-    data->point.x = M5.Touch.getPressPoint().x;
-    data->point.y = M5.Touch.getPressPoint().y;
-    data->state = LV_INDEV_STATE_PRESSED;
-  } else {
-    data->state = LV_INDEV_STATE_RELEASED;
+static void disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) {
+  int32_t width = area->x2 - area->x1 + 1;
+  int32_t height = area->y2 - area->y1 + 1;
+#ifdef UI_DEBUG_HEATMAP
+  redrawHeatmapAddRedraw(area);
+#endif
+  if (dispFallback) {
+    disp_flush_band(disp, area, color_p);
+    return;
+  }
+#if DISP_MODE == DISP_MODE_DIRECT
+  // color_pはフレームバッファの先頭を指す。最後の領域の描画後にまとめて転送する
+  disp_add_dirty_area(area);
+  if (lv_disp_flush_is_last(disp)) {
+    disp_push_dirty_areas();
+    touchLatencyFlushed(true, esp_timer_get_time());
+  }
+  lv_disp_flush_ready(disp);
+#elif DISP_MODE == DISP_MODE_BAND_DMA
+  // DMA転送を開始して戻る。完了はdisp_flush_completeで通知する
+  disp_flush_stats_begin();
+  flushingPixels = width * height;
+  flushingLast = lv_disp_flush_is_last(disp);
+  refreshPixels += width * height;
+  refreshAreas++;
+  lcd.startWrite();
+#if DISP_SOLID_FILL
+  disp_push_rows(disp, area, color_p);
+#else
+  lcd.pushImageDMA(area->x1, area->y1, width, height, (disp_pixel_t *)&color_p->full);
+#endif
+  flushingDisp = disp;
+#else
+  disp_flush_band(disp, area, color_p);
+#endif
+}
+
+#if DISP_MODE == DISP_MODE_BAND_DMA
+// DMA転送が終わっていればバスを解放してLVGLに通知する
+static void disp_flush_complete() {
+  if (flushingDisp != NULL && !lcd.dmaBusy()) {
+    lv_disp_drv_t *disp = flushingDisp;
+    flushingDisp = NULL;
+    lcd.endWrite();
+    disp_flush_stats_end(flushingPixels);
+    touchLatencyFlushed(flushingLast, esp_timer_get_time());
+    lv_disp_flush_ready(disp);
+  }
+}
+
+// もう一方のバッファの描画が終わり、転送完了を待っている間に呼ばれる
+static void disp_wait(lv_disp_drv_t *disp) {
+  if (waitStartMicros == 0) {
+    waitStartMicros = esp_timer_get_time();
+  }
+  disp_flush_complete();
+  if (flushingDisp == NULL) {
+    refreshBlockedMicros += esp_timer_get_time() - waitStartMicros;
+    waitStartMicros = 0;
   }
 }
+#endif
 
-static void open_keyboard() {
-  if (keyboard == NULL) {
-    keyboard = lv_keyboard_create(rootScreen);
+// SDカードはLCDとSPIバスを共有するので、転送が終わるまで待つ(描画中にフォントパックを読む前に呼ばれる)
+static void disp_release_bus() {
+#if DISP_MODE == DISP_MODE_BAND_DMA
+  while (flushingDisp != NULL) {
+    disp_flush_complete();
   }
+#endif
 }
 
-static void textarea_event_cb(lv_event_t *event) {
-  lv_event_code_t code = lv_event_get_code(event);
-  lv_obj_t *textarea = lv_event_get_target(event);
-  if (code == LV_EVENT_FOCUSED) {
-    open_keyboard();
-    lv_keyboard_set_textarea(keyboard, textarea);
-    lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+// リフレッシュの開始
+static void disp_render_start(lv_disp_drv_t *disp) {
+  refreshStartMicros = esp_timer_get_time();
+  touchLatencyRefreshStart();
+  refreshBlockedMicros = 0;
+  refreshPixels = 0;
+  refreshAreas = 0;
+}
+
+// リフレッシュの終了。転送を待っていない時間を描画時間とする
+static void disp_monitor(lv_disp_drv_t *disp, uint32_t time, uint32_t px) {
+  int64_t elapsed = esp_timer_get_time() - refreshStartMicros;
+  perfStats.renderMicros.add(elapsed - refreshBlockedMicros);
+  perfStats.pixels.add(refreshPixels);
+  perfStats.areas.add(refreshAreas);
+  refreshed = true;
+
+  if (firstFrameMillis == 0) {
+    firstFrameMillis = esp_timer_get_time() / 1000;
+    lv_mem_psram_stats_t mem;
+    lv_mem_psram_get_stats(&mem);
+    ESP_LOGI(TAG, "first frame : %lld ms after boot  lv_mem max used %u / %u bytes", firstFrameMillis, mem.max_used, mem.total_size);
   }
+}
 
-  if (code == LV_EVENT_DEFOCUSED) {
-    lv_keyboard_set_textarea(keyboard, NULL);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+// LVGLのオブジェクトはGUIタスク以外から触る前に必ずロックすること
+// 再帰ミューテックスなので、イベントコールバックの中から呼んでもよい
+static bool guiLock(TickType_t timeout = portMAX_DELAY) {
+  return xSemaphoreTakeRecursive(guiMutex, timeout) == pdTRUE;
+}
+
+static void guiUnlock() {
+  // 他のタスクがオブジェクトを変更して無効な領域ができた場合だけ、次の期限を待たずに描画させる
+  // 何も変わらなかった時(loop()のラベルの更新で文字が同じ時など)は起こさない
+  bool invalidated = false;
+  if ((guiTaskHandle != NULL) && (xTaskGetCurrentTaskHandle() != guiTaskHandle)) {
+    lv_disp_t *disp = lv_disp_get_default();
+    invalidated = (disp != NULL) && (disp->inv_p != 0);
+  }
+  xSemaphoreGiveRecursive(guiMutex);
+  if (invalidated) {
+    xTaskNotifyGive(guiTaskHandle);
+  }
+}
+
+static void guiTask(void *param) {
+  while (true) {
+    guiLock();
+    // タッチはtouch_input.cppが割り込みを受けてから読むので、M5.update()で常に読む必要は無い
+    touchInputResume();
+    // LV_TICK_CUSTOMでesp_timerから時刻を得るのでlv_tick_incは不要
+    int64_t handlerStart = esp_timer_get_time();
+    uint32_t timeTillNext = lv_timer_handler();
+    if (refreshed) {
+      // リフレッシュが行われた回だけ記録する
+      perfStats.handlerMicros.add(esp_timer_get_time() - handlerStart);
+      refreshed = false;
+    }
+#if DISP_MODE == DISP_MODE_BAND_DMA
+    // 最後のバンドの転送完了を拾う
+    disp_flush_complete();
+    if (flushingDisp != NULL) {
+      timeTillNext = 1;
+    }
+#endif
+    guiUnlock();
+
+    // 次のタイマーの期限まで眠る。guiUnlockなどからの通知があれば早く起きる
+    if (timeTillNext < 1) {
+      timeTillNext = 1;
+    } else if (timeTillNext > guiTaskMaxSleep) {
+      timeTillNext = guiTaskMaxSleep;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeTillNext));
   }
 }
 
@@ -327,38 +619,246 @@ static void getWiFiMac() {
   sprintf(macAddress, "%s", wifiMac.c_str());
 }
 
+static int formatSystemBar(char *buffer, size_t size) {
+  return snprintf(buffer, size, systemBarFormat, gpsReadyCell.get() ? LV_SYMBOL_GPS : " ", gsmReadyCell.get() ? LV_SYMBOL_CALL : " ", wifiConnectedCell.get() ? LV_SYMBOL_WIFI : " ", batteryLevelCell.get());
+}
+
+static int formatStatus(char *buffer, size_t size) {
+  return snprintf(buffer, size, "%s", linkRunningCell.get() ? running : stopped);
+}
+
+// 0.1単位の整数を小数点以下1桁で書く。浮動小数点数の書式は使わない
+static int formatTenths(char *buffer, size_t size, int tenths, const char *unit) {
+  int magnitude = abs(tenths);
+  return snprintf(buffer, size, "%s%d.%d %s", (tenths < 0) ? "-" : "", magnitude / 10, magnitude % 10, unit);
+}
+
+static int formatTemperature(char *buffer, size_t size) {
+  return formatTenths(buffer, size, temperatureCell.get(), "°C");
+}
+
+static int formatHumidity(char *buffer, size_t size) {
+  return formatTenths(buffer, size, humidityCell.get(), "%");
+}
+
+LabelBinding<> systemBarBinding(formatSystemBar);
+LabelBinding<> statusBinding(formatStatus);
+LabelBinding<> temperatureBinding(formatTemperature);
+LabelBinding<> humidityBinding(formatHumidity);
+
+static const char *bindingNames[] = {"systembar", "status", "temperature", "humidity"};
+static const LabelBinding<> *bindings[] = {&systemBarBinding, &statusBinding, &temperatureBinding, &humidityBinding};
+static const int bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+
+// セルとラベルを結び付ける。createUiの後に呼ぶ
+static void bindUi() {
+  gpsReadyCell.bind(&systemBarBinding);
+  gsmReadyCell.bind(&systemBarBinding);
+  wifiConnectedCell.bind(&systemBarBinding);
+  batteryLevelCell.bind(&systemBarBinding);
+  linkRunningCell.bind(&statusBinding);
+  temperatureCell.bind(&temperatureBinding);
+  humidityCell.bind(&humidityBinding);
+
+  systemBarBinding.attach(systemBar);
+  statusBinding.attach(connectionStatus);
+  temperatureBinding.attach(dashboardTempertature);
+  humidityBinding.attach(dashboardHumidity);
+}
+
 static void updateSystemBar() {
-  if (systemBar != NULL) {
-    bool gsmConnected = gsmReady;
-    bool wifiConnected = WiFi.isConnected();
-    int battLevel = getBatLevel();
-    sprintf(systemBarText, systemBarFormat, ((portA.type == gpsUnit) && portA.ready) ? LV_SYMBOL_GPS : " ", gsmConnected ? LV_SYMBOL_CALL : " ", wifiConnected ? LV_SYMBOL_WIFI : " ", battLevel);
-    lv_label_set_text(systemBar, systemBarText);
-  }
+  gpsReadyCell.set((portA.type == gpsUnit) && portA.ready);
+  gsmReadyCell.set(gsmReady);
+  wifiConnectedCell.set(WiFi.isConnected());
+  batteryLevelCell.set(getBatLevel());
+  systemBarBinding.apply();
 }
 
 static void updateStatus() {
-  if (connectionStatus != NULL) {
-    if ((WiFi.isConnected() && mqttClient.connected()) || gsmReady) {
-      lv_label_set_text(connectionStatus, running);
-    } else {
-      lv_label_set_text(connectionStatus, stopped);
-    }
-  }
+  linkRunningCell.set((WiFi.isConnected() && mqttClient.connected()) || gsmReady);
+  statusBinding.apply();
 }
 
 static void updateDashboard() {
   if (portA.type == env4Unit && portA.ready) {
-    sprintf(dashboardTempratureBuffer, "%.1f °C", portA.sht.cTemp);
-    lv_label_set_text(dashboardTempertature, dashboardTempratureBuffer);
-    sprintf(dashboardHumidityBuffer, "%.1f %%", portA.sht.humidity);
-    lv_label_set_text(dashboardHumidity, dashboardHumidityBuffer);
+    // 表示する桁に丸めてからsetするので、表示が変わらない変化では文字列を作らない
+    temperatureCell.set((int)lroundf(portA.sht.cTemp * 10));
+    humidityCell.set((int)lroundf(portA.sht.humidity * 10));
+  }
+  temperatureBinding.apply();
+  humidityBinding.apply();
+
+  // センサが無い間も記録して、グラフの時間軸を揃える
+  uint32_t now = millis();
+  if (now - lastHistoryMillis >= historyPeriod) {
+    lastHistoryMillis = now;
+    bool ready = (portA.type == env4Unit) && portA.ready;
+    temperatureHistory.add(ready ? (int16_t)temperatureCell.get() : SensorHistory::noValue);
+    humidityHistory.add(ready ? (int16_t)humidityCell.get() : SensorHistory::noValue);
   }
 }
 
 static void mqttCallback(const char *topic, byte *payload, unsigned int length) {
   ESP_LOGD(TAG, "topic : %s\n", topic);
   ESP_LOGD(TAG, "payload : %s\n", payload);
+
+  // 計測値の送信要求
+  if ((strcmp(topic, notificationTopic) == 0) && (length == strlen(perfCommand)) && (memcmp(payload, perfCommand, length) == 0)) {
+    perfDumpRequested = true;
+  }
+}
+
+// 計測値をシリアルに出力する
+static void printLine(const char *line) {
+  Serial.println(line);
+}
+
+static void printPerfStats() {
+  const char *names[] = {"handler_us", "render_us", "flush_ready_us", "pixels", "areas", "touch_us"};
+  const Histogram *histograms[] = {&perfStats.handlerMicros, &perfStats.renderMicros, &perfStats.flushReadyMicros, &perfStats.pixels, &perfStats.areas, &perfStats.touchMicros};
+  const int histogramCount = sizeof(histograms) / sizeof(histograms[0]);
+  char line[256];
+
+  guiLock();
+  for (int i = 0; i < histogramCount; i++) {
+    histograms[i]->formatSummary(line, sizeof(line));
+    Serial.printf("%s %s\n", names[i], line);
+    histograms[i]->formatBuckets(line, sizeof(line));
+    Serial.printf("  %s\n", line);
+  }
+  lv_mem_psram_stats_t mem;
+  lv_mem_psram_get_stats(&mem);
+  Serial.printf("first_frame_ms %lld\n", firstFrameMillis);
+  TouchInputStats touch;
+  touchInputGetStats(&touch);
+  Serial.printf("touch interrupts %u reads %u dropped %u\n", touch.interrupts, touch.reads, touch.dropped);
+  // タッチから画面への反映までの時間。count p50 p90 p99 max (us)
+  touchLatencyFormat(line, sizeof(line));
+  Serial.printf("touch_to_photon_us %s skipped %u\n", line, touchLatencySkipped());
+  Serial.printf("lv_mem used %u max %u total %u free %u biggest %u frag %u%%\n", mem.used_size, mem.max_used, mem.total_size, mem.free_size, mem.free_biggest_size, mem.frag_pct);
+  // サイズクラスのページと、描画中に内部RAMに置いたものなどプールの外の確保
+  Serial.printf("lv_mem blocks %u class %u (free %u) outside %u fallback %u\n", mem.used_cnt, mem.class_size, mem.class_free, mem.outside_cnt, mem.fallback_cnt);
+  // 描画のキャッシュ。画像とグラデーションは予算を共有する
+  Serial.printf("cache used %u / %u\n", cacheBudgetUsed(), cacheBudgetLimit());
+  for (int i = 0; i < cacheTypeCount; i++) {
+    cacheBudgetFormat((CacheType)i, line, sizeof(line));
+    Serial.printf("cache %s %s\n", cacheTypeNames[i], line);
+  }
+  GlyphIndexStats glyphIndex;
+  glyphIndexGetStats(&glyphIndex);
+  Serial.printf("glyph_index fonts %u indexes %u bytes %u lookups %u\n", glyphIndex.fonts, glyphIndex.indexes, glyphIndex.bytes, glyphIndex.lookups);
+  GlyphCacheStats glyphCache;
+  glyphCacheGetStats(&glyphCache);
+  Serial.printf("glyph_cache hits %u misses %u evictions %u entries %u bytes %u flash_avoided %llu\n", glyphCache.hits, glyphCache.misses, glyphCache.evictions, glyphCache.entries, glyphCache.bytes, glyphCache.flashBytes);
+  // SDカードのフォントパック。bytesは常に置いている部分、pagesはビットマップのページのキャッシュ
+  FontPackStats fontPack;
+  fontPackGetStats(&fontPack);
+  Serial.printf("font_pack packs %u bytes %u pages %u / %u hits %u misses %u evictions %u read %llu bytes %llu us\n", fontPack.packs, fontPack.bytes, fontPack.pages, FONT_PACK_PAGE_COUNT, fontPack.hits, fontPack.misses, fontPack.evictions, fontPack.readBytes, fontPack.readMicros);
+  // ラベルの更新の内訳。unchangedとsuppressedが省いた更新
+  for (int i = 0; i < bindingCount; i++) {
+    Serial.printf("binding %s : applied %u suppressed %u unchanged %u\n", bindingNames[i], bindings[i]->appliedCount(), bindings[i]->suppressedCount(), bindings[i]->unchangedCount());
+  }
+  guiUnlock();
+}
+
+// 計測値をJSONにする
+static void buildPerfStats(JsonDocument &perfJson) {
+  const char *names[] = {"handler_us", "render_us", "flush_ready_us", "pixels", "areas", "touch_us"};
+  const Histogram *histograms[] = {&perfStats.handlerMicros, &perfStats.renderMicros, &perfStats.flushReadyMicros, &perfStats.pixels, &perfStats.areas, &perfStats.touchMicros};
+  const int histogramCount = sizeof(histograms) / sizeof(histograms[0]);
+
+  guiLock();
+  perfJson["gateway"] = macAddress;
+  for (int i = 0; i < histogramCount; i++) {
+    JsonObject histogramJson = perfJson[names[i]].to<JsonObject>();
+    histogramJson["n"] = histograms[i]->count();
+    histogramJson["avg"] = histograms[i]->average();
+    histogramJson["p50"] = histograms[i]->percentile(50);
+    histogramJson["p90"] = histograms[i]->percentile(90);
+    histogramJson["max"] = histograms[i]->max();
+    // バケットiの上限は2^i
+    JsonArray bucketsJson = histogramJson["buckets"].to<JsonArray>();
+    for (int j = 0; j < Histogram::bucketCount; j++) {
+      bucketsJson.add(histograms[i]->bucket(j));
+    }
+  }
+  lv_mem_psram_stats_t mem;
+  lv_mem_psram_get_stats(&mem);
+  perfJson["first_frame_ms"] = firstFrameMillis;
+  TouchInputStats touch;
+  touchInputGetStats(&touch);
+  perfJson["touch_interrupts"] = touch.interrupts;
+  perfJson["touch_reads"] = touch.reads;
+  JsonObject latencyJson = perfJson["touch_to_photon_us"].to<JsonObject>();
+  latencyJson["n"] = touchLatencyCount();
+  latencyJson["p50"] = touchLatencyPercentile(50);
+  latencyJson["p90"] = touchLatencyPercentile(90);
+  latencyJson["p99"] = touchLatencyPercentile(99);
+  latencyJson["max"] = touchLatencyPercentile(100);
+  perfJson["lv_mem_max"] = mem.max_used;
+  perfJson["lv_mem_used"] = mem.used_size;
+  perfJson["lv_mem_biggest_free"] = mem.free_biggest_size;
+  perfJson["lv_mem_frag"] = mem.frag_pct;
+  JsonObject cacheJson = perfJson["cache"].to<JsonObject>();
+  cacheJson["used"] = cacheBudgetUsed();
+  cacheJson["limit"] = cacheBudgetLimit();
+  for (int i = 0; i < cacheTypeCount; i++) {
+    CacheTypeStats cache;
+    cacheBudgetGetStats((CacheType)i, &cache);
+    JsonObject typeJson = cacheJson[cacheTypeNames[i]].to<JsonObject>();
+    typeJson["hits"] = cache.hits;
+    typeJson["misses"] = cache.misses;
+    typeJson["evictions"] = cache.evictions;
+    typeJson["bytes"] = cache.bytes;
+  }
+  GlyphCacheStats glyphCache;
+  glyphCacheGetStats(&glyphCache);
+  JsonObject glyphCacheJson = perfJson["glyph_cache"].to<JsonObject>();
+  glyphCacheJson["hits"] = glyphCache.hits;
+  glyphCacheJson["misses"] = glyphCache.misses;
+  glyphCacheJson["evictions"] = glyphCache.evictions;
+  glyphCacheJson["flash_avoided"] = glyphCache.flashBytes;
+  FontPackStats fontPack;
+  fontPackGetStats(&fontPack);
+  JsonObject fontPackJson = perfJson["font_pack"].to<JsonObject>();
+  fontPackJson["packs"] = fontPack.packs;
+  fontPackJson["hits"] = fontPack.hits;
+  fontPackJson["misses"] = fontPack.misses;
+  fontPackJson["read_bytes"] = fontPack.readBytes;
+  fontPackJson["read_us"] = fontPack.readMicros;
+  JsonObject bindingsJson = perfJson["bindings"].to<JsonObject>();
+  for (int i = 0; i < bindingCount; i++) {
+    JsonObject bindingJson = bindingsJson[bindingNames[i]].to<JsonObject>();
+    bindingJson["applied"] = bindings[i]->appliedCount();
+    bindingJson["suppressed"] = bindings[i]->suppressedCount();
+    bindingJson["unchanged"] = bindings[i]->unchangedCount();
+  }
+  guiUnlock();
+}
+
+// 計測値のJSONを送る。約2KBになり、ビーコンのmessageやPubSubClientのバッファより大きいので、大きさを測ってから送る
+static void publishPerfStats(const char *perfTopic) {
+  JsonDocument perfJson;
+  buildPerfStats(perfJson);
+  size_t length = measureJson(perfJson);
+  if (gsmReady) {
+    char *buffer = (char *)ps_malloc(length + 1);
+    if (buffer == NULL) {
+      ESP_LOGE(TAG, "perf : cannot allocate %u bytes", (unsigned)(length + 1));
+      return;
+    }
+    serializeJson(perfJson, buffer, length + 1);
+    sim7080gClient.publish(portASerial, perfTopic, buffer, length, 0, 0);
+    free(buffer);
+  } else if (mqttClient.connected()) {
+    // バッファを通さずにクライアントへ直接書き出す
+    bool ok = mqttClient.beginPublish(perfTopic, length, false);
+    ok = ok && (serializeJson(perfJson, mqttClient) == length);
+    ok = (mqttClient.endPublish() == 1) && ok;
+    if (!ok) {
+      ESP_LOGE(TAG, "perf : publish of %u bytes to %s failed", (unsigned)length, perfTopic);
+    }
+  }
 }
 
 static void IRAM_ATTR onTimer() {
@@ -377,6 +877,13 @@ static void IRAM_ATTR onTimer() {
 class MyNimBLEAdvertisedDeviceCallbacks : public NimBLEAdvertisedDeviceCallbacks {
   void onResult(NimBLEAdvertisedDevice *advertisedDevice) {
     int rssi = advertisedDevice->getRSSI();
+    // 一覧には接続やRSSIの閾値に関係なく入れる。キューが一杯なら捨てる
+    if (sightingQueue != NULL) {
+      struct Sighting sighting;
+      memcpy(sighting.address, advertisedDevice->getAddress().getNative(), bluetoothAddressBytes);
+      sighting.rssi = (int8_t)rssi;
+      xQueueSend(sightingQueue, &sighting, 0);
+    }
     if (rssi >= rssiThreshold) {
       if (mqttClient.connected() || gsmReady) {
         struct Beacon beacon;
@@ -413,63 +920,174 @@ class MyNimBLEAdvertisedDeviceCallbacks : public NimBLEAdvertisedDeviceCallbacks
 
 MyNimBLEAdvertisedDeviceCallbacks callbacks = MyNimBLEAdvertisedDeviceCallbacks();
 
-void setup() {
-  M5.begin(true, true, true, true);
-  Serial.begin(115200);
+// スキャンの結果をドロップダウンに反映する。GUIのロックを取ってから呼ぶ
+// 新しいSSIDはRSSIの順の位置に追加し、表示済みのSSIDの順番が変わった場合だけ全て作り直す
+static void updateWifiScan() {
+  if (!wifiScanPoll() || (ssidDropdown == NULL)) {
+    if (!wifiScanRunning()) {
+      ssidDropdown = NULL;
+    }
+    return;
+  }
 
-  getWiFiMac();
+  int count = wifiScanNetworkCount();
+  bool rebuild = wifiScanTakeReordered();
+  if (rebuild || !ssidDropdownCleared) {
+    lv_dropdown_clear_options(ssidDropdown);
+    ssidDropdownCleared = true;
+  }
+  for (int i = 0; i < count; i++) {
+    WifiNetwork &network = wifiScanNetwork(i);
+    if (rebuild || !network.shown) {
+      lv_dropdown_add_option(ssidDropdown, network.ssid, i);
+      network.shown = true;
+    }
+  }
 
-  // Restore preferences
-  preferences.begin("m5core2_app", false);
-  sprintf(ssid, "%s", preferences.getString(ssidKey, "").c_str());
-  sprintf(pass, "%s", preferences.getString(passKey, "").c_str());
+  // 設定中のSSIDを選択したままにする
+  int32_t selected = lv_dropdown_get_option_index(ssidDropdown, ssid);
+  if (selected >= 0) {
+    lv_dropdown_set_selected(ssidDropdown, selected);
+  }
+  // 開いている一覧に追加した項目を表示する
+  if (lv_dropdown_is_open(ssidDropdown)) {
+    lv_dropdown_open(ssidDropdown);
+  }
+}
+
+// 受信したデバイスを一覧に反映する。GUIのロックを取ってから呼ぶ
+static void updateDeviceList() {
+  if (sightingQueue == NULL) {
+    return;
+  }
+  uint32_t now = millis();
+  struct Sighting sighting;
+  while (xQueueReceive(sightingQueue, &sighting, 0) == pdPASS) {
+    deviceList.update(sighting.address, sighting.rssi, now);
+  }
+  deviceList.expire(now, deviceMaxAge);
+}
+
+// 他の処理でヒープが減ったら描画のキャッシュを捨ててlv_memのプールを空けておく
+// プールが足りないとlv_memは他のヒープから取るので、キャッシュのためにヒープを使わないようにする
+static void updateCacheBudget() {
+  bool low = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < lowMemoryBytes;
+  if (low == lowMemory) {
+    return;
+  }
+  lowMemory = low;
+  cacheBudgetSetLimit(low ? 0 : LV_CACHE_BUDGET_SIZE);
+  ESP_LOGW(TAG, "low memory %d : cache budget %u bytes", low, cacheBudgetLimit());
+}
+
+//
+// UIからの操作 (ui.hpp)
+//
+static void ssid_dropdown_delete_cb(lv_event_t *event) {
+  if (lv_event_get_target(event) == ssidDropdown) {
+    ssidDropdown = NULL;
+  }
+}
+
+// 切断せずに非同期でスキャンする。結果はloopのupdateWifiScanでドロップダウンに追加する
+void scanWifi(lv_obj_t *dropdown) {
+  ESP_LOGD(TAG, "ssidDropdown\n");
+  lv_obj_remove_event_cb(dropdown, ssid_dropdown_delete_cb);
+  lv_obj_add_event_cb(dropdown, ssid_dropdown_delete_cb, LV_EVENT_DELETE, NULL);
+  ssidDropdown = dropdown;
+  ssidDropdownCleared = false;
+  wifiScanStart();
+}
+
+void applyWifiSettings() {
+  wifiReady = false;
   ESP_LOGD(TAG, "ssid : %s  pass : %s\n", ssid, pass);
+}
 
-  gsmPort = preferences.getInt(gsmPortKey, gsmPortNone);
-  sprintf(apn, "%s", preferences.getString(apnKey, "").c_str());
-  sprintf(apnUser, "%s", preferences.getString(apnUserKey, "").c_str());
-  sprintf(apnPass, "%s", preferences.getString(apnPassKey, "").c_str());
-  ESP_LOGD(TAG, "port : %d apn : %s user : %s pass : %s\n", gsmPort, apn, apnUser, apnPass);
+void applyGsmSettings() {
+  ESP_LOGD(TAG, "apn : %s, user : %s, pass : %s", apn, apnUser, apnPass);
+}
 
-  sprintf(url, "%s", preferences.getString(urlKey, "").c_str());
-  port = preferences.getInt(portKey, port);
-  tls = preferences.getBool(tlsKey, true);
-  char defaultClientId[32] = {0};
-  sprintf(defaultClientId, "m5stack-%s", macAddress);
-  sprintf(clientId, "%s", preferences.getString(clientIdKey, defaultClientId));
-  sprintf(topic, "%s", preferences.getString(topicKey).c_str(), "topic");
-  ESP_LOGD(TAG, "mqttUrl : %s port : %d clientId : %s topic : %s\n", url, port, clientId, topic);
+void applyMqttSettings() {
+  wifiReady = false;
+  ESP_LOGD(TAG, "%s, %d, %s\n", url, port, topic);
+}
+
+void applyCertSettings() {
+  wifiReady = false;
+}
 
-  int rootCASize = preferences.getString(rootCAKey, "").length();
-  if (rootCASize > 0) {
-    rootCA = (char *)ps_malloc(rootCASize + 1);
-    sprintf(rootCA, preferences.getString(rootCAKey, "").c_str());
-    rootCA[rootCASize + 1] = '\0';
-    ESP_LOGD(TAG, "rootCA : %s\n", rootCA);
+static const char *ntpServer() {
+  if ((ntpServerIndex >= 0) && (ntpServerIndex < (int)(sizeof(ntpServerList) / sizeof(ntpServerList[0])))) {
+    return ntpServerList[ntpServerIndex];
   }
+  return nictNTP;
+}
 
-  int certSize = preferences.getString(certKey, "").length();
-  if (certSize > 0) {
-    cert = (char *)ps_malloc(certSize + 1);
-    sprintf(cert, preferences.getString(certKey, "").c_str());
-    ESP_LOGD(TAG, "cert : %s\n", cert);
+void applyNtpSettings() {
+  if (WiFi.isConnected()) {
+    configTime(JST, 0, ntpServer());
   }
+}
 
-  int keySize = preferences.getString(keyKey, "").length();
-  if (keySize > 0) {
-    key = (char *)ps_malloc(keySize + 1);
-    sprintf(key, preferences.getString(keyKey, "").c_str());
-    ESP_LOGD(TAG, "key : %s\n", key);
+void applySensorsSettings() {
+  if ((timerIntervalIndex >= 0) && (timerIntervalIndex < timerIntervalCount)) {
+    timerInterval = timerIntervalList[timerIntervalIndex];
   }
+}
 
-  scanEnable = preferences.getBool(scanEnableKey, true);
-  activeScan = preferences.getBool(activeScanKey, false);
-  rssiThreshold = preferences.getInt(rssiThresholdKey, rssiThreshold);
+// SDカードのファイルを読み込む
+// UIのイベントから呼ばれるので、先にLCDの転送を終えてSPIバスを解放する(転送中のバスのロックは再帰できない)
+char *readSettingFile(const char *path) {
+  disp_release_bus();
+  File file = SD.open(path, "r");
+  if (!file) {
+    return NULL;
+  }
+  char *buffer = (char *)ps_malloc(file.size() + 1);
+  if (buffer != NULL) {
+    size_t length = file.readBytes(buffer, file.size());
+    buffer[length] = '\0';
+  }
+  file.close();
+  return buffer;
+}
 
-  timerInterval = preferences.getInt(timerIntervalKey, timerIntervalNone);
-  portA.type = preferences.getInt(portAKey);
+// SDカードのフォントパック(S:/fonts/mplus1_<太さ>_<大きさ>.fpk)のうち、あるものを開く
+static void openFontPacks() {
+  static const char *weights[] = {"light", "regular", "bold"};
+  static const int sizes[] = {8, 10, 12, 14, 16, 18, 20, 22, 24};
+  char path[48];
+  int count = 0;
+  for (int i = 0; i < sizeof(weights) / sizeof(weights[0]); i++) {
+    for (int j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+      snprintf(path, sizeof(path), "S:/fonts/mplus1_%s_%d.fpk", weights[i], sizes[j]);
+      if (fontPackOpen(path) != NULL) {
+        count++;
+      }
+    }
+  }
+  FontPackStats stats;
+  fontPackGetStats(&stats);
+  ESP_LOGI(TAG, "font packs : %d opened, %u bytes resident", count, stats.bytes);
+}
 
-  preferences.end();
+void setup() {
+  M5.begin(true, true, true, true);
+  Serial.begin(115200);
+
+  getWiFiMac();
+
+  // Restore preferences
+  loadSettings();
+  if (strlen(clientId) == 0) {
+    snprintf(clientId, sizeof(clientId), "m5stack-%s", macAddress);
+  }
+  applySensorsSettings();
+  portA.type = portAType;
+  ESP_LOGD(TAG, "ssid : %s  pass : %s\n", ssid, pass);
+  ESP_LOGD(TAG, "port : %d apn : %s user : %s pass : %s\n", gsmPort, apn, apnUser, apnPass);
+  ESP_LOGD(TAG, "mqttUrl : %s port : %d clientId : %s topic : %s\n", url, port, clientId, topic);
 
   // Setup WiFi
   WiFi.mode(WIFI_STA);
@@ -481,7 +1099,7 @@ void setup() {
   if (WiFi.isConnected()) {
     ESP_LOGD(TAG, "WiFi connect OK\n");
 
-    configTime(JST, 0, nictNTP);  // 時間を同期
+    configTime(JST, 0, ntpServer());  // 時間を同期
 
     if (tls) {
       wifiClientSecure.setCACert(rootCA);
@@ -492,6 +1110,7 @@ void setup() {
     }
 
     mqttClient.setServer(url, port);
+    mqttClient.setBufferSize(sizeof(message));
     mqttClient.connect(clientId);
     delay(1000);
     if (mqttClient.connected()) {
@@ -538,8 +1157,8 @@ void setup() {
 
       if (tls) {
         sim7080gClient.setCaCert(portASerial, awsClass2RootFileName, awsClass2Root, strlen(awsClass2Root));
-        sim7080gClient.setCert(portASerial, modemCertFileName, cert, certSize);
-        sim7080gClient.setKey(portASerial, modemPrivateKeyFileName, key, keySize);
+        sim7080gClient.setCert(portASerial, modemCertFileName, cert, (cert != NULL) ? strlen(cert) : 0);
+        sim7080gClient.setKey(portASerial, modemPrivateKeyFileName, key, (key != NULL) ? strlen(key) : 0);
         sim7080gClient.useTLS(portASerial, awsClass2RootFileName, modemCertFileName, modemPrivateKeyFileName);
         sim7080gClient.setSSLVersion(portASerial, 3);
       }
@@ -602,6 +1221,11 @@ finish_gsm_setup:
   bleScan->setAdvertisedDeviceCallbacks(&callbacks);
 
   queue = xQueueCreate(10, sizeof(Beacon));
+  temperatureHistory.begin();
+  humidityHistory.begin();
+  if (deviceList.begin()) {
+    sightingQueue = xQueueCreate(sightingQueueLength, sizeof(Sighting));
+  }
 
   if (queue) {
     if (timerInterval > 0) {
@@ -613,344 +1237,85 @@ finish_gsm_setup:
   }
 
   // Setup LVGL
+  guiMutex = xSemaphoreCreateRecursiveMutex();
   lcd.begin();
   lcd.setBrightness(128);
-  lcd.setColorDepth(24);
+  lcd.setColorDepth(dispColorDepth);
 
   /* Initialize the display */
+  // 確保できなければ静的なバッファのBANDモードで動く
+#if DISP_MODE == DISP_MODE_BAND_DMA
+  buf1 = (lv_color_t *)heap_caps_malloc(screenWidth * bandHeight * sizeof(lv_color_t), MALLOC_CAP_DMA);
+  buf2 = (lv_color_t *)heap_caps_malloc(screenWidth * bandHeight * sizeof(lv_color_t), MALLOC_CAP_DMA);
+  if ((buf1 != NULL) && (buf2 != NULL)) {
+    lv_disp_draw_buf_init(&draw_buf, buf1, buf2, screenWidth * bandHeight);
+  } else {
+    ESP_LOGE(TAG, "cannot allocate DMA draw buffers (%u bytes each), using a single band", (unsigned)(screenWidth * bandHeight * sizeof(lv_color_t)));
+    heap_caps_free(buf1);
+    heap_caps_free(buf2);
+    buf1 = buf2 = NULL;
+    dispFallback = true;
+  }
+#elif DISP_MODE == DISP_MODE_DIRECT
+  frameBuffer = (lv_color_t *)ps_malloc(screenWidth * screenHeight * sizeof(lv_color_t));
+  if (frameBuffer != NULL) {
+    lv_disp_draw_buf_init(&draw_buf, frameBuffer, NULL, screenWidth * screenHeight);
+  } else {
+    ESP_LOGE(TAG, "cannot allocate the frame buffer (%u bytes), using a single band", (unsigned)(screenWidth * screenHeight * sizeof(lv_color_t)));
+    dispFallback = true;
+  }
+#else
   lv_disp_draw_buf_init(&draw_buf, buf, NULL, screenWidth * 3);
+#endif
+  if (dispFallback) {
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, screenWidth * 3);
+  }
   lv_init();
+  cacheBudgetBegin(LV_CACHE_BUDGET_SIZE, esp_timer_get_time);
   static lv_disp_drv_t disp_drv;
   lv_disp_drv_init(&disp_drv);
   disp_drv.hor_res = screenWidth;
   disp_drv.ver_res = screenHeight;
   disp_drv.flush_cb = disp_flush;
+  disp_drv.render_start_cb = disp_render_start;
+  disp_drv.monitor_cb = disp_monitor;
+#if DISP_SOLID_FILL
+  disp_drv.draw_ctx_init = dispFillInitCtx;
+  disp_drv.draw_ctx_deinit = dispFillDeinitCtx;
+  disp_drv.draw_ctx_size = dispFillCtxSize();
+#elif DISP_BLEND_SWAR
+  disp_drv.draw_ctx_init = blend565InitCtx;
+#endif
+#if DISP_MODE == DISP_MODE_BAND_DMA
+  if (!dispFallback) {
+    disp_drv.wait_cb = disp_wait;
+  }
+#elif DISP_MODE == DISP_MODE_DIRECT
+  disp_drv.direct_mode = !dispFallback;
+#endif
+#ifdef UI_DEBUG_HEATMAP
+  disp_drv.rounder_cb = redrawHeatmapRounder;
+#endif
   disp_drv.draw_buf = &draw_buf;
   lv_disp_drv_register(&disp_drv);
+#ifdef UI_DEBUG_HEATMAP
+  redrawHeatmapInit();
+#endif
 
   /* Initialize the input device driver */
   static lv_indev_drv_t indev_drv;
   lv_indev_drv_init(&indev_drv);
   indev_drv.type = LV_INDEV_TYPE_POINTER;
-  indev_drv.read_cb = touchpad_read;
-  lv_indev_drv_register(&indev_drv);
+  indev_drv.read_cb = touchInputRead;
+  indev_drv.feedback_cb = touchLatencyFeedback;
+  touchInputAttach(lv_indev_drv_register(&indev_drv));
 
   /* Initialize the filesystem driver */
   lv_port_fs_sd_init();
+  lv_port_fs_sd_set_before_access(disp_release_bus);
+  fontPackBegin(disp_release_bus, esp_timer_get_time);
+  openFontPacks();
 
-  // static lv_obj_t* loginScreen = lv_scr_act();
-  // lv_obj_t* loginPage = lv_obj_create(loginScreen);
-
-  rootScreen = lv_scr_act();
-
-  lv_obj_t *tabView = lv_tabview_create(rootScreen, LV_DIR_BOTTOM, tabWidth);
-
-  // ホームタブ
-  lv_obj_t *homeTab = lv_tabview_add_tab(tabView, LV_SYMBOL_HOME);
-  lv_obj_t *homeTabContainer = lv_obj_create(homeTab);
-  lv_gridnav_add(homeTabContainer, LV_GRIDNAV_CTRL_NONE);
-  lv_obj_set_size(homeTabContainer, lv_pct(100), lv_pct(100));
-
-  systemBar = lv_label_create(homeTabContainer);
-  lv_label_set_text(systemBar, systemBarText);
-  lv_obj_align(systemBar, LV_ALIGN_TOP_RIGHT, 0, 0);
-
-  connectionStatus = lv_label_create(homeTabContainer);
-  lv_label_set_text(connectionStatus, booting);
-  lv_obj_set_pos(connectionStatus, 0, 0);
-
-  // ダッシュボード
-  static lv_style_t dashboardLabelStyle;
-  lv_style_init(&dashboardLabelStyle);
-  lv_style_set_text_font(&dashboardLabelStyle, &lv_font_montserrat_34);
-
-  dashboardTempertature = lv_label_create(homeTabContainer);
-  lv_label_set_text(dashboardTempertature, "--.- °C");
-  lv_obj_set_pos(dashboardTempertature, 15, 60);
-  lv_obj_add_style(dashboardTempertature, &dashboardLabelStyle, 0);
-
-  dashboardHumidity = lv_label_create(homeTabContainer);
-  lv_label_set_text(dashboardHumidity, "--.- %");
-  lv_obj_set_pos(dashboardHumidity, 150, 60);
-  lv_obj_add_style(dashboardHumidity, &dashboardLabelStyle, 0);
-
-  // WiFi/MQTT/証明書タブ
-  lv_obj_t *connectionTab = lv_tabview_add_tab(tabView, LV_SYMBOL_WIFI);
-  lv_obj_t *connectionTabContainer = lv_obj_create(connectionTab);
-  lv_gridnav_add(connectionTabContainer, LV_GRIDNAV_CTRL_NONE);
-  lv_obj_set_size(connectionTabContainer, lv_pct(100), lv_pct(300));
-
-  // static lv_style_t jp_style;
-  // lv_style_init(&jp_style);
-  // lv_style_set_text_font(&jp_style, &mplus1_light_14);
-
-  lv_obj_t *wifiLabel = lv_label_create(connectionTabContainer);
-  // lv_obj_add_style(wifiLabel, &jp_style, 0);
-  lv_label_set_text(wifiLabel, wifiText);
-  lv_obj_set_pos(wifiLabel, 0, 0);
-
-  lv_obj_t *ssidLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(ssidLabel, ssidText);
-  lv_obj_set_pos(ssidLabel, 0, 50);
-
-  static lv_obj_t *ssidDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(ssidDropdown, ssid);
-  lv_obj_set_width(ssidDropdown, 140);
-  lv_obj_set_pos(ssidDropdown, 50, 40);
-  lv_obj_add_event_cb(
-      ssidDropdown,
-      [](lv_event_t *event) {
-        ESP_LOGD(TAG, "ssidDropdown\n");
-        ssids = "";
-        lv_dropdown_clear_options(ssidDropdown);
-        WiFi.mode(WIFI_STA);
-        WiFi.disconnect();
-        delay(100);
-        int networks = WiFi.scanNetworks();
-        for (int i = 0; i < networks; i++) {
-          ESP_LOGD(TAG, "%s\n", WiFi.SSID(i) + " " + WiFi.channel(i) + " " + WiFi.RSSI(i));
-          ssids += WiFi.SSID(i) + "\n";
-        }
-        if (networks > 0) {
-          lv_dropdown_set_options(ssidDropdown, ssids.c_str());
-        }
-      },
-      LV_EVENT_CLICKED, NULL);
-
-  lv_obj_t *passwordLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(passwordLabel, passText);
-  lv_obj_set_pos(passwordLabel, 0, 100);
-
-  static lv_obj_t *passwordTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(passwordTextarea, pass);
-  lv_textarea_set_password_mode(passwordTextarea, true);
-  lv_textarea_set_one_line(passwordTextarea, true);
-  lv_textarea_set_max_length(passwordTextarea, 64);
-  lv_obj_set_width(passwordTextarea, 140);
-  lv_obj_set_pos(passwordTextarea, 50, 90);
-  lv_obj_add_event_cb(passwordTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *wifiSaveButton = lv_btn_create(connectionTabContainer);
-  lv_obj_t *wifiSaveButtonLabel = lv_label_create(wifiSaveButton);
-  lv_label_set_text(wifiSaveButtonLabel, saveText);
-  lv_obj_set_pos(wifiSaveButton, 50, 140);
-  lv_obj_add_event_cb(
-      wifiSaveButton,
-      [](lv_event_t *event) {
-        wifiReady = false;
-
-        lv_dropdown_get_selected_str(ssidDropdown, ssid, 33);
-        sprintf(pass, "%s\0", lv_textarea_get_text(passwordTextarea), 65);
-        ESP_LOGD(TAG, "ssid : %s  pass : %s\n", ssid, pass);
-
-        static const char *buttons[] = {okText, cancelText, ""};
-        messageBox = lv_msgbox_create(NULL, saveText, "SSID and Password", buttons, true);
-        lv_obj_center(messageBox);
-        lv_obj_add_event_cb(
-            messageBox,
-            [](lv_event_t *event) {
-              lv_obj_t *obj = lv_event_get_current_target(event);
-              const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-              if (strcmp(buttonText, okText) == 0) {
-                preferences.begin("m5core2_app", false);
-                preferences.putString(ssidKey, ssid);
-                preferences.putString(passKey, pass);
-                preferences.end();
-              }
-              lv_msgbox_close(messageBox);
-            },
-            LV_EVENT_VALUE_CHANGED, NULL);
-      },
-      LV_EVENT_CLICKED, NULL);
-    
-  lv_obj_t *gsmLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(gsmLabel, gsmText);
-  lv_obj_set_pos(gsmLabel, 0, 200);
-
-  lv_obj_t *gsmPortLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(gsmPortLabel, portText);
-  lv_obj_set_pos(gsmPortLabel, 0, 250);
-
-  static lv_obj_t *gsmPortDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(gsmPortDropdown, "None\nPortA");
-  lv_dropdown_set_selected(gsmPortDropdown, gsmPort);
-  lv_obj_set_pos(gsmPortDropdown, 50, 240);
-  
-  lv_obj_t *apnLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(apnLabel, apnText);
-  lv_obj_set_pos(apnLabel, 0, 300);
-
-  static lv_obj_t *apnTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(apnTextarea, apn);
-  lv_textarea_set_one_line(apnTextarea, true);
-  lv_textarea_set_max_length(apnTextarea, 63);
-  lv_obj_set_width(apnTextarea, 140);
-  lv_obj_set_pos(apnTextarea, 50, 290);
-  lv_obj_add_event_cb(apnTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *apnUserLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(apnUserLabel, userText);
-  lv_obj_set_pos(apnUserLabel, 0, 350);
-
-  static lv_obj_t *apnUserTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(apnUserTextarea, apnUser);
-  lv_textarea_set_one_line(apnUserTextarea, true);
-  lv_textarea_set_max_length(apnUserTextarea, 63);
-  lv_obj_set_width(apnUserTextarea, 140);
-  lv_obj_set_pos(apnUserTextarea, 50, 340);
-  lv_obj_add_event_cb(apnUserTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *apnPassLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(apnPassLabel, passText);
-  lv_obj_set_pos(apnPassLabel, 0, 400);
-
-  static lv_obj_t *apnPassTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(apnPassTextarea, apnPass);
-  lv_textarea_set_one_line(apnPassTextarea, true);
-  lv_textarea_set_max_length(apnPassTextarea, 63);
-  lv_obj_set_width(apnPassTextarea, 140);
-  lv_obj_set_pos(apnPassTextarea, 50, 390);
-  lv_obj_add_event_cb(apnPassTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *gsmSaveButton = lv_btn_create(connectionTabContainer);
-  lv_obj_t *gsmSaveButtonLabel = lv_label_create(gsmSaveButton);
-  lv_label_set_text(gsmSaveButtonLabel, saveText);
-  lv_obj_set_pos(gsmSaveButton, 50, 450);
-  lv_obj_add_event_cb(
-    gsmSaveButton,
-    [](lv_event_t *event) {
-      gsmPort = lv_dropdown_get_selected(gsmPortDropdown);
-      sprintf(apn, "%s", lv_textarea_get_text(apnTextarea));
-      sprintf(apnUser, "%s", lv_textarea_get_text(apnUserTextarea));
-      sprintf(apnPass, "%s", lv_textarea_get_text(apnPassTextarea));
-      ESP_LOGD(TAG, "apn : %s, user : %s, pass : %s", apn, apnUser, apnPass);
-      static const char *buttons[] = {okText, cancelText, ""};
-      messageBox = lv_msgbox_create(NULL, saveText, "GSM settings", buttons, true);
-      lv_obj_center(messageBox);
-      lv_obj_add_event_cb(
-        messageBox,
-        [](lv_event_t *event) {
-          lv_obj_t *obj = lv_event_get_current_target(event);
-          const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-          if (strcmp(buttonText, okText) == 0) {
-            preferences.begin("m5core2_app", false);
-            preferences.putInt(gsmPortKey, gsmPort);
-            preferences.putString(apnKey, apn);
-            preferences.putString(apnUserKey, apnUser);
-            preferences.putString(apnPassKey, apnPass);
-            preferences.end();
-          }
-          lv_msgbox_close(messageBox);
-        },
-        LV_EVENT_VALUE_CHANGED, NULL);
-  }, LV_EVENT_CLICKED, NULL);
-
-  lv_obj_t *mqttLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(mqttLabel, mqttText);
-  lv_obj_set_pos(mqttLabel, 0, 500);
-
-  lv_obj_t *urlLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(urlLabel, urlText);
-  lv_obj_set_pos(urlLabel, 0, 550);
-
-  static lv_obj_t *urlTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(urlTextarea, url);
-  lv_textarea_set_one_line(urlTextarea, true);
-  lv_textarea_set_max_length(urlTextarea, 63);
-  lv_obj_set_width(urlTextarea, 140);
-  lv_obj_set_pos(urlTextarea, 50, 540);
-  lv_obj_add_event_cb(urlTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *portLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(portLabel, portText);
-  lv_obj_set_pos(portLabel, 0, 600);
-
-  static lv_obj_t *portTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(portTextarea, String(port).c_str());
-  lv_textarea_set_one_line(portTextarea, true);
-  lv_textarea_set_accepted_chars(portTextarea, "0123456789");
-  lv_textarea_set_max_length(portTextarea, 4);
-  lv_obj_set_width(portTextarea, 140);
-  lv_obj_set_pos(portTextarea, 50, 590);
-  lv_obj_add_event_cb(portTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *tlsLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(tlsLabel, tlsText);
-  lv_obj_set_pos(tlsLabel, 0, 650);
-
-  static lv_obj_t *tlsSwitch = lv_switch_create(connectionTabContainer);
-  lv_obj_set_pos(tlsSwitch, 50, 640);
-  if (tls) {
-    lv_obj_add_state(tlsSwitch, tls);
-  } else {
-    lv_obj_clear_state(tlsSwitch, tls);
-  }
-
-  lv_obj_t *clientIdLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(clientIdLabel, clientIdText);
-  lv_obj_set_pos(clientIdLabel, 0, 700);
-
-  static lv_obj_t *clientIdTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(clientIdTextarea, clientId);
-  lv_textarea_set_one_line(clientIdTextarea, true);
-  lv_textarea_set_max_length(clientIdTextarea, 31);
-  lv_obj_set_width(clientIdTextarea, 140);
-  lv_obj_set_pos(clientIdTextarea, 50, 690);
-  lv_obj_add_event_cb(clientIdTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *topicLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(topicLabel, topicText);
-  lv_obj_set_pos(topicLabel, 0, 750);
-
-  static lv_obj_t *topicTextarea = lv_textarea_create(connectionTabContainer);
-  lv_textarea_set_text(topicTextarea, topic);
-  lv_textarea_set_one_line(topicTextarea, true);
-  lv_obj_set_width(topicTextarea, 140);
-  lv_obj_set_pos(topicTextarea, 50, 740);
-  lv_obj_add_event_cb(topicTextarea, textarea_event_cb, LV_EVENT_ALL, NULL);
-
-  lv_obj_t *mqttSaveButton = lv_btn_create(connectionTabContainer);
-  lv_obj_t *mqttSaveButtonLabel = lv_label_create(mqttSaveButton);
-  lv_label_set_text(mqttSaveButtonLabel, saveText);
-  lv_obj_set_pos(mqttSaveButton, 50, 800);
-  lv_obj_add_event_cb(
-      mqttSaveButton,
-      [](lv_event_t *event) {
-        ESP_LOGD(TAG, "mqttSaveButton\n");
-        wifiReady = false;
-
-        sprintf(url, "%s", lv_textarea_get_text(urlTextarea));
-        port = atoi(lv_textarea_get_text(portTextarea));
-        tls = lv_obj_get_state(tlsSwitch);
-        sprintf(clientId, "%s", lv_textarea_get_text(clientIdTextarea));
-        sprintf(topic, "%s", lv_textarea_get_text(topicTextarea));
-
-        ESP_LOGD(TAG, "%s, %d, %s\n", url, port, topic);
-
-        static const char *buttons[] = {okText, cancelText, ""};
-        messageBox = lv_msgbox_create(NULL, saveText, "MQTT settings", buttons, true);
-        lv_obj_center(messageBox);
-        lv_obj_add_event_cb(
-            messageBox,
-            [](lv_event_t *event) {
-              lv_obj_t *obj = lv_event_get_current_target(event);
-              const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-              if (strcmp(buttonText, okText) == 0) {
-                preferences.begin("m5core2_app", false);
-                preferences.putString(urlKey, url);
-                preferences.putInt(portKey, port);
-                preferences.putBool(tlsKey, tls);
-                preferences.putString(clientIdKey, clientId);
-                preferences.putString(topicKey, topic);
-                preferences.end();
-              }
-              lv_msgbox_close(messageBox);
-            },
-            LV_EVENT_VALUE_CHANGED, NULL);
-      },
-      LV_EVENT_CLICKED, NULL);
-
-  String files = "";
   // SDカードからファイル一覧を取得する
   File root = SD.open("/");
   File file = root.openNextFile();
@@ -968,283 +1333,44 @@ finish_gsm_setup:
   }
   file.close();
 
-  lv_obj_t *certLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(certLabel, certText);
-  lv_obj_set_pos(certLabel, 0, 850);
-
-  lv_obj_t *rootCaLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(rootCaLabel, rootCAText);
-  lv_obj_set_pos(rootCaLabel, 0, 900);
-
-  static lv_obj_t *rootCaDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(rootCaDropdown, files.c_str());
-  lv_obj_set_width(rootCaDropdown, 140);
-  lv_obj_set_pos(rootCaDropdown, 50, 890);
-
-  lv_obj_t *clientCertLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(clientCertLabel, certText);
-  lv_obj_set_pos(clientCertLabel, 0, 950);
-
-  static lv_obj_t *clientCertDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(clientCertDropdown, files.c_str());
-  lv_obj_set_width(clientCertDropdown, 140);
-  lv_obj_set_pos(clientCertDropdown, 50, 940);
-
-  lv_obj_t *keyLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(keyLabel, keyText);
-  lv_obj_set_pos(keyLabel, 0, 1000);
-
-  static lv_obj_t *keyDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(keyDropdown, files.c_str());
-  lv_obj_set_width(keyDropdown, 140);
-  lv_obj_set_pos(keyDropdown, 50, 990);
-
-  lv_obj_t *certSaveButton = lv_btn_create(connectionTabContainer);
-  lv_obj_t *certSaveButtonLabel = lv_label_create(certSaveButton);
-  lv_label_set_text(certSaveButtonLabel, saveText);
-  lv_obj_set_pos(certSaveButton, 50, 1050);
-  lv_obj_add_event_cb(
-      certSaveButton,
-      [](lv_event_t *event) {
-        wifiReady = false;
-
-        static const char *buttons[] = {okText, cancelText, ""};
-        messageBox = lv_msgbox_create(NULL, saveText, "Certification files", buttons, true);
-        lv_obj_center(messageBox);
-        lv_obj_add_event_cb(
-            messageBox,
-            [](lv_event_t *event) {
-              lv_obj_t *obj = lv_event_get_current_target(event);
-              const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-              if (strcmp(buttonText, okText) == 0) {
-                preferences.begin("m5core2_app", false);
-
-                char buf[32];
-                File file;
-
-                lv_dropdown_get_selected_str(rootCaDropdown, buf, 32);
-                file = SD.open(buf, "r");
-                rootCA = (char *)ps_malloc(file.size());
-                file.readBytes(rootCA, file.size());
-                preferences.putString(rootCAKey, rootCA);
-
-                lv_dropdown_get_selected_str(clientCertDropdown, buf, 32);
-                file = SD.open(buf, "r");
-                cert = (char *)ps_malloc(file.size());
-                file.readBytes(cert, file.size());
-                preferences.putString(certKey, cert);
-
-                lv_dropdown_get_selected_str(keyDropdown, buf, 32);
-                file = SD.open(buf, "r");
-                key = (char *)ps_malloc(file.size());
-                file.readBytes(key, file.size());
-                preferences.putString(keyKey, key);
-
-                preferences.end();
-              }
-              lv_msgbox_close(messageBox);
-            },
-            LV_EVENT_VALUE_CHANGED, NULL);
-      },
-      LV_EVENT_CLICKED, NULL);
-
-  lv_obj_t *ntpLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(ntpLabel, ntpText);
-  lv_obj_set_pos(ntpLabel, 0, 1100);
-
-  lv_obj_t *ntpServerLabel = lv_label_create(connectionTabContainer);
-  lv_label_set_text(ntpServerLabel, urlText);
-  lv_obj_set_pos(ntpServerLabel, 0, 1150);
-
-  lv_obj_t *ntpDropdown = lv_dropdown_create(connectionTabContainer);
-  lv_dropdown_set_options(ntpDropdown, nictNTP);
-  lv_obj_set_width(ntpDropdown, 140);
-  lv_obj_set_pos(ntpDropdown, 50, 1140);
-
-  lv_obj_t *ntpSaveButton = lv_btn_create(connectionTabContainer);
-  lv_obj_t *ntpSaveButtonLabel = lv_label_create(ntpSaveButton);
-  lv_label_set_text(ntpSaveButtonLabel, saveText);
-  lv_obj_set_pos(ntpSaveButton, 50, 1200);
-  lv_obj_add_event_cb(
-      ntpSaveButton,
-      [](lv_event_t *event) {
-        // NTPの変更は未実装
-      },
-      LV_EVENT_CLICKED, NULL);
-
-  // Bluetoothタブ
-  lv_obj_t *bluetoothTab = lv_tabview_add_tab(tabView, LV_SYMBOL_BLUETOOTH);
-  lv_obj_t *bluetoothTabContainer = lv_obj_create(bluetoothTab);
-  lv_gridnav_add(bluetoothTabContainer, LV_GRIDNAV_CTRL_NONE);
-  lv_obj_set_size(bluetoothTabContainer, lv_pct(100), lv_pct(100));
-
-  lv_obj_t *bluetoothLabel = lv_label_create(bluetoothTabContainer);
-  lv_label_set_text(bluetoothLabel, bluetoothText);
-  lv_obj_set_pos(bluetoothLabel, 0, 0);
-
-  lv_obj_t *scanEnableLabel = lv_label_create(bluetoothTabContainer);
-  lv_label_set_text(scanEnableLabel, scanText);
-  lv_obj_set_pos(scanEnableLabel, 0, 50);
-
-  static lv_obj_t *scanEnableSwitch = lv_switch_create(bluetoothTabContainer);
-  lv_obj_set_pos(scanEnableSwitch, 50, 40);
-  if (scanEnable) {
-    lv_obj_add_state(scanEnableSwitch, LV_STATE_CHECKED);
-  } else {
-    lv_obj_clear_state(scanEnableSwitch, LV_STATE_CHECKED);
-  }
+  UiSettings uiSettings;
+  uiSettings.systemBarText = systemBarText;
+  uiSettings.files = files.c_str();
+  createUi(uiSettings);
+  bindUi();
 
-  lv_obj_t *activeScanEnableLabel = lv_label_create(bluetoothTabContainer);
-  lv_label_set_text(activeScanEnableLabel, activeScanText);
-  lv_obj_set_pos(activeScanEnableLabel, 0, 100);
-
-  static lv_obj_t *activeScanSwitch = lv_switch_create(bluetoothTabContainer);
-  if (activeScan) {
-    lv_obj_add_state(activeScanSwitch, LV_STATE_CHECKED);
-  } else {
-    lv_obj_clear_state(activeScanSwitch, LV_STATE_CHECKED);
-  }
-  lv_obj_set_pos(activeScanSwitch, 50, 90);
-
-  lv_obj_t *rssiLabel = lv_label_create(bluetoothTabContainer);
-  lv_label_set_text(rssiLabel, rssiText);
-  lv_obj_set_pos(rssiLabel, 0, 150);
-
-  static lv_obj_t *rssiThresholdLabel = lv_label_create(bluetoothTabContainer);
-  lv_label_set_text_fmt(rssiThresholdLabel, "%d", rssiThreshold);
-  lv_obj_set_pos(rssiThresholdLabel, 210, 150);
-
-  static lv_obj_t *rssiSlider = lv_slider_create(bluetoothTabContainer);
-  lv_obj_set_width(rssiSlider, 130);
-  lv_slider_set_range(rssiSlider, -120, 0);
-  lv_slider_set_value(rssiSlider, rssiThreshold, LV_ANIM_OFF);
-  lv_obj_set_pos(rssiSlider, 60, 150);
-  lv_obj_add_event_cb(
-      rssiSlider,
-      [](lv_event_t *event) {
-        lv_obj_t *slider = lv_event_get_target(event);
-        int value = lv_slider_get_value(slider);
-        lv_label_set_text_fmt(rssiThresholdLabel, "%d", value);
-      },
-      LV_EVENT_VALUE_CHANGED, NULL);
-
-  lv_obj_t *bluetoothSaveButton = lv_btn_create(bluetoothTabContainer);
-  lv_obj_t *bluetoothSaveButtonLabel = lv_label_create(bluetoothSaveButton);
-  lv_label_set_text(bluetoothSaveButtonLabel, saveText);
-  lv_obj_set_pos(bluetoothSaveButton, 50, 200);
-  lv_obj_add_event_cb(
-      bluetoothSaveButton,
-      [](lv_event_t *event) {
-        static const char *buttons[] = {okText, cancelText, ""};
-        messageBox = lv_msgbox_create(NULL, saveText, "Bluetooth settings", buttons, true);
-        lv_obj_center(messageBox);
-        lv_obj_add_event_cb(
-            messageBox,
-            [](lv_event_t *event) {
-              lv_obj_t *obj = lv_event_get_current_target(event);
-              const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-              if (strcmp(buttonText, okText) == 0) {
-                preferences.begin("m5core2_app", false);
-                preferences.putBool(scanEnableKey, lv_obj_get_state(scanEnableSwitch));
-                preferences.putBool(activeScanKey, lv_obj_get_state(activeScanSwitch));
-                preferences.putInt(rssiThresholdKey, lv_slider_get_value(rssiSlider));
-                preferences.end();
-              }
-              lv_msgbox_close(messageBox);
-            },
-            LV_EVENT_VALUE_CHANGED, NULL);
-      },
-      LV_EVENT_CLICKED, NULL);
-
-  // GPS/内蔵センサタブ
-  lv_obj_t *sensorsTab = lv_tabview_add_tab(tabView, LV_SYMBOL_PLUS);
-  lv_obj_t *sensorsTabContainer = lv_obj_create(sensorsTab);
-  lv_gridnav_add(sensorsTabContainer, LV_GRIDNAV_CTRL_NONE);
-  lv_obj_set_size(sensorsTabContainer, lv_pct(100), lv_pct(450));
-
-  lv_obj_t *sensorsLabel = lv_label_create(sensorsTabContainer);
-  lv_label_set_text(sensorsLabel, sensorsText);
-  lv_obj_set_pos(sensorsLabel, 0, 0);
-
-  lv_obj_t *timerEnableLabel = lv_label_create(sensorsTabContainer);
-  lv_label_set_text(timerEnableLabel, timerText);
-  lv_obj_set_pos(timerEnableLabel, 0, 50);
-
-  static lv_obj_t* timerIntervalDropdown = lv_dropdown_create(sensorsTabContainer);
-  lv_dropdown_set_options(timerIntervalDropdown, timerIntervals);
-  lv_obj_set_width(timerIntervalDropdown, 140);
-  lv_obj_set_pos(timerIntervalDropdown, 50, 40);
-  if (timerInterval == timerIntervalNone) {
-    lv_dropdown_set_selected(timerIntervalDropdown, 0);
-  } else if (timerInterval == timerInterval10min) {
-    lv_dropdown_set_selected(timerIntervalDropdown, 1);
-  } else if (timerInterval == timerInterval30min) {
-    lv_dropdown_set_selected(timerIntervalDropdown, 2);
-  } else if (timerInterval == timerInterval60min) {
-    lv_dropdown_set_selected(timerIntervalDropdown, 3);
-  }
-
-  lv_obj_t *portALabel = lv_label_create(sensorsTabContainer);
-  lv_label_set_text(portALabel, portAText);
-  lv_obj_set_pos(portALabel, 0, 100);
-
-  static lv_obj_t *portADropdown = lv_dropdown_create(sensorsTabContainer);
-  lv_dropdown_set_options(portADropdown, supportedUnits);
-  lv_obj_set_width(portADropdown, 140);
-  lv_dropdown_set_selected(portADropdown, portA.type);
-  lv_obj_set_pos(portADropdown, 50, 90);
-  if (gsmPort == gsmPortA) {
-    lv_dropdown_set_selected(portADropdown, none);
-    lv_obj_add_state(portADropdown, LV_STATE_DISABLED);
-  }
-
-  lv_obj_t *sensorsSaveButton = lv_btn_create(sensorsTabContainer);
-  lv_obj_t *sensorsSaveButtonLabel = lv_label_create(sensorsSaveButton);
-  lv_label_set_text(sensorsSaveButtonLabel, saveText);
-  lv_obj_set_pos(sensorsSaveButton, 50, 150);
-  lv_obj_add_event_cb(
-      sensorsSaveButton,
-      [](lv_event_t *event) {
-        int selected = lv_dropdown_get_selected(timerIntervalDropdown);
-        if (selected == 0) {
-          timerInterval = timerIntervalNone;
-        } else if (selected == 1) {
-          timerInterval = timerInterval10min;
-        } else if (selected == 2) {
-          timerInterval = timerInterval30min;
-        } else if (selected == 3) {
-          timerInterval = timerInterval60min;
-        }
-
-        static const char *buttons[] = {okText, cancelText, ""};
-        messageBox = lv_msgbox_create(NULL, saveText, "Sensors settings", buttons, true);
-        lv_obj_center(messageBox);
-        lv_obj_add_event_cb(
-            messageBox,
-            [](lv_event_t *event) {
-              lv_obj_t *obj = lv_event_get_current_target(event);
-              const char *buttonText = lv_msgbox_get_active_btn_text(obj);
-              int portA = lv_dropdown_get_selected(portADropdown);
-              if (strcmp(buttonText, okText) == 0) {
-                preferences.begin("m5core2_app", false);
-                preferences.putInt(timerIntervalKey, timerInterval);
-                preferences.putInt(portAKey, portA);
-                preferences.end();
-              }
-              lv_msgbox_close(messageBox);
-            },
-            LV_EVENT_VALUE_CHANGED, NULL);
-      },
-      LV_EVENT_CLICKED, NULL);
+  xTaskCreatePinnedToCore(guiTask, "gui", guiTaskStackSize, NULL, guiTaskPriority, &guiTaskHandle, guiTaskCore);
+  touchInputBegin(guiTaskHandle);
 
   ESP_LOGD(TAG, "Setup done\n");
 }
 
-void loop() {
-  M5.update();
-  lv_tick_inc(5);
-  lv_task_handler();
+// loop()が使う接続の設定の写し
+// 設定の配列はUIのコールバック(GUIタスク)が書き換えるので、loop()の初めにロックして写し、書きかけの文字列を使わないようにする
+// PubSubClientのsetServerは文字列を写さずに持つので、urlはこの写しを渡す
+struct ConnectionSettings {
+  char ssid[sizeof(::ssid)];
+  char pass[sizeof(::pass)];
+  char url[sizeof(::url)];
+  int port;
+  char clientId[sizeof(::clientId)];
+  char topic[sizeof(::topic)];
+};
+static ConnectionSettings connection;
+
+static void copyConnectionSettings() {
+  guiLock();
+  strlcpy(connection.ssid, ssid, sizeof(connection.ssid));
+  strlcpy(connection.pass, pass, sizeof(connection.pass));
+  strlcpy(connection.url, url, sizeof(connection.url));
+  connection.port = port;
+  strlcpy(connection.clientId, clientId, sizeof(connection.clientId));
+  strlcpy(connection.topic, topic, sizeof(connection.topic));
+  guiUnlock();
+}
 
+void loop() {
+  copyConnectionSettings();
   if (wifiReady || gsmReady) {
     if (WiFi.isConnected() || gsmReady) {
       if (mqttClient.connected() || gsmReady) {
@@ -1278,16 +1404,19 @@ void loop() {
                 }
               }
 
+              // AXPはタッチパネルと同じI2Cバスなので、GUIタスクと排他する
+              guiLock();
               messageJson["battery"] = getBatLevel();
+              guiUnlock();
               messageJson["timestamp"] = beacon.timestamp;
 
               int messageLength = serializeJson(messageJson, message);
               ESP_LOGD(TAG, "%s\n", message);
               if (gsmReady) {
                 sim7080gClient.updateLatLng(portASerial);
-                sim7080gClient.publish(portASerial, topic, message, messageLength, 0, 0);
+                sim7080gClient.publish(portASerial, connection.topic, message, messageLength, 0, 0);
               } else if (mqttClient.connected()) {
-                mqttClient.publish(topic, message);
+                mqttClient.publish(connection.topic, message);
               }
               delay(1);
             }
@@ -1309,9 +1438,9 @@ void loop() {
       } else {
         if (!mqttClient.connected()) {
           mqttClient.disconnect();
-          mqttClient.setServer(url, port);
+          mqttClient.setServer(connection.url, connection.port);
           mqttClient.setCallback(mqttCallback);
-          if (mqttClient.connect(clientId)) {
+          if (mqttClient.connect(connection.clientId)) {
             mqttClient.subscribe(notificationTopic);
           } else {
             if (retry++ > 100) {
@@ -1323,8 +1452,9 @@ void loop() {
         }
       }
     } else {
-      if (!WiFi.isConnected()) {
-        WiFi.begin(ssid, pass);
+      // スキャン中に接続を始めるとスキャンが止まるので、終わるまで待つ
+      if (!WiFi.isConnected() && !wifiScanRunning()) {
+        WiFi.begin(connection.ssid, connection.pass);
         WiFi.waitForConnectResult();
       }
     }
@@ -1350,9 +1480,68 @@ void loop() {
     }
   }
 
+  guiLock();
   updateSystemBar();
   updateStatus();
   updateDashboard();
+  updateDeviceList();
+  updateWifiScan();
+  updateCacheBudget();
+  guiUnlock();
+
+  // 計測値の出力 p : 出力、r : リセット、b : 描画カーネルの速度比較
+  // g : グリフ番号の表とグリフのキャッシュの速度比較(GLYPH_INDEX_BENCH_FONTの場合)
+  // h : ヒートマップの表示切り替え、i : 無効化の集計の出力(UI_DEBUG_HEATMAPの場合)
+  while (Serial.available() > 0) {
+    int ch = Serial.read();
+    if (ch == 'p') {
+      printPerfStats();
+    } else if (ch == 'r') {
+      guiLock();
+      perfStats.clear();
+      touchLatencyClear();
+      cacheBudgetClearStats();
+      glyphCacheClearStats();
+      fontPackClearStats();
+      guiUnlock();
+#if DISP_BLEND_SWAR
+    } else if (ch == 'b') {
+      guiLock();
+      blend565Benchmark(esp_timer_get_time, printLine);
+      guiUnlock();
+#endif
+#ifdef GLYPH_INDEX_BENCH_FONT
+    } else if (ch == 'g') {
+      guiLock();
+      glyphIndexBenchmark(&GLYPH_INDEX_BENCH_FONT, esp_timer_get_time, printLine);
+      glyphCacheBenchmark(&GLYPH_INDEX_BENCH_FONT, esp_timer_get_time, printLine);
+      guiUnlock();
+#endif
+#ifdef UI_DEBUG_HEATMAP
+    } else if (ch == 'h') {
+      guiLock();
+      redrawHeatmapShow(!redrawHeatmapShown());
+      guiUnlock();
+    } else if (ch == 'i') {
+      guiLock();
+      redrawHeatmapReport(printLine);
+      guiUnlock();
+#endif
+    }
+  }
+
+  if (perfDumpRequested) {
+    perfDumpRequested = false;
+    char perfTopic[sizeof(topic) + 8];
+    sprintf(perfTopic, "%s%s", connection.topic, perfTopicSuffix);
+    publishPerfStats(perfTopic);
+  }
 
-  delay(1);
+  // 次のビーコンが届くか、周期が来るまで眠る
+  if ((queue != NULL) && (uxQueueMessagesWaiting(queue) == 0)) {
+    struct Beacon beacon;
+    xQueuePeek(queue, &beacon, pdMS_TO_TICKS(loopPeriod));
+  } else {
+    delay(loopPeriod);
+  }
 }
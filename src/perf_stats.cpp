@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include "perf_stats.hpp"
+
+void Histogram::add(uint32_t value) {
+  int index = 0;
+  while ((index < bucketCount - 1) && (value >= bucketLimit(index))) {
+    index++;
+  }
+  buckets[index]++;
+  samples++;
+  sum += value;
+  if (value > maxValue) {
+    maxValue = value;
+  }
+}
+
+void Histogram::clear() {
+  for (int i = 0; i < bucketCount; i++) {
+    buckets[i] = 0;
+  }
+  samples = 0;
+  maxValue = 0;
+  sum = 0;
+}
+
+uint32_t Histogram::percentile(int percent) const {
+  if (samples == 0) {
+    return 0;
+  }
+
+  uint32_t target = ((uint64_t)samples * percent + 99) / 100;
+  uint32_t accumulated = 0;
+  for (int i = 0; i < bucketCount; i++) {
+    accumulated += buckets[i];
+    if (accumulated >= target) {
+      // バケットの上限より最大値の方が小さければ最大値を返す
+      return (bucketLimit(i) < maxValue) ? bucketLimit(i) : maxValue;
+    }
+  }
+  return maxValue;
+}
+
+int Histogram::formatSummary(char *buffer, size_t size) const {
+  return snprintf(buffer, size, "n=%u avg=%u p50<=%u p90<=%u max=%u", samples, average(), percentile(50), percentile(90), maxValue);
+}
+
+int Histogram::formatBuckets(char *buffer, size_t size) const {
+  int length = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < bucketCount; i++) {
+    if (buckets[i] == 0) {
+      continue;
+    }
+    int written;
+    if (i < bucketCount - 1) {
+      written = snprintf(&buffer[length], size - length, "<%u:%u ", bucketLimit(i), buckets[i]);
+    } else {
+      written = snprintf(&buffer[length], size - length, ">=%u:%u ", bucketLimit(i - 1), buckets[i]);
+    }
+    if ((written < 0) || ((size_t)(length + written) >= size)) {
+      break;
+    }
+    length += written;
+  }
+  return length;
+}
+
+void PerfStats::clear() {
+  handlerMicros.clear();
+  renderMicros.clear();
+  flushReadyMicros.clear();
+  pixels.clear();
+  areas.clear();
+  touchMicros.clear();
+}
+
+int PerfStats::formatSummary(char *buffer, size_t size) const {
+  const char *names[] = {"handler us", "render us", "flush ready us", "pixels", "areas", "touch us"};
+  const Histogram *histograms[] = {&handlerMicros, &renderMicros, &flushReadyMicros, &pixels, &areas, &touchMicros};
+  const int count = sizeof(histograms) / sizeof(histograms[0]);
+
+  int length = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < count; i++) {
+    int written = snprintf(&buffer[length], size - length, "%s\n  ", names[i]);
+    if ((written < 0) || ((size_t)(length + written) >= size)) {
+      break;
+    }
+    length += written;
+    written = histograms[i]->formatSummary(&buffer[length], size - length);
+    if ((written < 0) || ((size_t)(length + written + 1) >= size)) {
+      break;
+    }
+    length += written;
+    buffer[length++] = '\n';
+    buffer[length] = '\0';
+  }
+  return length;
+}
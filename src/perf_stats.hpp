@@ -0,0 +1,50 @@
+#ifndef PERF_STATS_HPP
+#define PERF_STATS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 固定バケットのヒストグラム
+// バケットiには 2^(i-1) <= value < 2^i の値が入る。最後のバケットはそれ以上の値をまとめる
+class Histogram {
+public:
+  static const int bucketCount = 20;
+
+  void add(uint32_t value);
+  void clear();
+  uint32_t count() const { return samples; }
+  uint32_t max() const { return maxValue; }
+  uint32_t average() const { return (samples > 0) ? (uint32_t)(sum / samples) : 0; }
+  uint32_t bucket(int index) const { return buckets[index]; }
+  // バケットの上限(この値未満)
+  static uint32_t bucketLimit(int index) { return (index < bucketCount - 1) ? (1UL << index) : UINT32_MAX; }
+  // パーセンタイルの近似値(該当するバケットの上限と最大値の小さい方)を返す
+  uint32_t percentile(int percent) const;
+  // "count avg p50 p90 max" の1行
+  int formatSummary(char *buffer, size_t size) const;
+  // 空でないバケットを "<limit>:<count> " の形式で並べる
+  int formatBuckets(char *buffer, size_t size) const;
+
+private:
+  uint32_t buckets[bucketCount] = {0};
+  uint32_t samples = 0;
+  uint32_t maxValue = 0;
+  uint64_t sum = 0;
+};
+
+// 1回のリフレッシュごとの描画、転送の計測値
+struct PerfStats {
+  Histogram handlerMicros;     // lv_timer_handler全体
+  Histogram renderMicros;      // リフレッシュのうち転送を待っていない時間
+  Histogram flushReadyMicros;  // 転送を始めてから、完了を確認してLVGLに通知するまで
+                               // BAND_DMAでは完了を次のバンドの描画の後に確認するので、DMAの転送と次のバンドの描画の長い方になる
+  Histogram pixels;            // 転送した画素数
+  Histogram areas;             // 転送した領域の数
+  Histogram touchMicros;       // タッチの割り込みからLVGLが座標を読むまで
+
+  void clear();
+  // 全ヒストグラムの要約を複数行のテキストにする
+  int formatSummary(char *buffer, size_t size) const;
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "redraw_heatmap.hpp"
+
+static const lv_coord_t tileSize = 16;
+static const int maxTileColumns = 32;
+static const int maxTileRows = 32;
+// 集計の周期
+static const uint32_t windowPeriod = 1000;
+// 無効化を割り当てるオブジェクトの数
+static const int maxTrackedObjects = 32;
+// 1秒にこの回数以上無効化されたオブジェクトを過剰な無効化として報告する
+static const uint16_t overInvalidationThreshold = 5;
+// レポートに出力するオブジェクトの数
+static const int reportObjects = 8;
+// オーバーレイの色の段階と、最も赤くなる再描画回数(回/秒)
+static const int heatLevels = 8;
+static const uint16_t heatMax = 30;
+
+struct TileCounts {
+  uint16_t invalidations;
+  uint16_t redraws;
+};
+
+struct ObjectCounts {
+  const lv_obj_t *obj;  // 同じオブジェクトかの比較にだけ使う。削除されている場合があるので参照しない
+  const char *name;
+  lv_area_t coords;
+  uint16_t count;
+};
+
+static int tileColumns = 0;
+static int tileRows = 0;
+static TileCounts currentTiles[maxTileRows][maxTileColumns];
+static TileCounts lastTiles[maxTileRows][maxTileColumns];
+static uint8_t shownLevels[maxTileRows][maxTileColumns];
+
+static ObjectCounts currentObjects[maxTrackedObjects];
+static int currentObjectCount = 0;
+static uint16_t currentUntracked = 0;
+static ObjectCounts lastObjects[maxTrackedObjects];
+static int lastObjectCount = 0;
+static uint16_t lastUntracked = 0;
+
+static lv_obj_t *overlay = NULL;
+// オーバーレイ自身の無効化は数えない
+static bool ignoreInvalidations = false;
+
+static const char *objectName(const lv_obj_t *obj) {
+  static const struct {
+    const lv_obj_class_t *objClass;
+    const char *name;
+  } names[] = {
+    {&lv_label_class, "label"},
+    {&lv_btn_class, "btn"},
+    {&lv_btnmatrix_class, "btnmatrix"},
+    {&lv_textarea_class, "textarea"},
+    {&lv_dropdown_class, "dropdown"},
+    {&lv_switch_class, "switch"},
+    {&lv_slider_class, "slider"},
+    {&lv_bar_class, "bar"},
+    {&lv_chart_class, "chart"},
+    {&lv_keyboard_class, "keyboard"},
+    {&lv_msgbox_class, "msgbox"},
+    {&lv_tabview_class, "tabview"},
+  };
+
+  if (lv_obj_get_parent(obj) == NULL) {
+    return "screen";
+  }
+  for (const auto &entry : names) {
+    if (lv_obj_check_type(obj, entry.objClass)) {
+      return entry.name;
+    }
+  }
+  return "obj";
+}
+
+// 領域を含む最も深い子孫を探す。上に描画される子から調べる
+static lv_obj_t *findOwner(lv_obj_t *obj, const lv_area_t *area) {
+  int32_t count = lv_obj_get_child_cnt(obj);
+  for (int32_t i = count - 1; i >= 0; i--) {
+    lv_obj_t *child = lv_obj_get_child(obj, i);
+    if ((child == overlay) || lv_obj_has_flag(child, LV_OBJ_FLAG_HIDDEN)) {
+      continue;
+    }
+    lv_area_t coords;
+    lv_obj_get_coords(child, &coords);
+    lv_coord_t ext = _lv_obj_get_ext_draw_size(child);
+    lv_area_increase(&coords, ext, ext);
+    if (_lv_area_is_in(area, &coords, 0)) {
+      return findOwner(child, area);
+    }
+  }
+  return obj;
+}
+
+static void countObject(const lv_area_t *area) {
+  lv_obj_t *owner = findOwner(lv_layer_top(), area);
+  if (owner == lv_layer_top()) {
+    owner = findOwner(lv_scr_act(), area);
+  }
+
+  for (int i = 0; i < currentObjectCount; i++) {
+    if (currentObjects[i].obj == owner) {
+      lv_obj_get_coords(owner, &currentObjects[i].coords);
+      if (currentObjects[i].count < UINT16_MAX) {
+        currentObjects[i].count++;
+      }
+      return;
+    }
+  }
+
+  if (currentObjectCount < maxTrackedObjects) {
+    ObjectCounts &entry = currentObjects[currentObjectCount++];
+    entry.obj = owner;
+    entry.name = objectName(owner);
+    lv_obj_get_coords(owner, &entry.coords);
+    entry.count = 1;
+  } else if (currentUntracked < UINT16_MAX) {
+    currentUntracked++;
+  }
+}
+
+static void countTiles(const lv_area_t *area, bool redraw) {
+  int x1 = LV_MAX(area->x1, 0) / tileSize;
+  int y1 = LV_MAX(area->y1, 0) / tileSize;
+  int x2 = LV_MIN(area->x2 / tileSize, tileColumns - 1);
+  int y2 = LV_MIN(area->y2 / tileSize, tileRows - 1);
+  for (int y = y1; y <= y2; y++) {
+    for (int x = x1; x <= x2; x++) {
+      uint16_t &count = redraw ? currentTiles[y][x].redraws : currentTiles[y][x].invalidations;
+      if (count < UINT16_MAX) {
+        count++;
+      }
+    }
+  }
+}
+
+static int heatLevel(uint16_t redraws) {
+  if (redraws == 0) {
+    return 0;
+  }
+  return 1 + LV_MIN(redraws, heatMax) * (heatLevels - 2) / heatMax;
+}
+
+static void tileArea(int x, int y, lv_area_t *area) {
+  area->x1 = x * tileSize;
+  area->y1 = y * tileSize;
+  area->x2 = area->x1 + tileSize - 1;
+  area->y2 = area->y1 + tileSize - 1;
+}
+
+// 色が変わるタイルだけを無効化する。オーバーレイ全体を無効化すると全てのタイルが毎秒再描画されてしまう
+static void updateOverlay() {
+  ignoreInvalidations = true;
+  for (int y = 0; y < tileRows; y++) {
+    for (int x = 0; x < tileColumns; x++) {
+      uint8_t level = heatLevel(lastTiles[y][x].redraws);
+      if (level != shownLevels[y][x]) {
+        shownLevels[y][x] = level;
+        lv_area_t area;
+        tileArea(x, y, &area);
+        lv_obj_invalidate_area(overlay, &area);
+      }
+    }
+  }
+  ignoreInvalidations = false;
+}
+
+static void overlay_draw_cb(lv_event_t *e) {
+  lv_draw_ctx_t *draw_ctx = lv_event_get_draw_ctx(e);
+  lv_draw_rect_dsc_t dsc;
+  lv_draw_rect_dsc_init(&dsc);
+  dsc.bg_opa = LV_OPA_50;
+
+  for (int y = 0; y < tileRows; y++) {
+    for (int x = 0; x < tileColumns; x++) {
+      uint8_t level = shownLevels[y][x];
+      if (level == 0) {
+        continue;
+      }
+      lv_area_t area;
+      tileArea(x, y, &area);
+      if (_lv_area_is_on(&area, draw_ctx->clip_area)) {
+        dsc.bg_color = lv_color_mix(lv_palette_main(LV_PALETTE_RED), lv_palette_main(LV_PALETTE_BLUE), level * 255 / (heatLevels - 1));
+        lv_draw_rect(draw_ctx, &dsc, &area);
+      }
+    }
+  }
+}
+
+static void heatmap_timer_cb(lv_timer_t *timer) {
+  memcpy(lastTiles, currentTiles, sizeof(lastTiles));
+  memset(currentTiles, 0, sizeof(currentTiles));
+  memcpy(lastObjects, currentObjects, sizeof(lastObjects));
+  lastObjectCount = currentObjectCount;
+  lastUntracked = currentUntracked;
+  currentObjectCount = 0;
+  currentUntracked = 0;
+
+  if (overlay != NULL) {
+    updateOverlay();
+  }
+}
+
+void redrawHeatmapInit() {
+  lv_disp_t *disp = lv_disp_get_default();
+  tileColumns = LV_MIN((lv_disp_get_hor_res(disp) + tileSize - 1) / tileSize, maxTileColumns);
+  tileRows = LV_MIN((lv_disp_get_ver_res(disp) + tileSize - 1) / tileSize, maxTileRows);
+  lv_timer_create(heatmap_timer_cb, windowPeriod, NULL);
+}
+
+void redrawHeatmapRounder(lv_disp_drv_t *disp_drv, lv_area_t *area) {
+  // 描画中の呼び出しはLVGLが1回に描画できる行数を調べるためのもので、無効化ではない
+  // _lv_refr_get_disp_refreshingは最初の描画の後はNULLに戻らないので、rendering_in_progressで判定する
+  lv_disp_t *disp = lv_disp_get_default();
+  if ((tileColumns == 0) || ignoreInvalidations || ((disp != NULL) && disp->rendering_in_progress)) {
+    return;
+  }
+  countTiles(area, false);
+  countObject(area);
+}
+
+void redrawHeatmapAddRedraw(const lv_area_t *area) {
+  if (tileColumns > 0) {
+    countTiles(area, true);
+  }
+}
+
+void redrawHeatmapShow(bool show) {
+  ignoreInvalidations = true;
+  if (show && (overlay == NULL)) {
+    overlay = lv_obj_create(lv_layer_sys());
+    lv_obj_remove_style_all(overlay);
+    lv_obj_set_size(overlay, LV_PCT(100), LV_PCT(100));
+    lv_obj_clear_flag(overlay, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_event_cb(overlay, overlay_draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+    memset(shownLevels, 0, sizeof(shownLevels));
+  } else if (!show && (overlay != NULL)) {
+    lv_obj_del(overlay);
+    overlay = NULL;
+  }
+  ignoreInvalidations = false;
+}
+
+bool redrawHeatmapShown() {
+  return overlay != NULL;
+}
+
+static int compareObjectCounts(const void *a, const void *b) {
+  return (int)((const ObjectCounts *)b)->count - (int)((const ObjectCounts *)a)->count;
+}
+
+void redrawHeatmapReport(void (*print)(const char *line)) {
+  char line[96];
+  uint32_t invalidations = 0;
+  uint32_t redraws = 0;
+  int hottestX = 0;
+  int hottestY = 0;
+  for (int y = 0; y < tileRows; y++) {
+    for (int x = 0; x < tileColumns; x++) {
+      invalidations += lastTiles[y][x].invalidations;
+      redraws += lastTiles[y][x].redraws;
+      if (lastTiles[y][x].redraws > lastTiles[hottestY][hottestX].redraws) {
+        hottestX = x;
+        hottestY = y;
+      }
+    }
+  }
+  snprintf(line, sizeof(line), "heatmap : tiles/s invalidated %u redrawn %u  hottest (%d,%d) %u/s",
+           invalidations, redraws, hottestX * tileSize, hottestY * tileSize, lastTiles[hottestY][hottestX].redraws);
+  print(line);
+
+  ObjectCounts sorted[maxTrackedObjects];
+  memcpy(sorted, lastObjects, sizeof(sorted));
+  qsort(sorted, lastObjectCount, sizeof(ObjectCounts), compareObjectCounts);
+  for (int i = 0; (i < lastObjectCount) && (i < reportObjects); i++) {
+    const ObjectCounts &entry = sorted[i];
+    snprintf(line, sizeof(line), "  %-9s (%d,%d %dx%d) %u/s%s", entry.name, entry.coords.x1, entry.coords.y1,
+             lv_area_get_width(&entry.coords), lv_area_get_height(&entry.coords), entry.count,
+             (entry.count >= overInvalidationThreshold) ? "  over-invalidated" : "");
+    print(line);
+  }
+  if (lastUntracked > 0) {
+    snprintf(line, sizeof(line), "  (%u/s from untracked objects)", lastUntracked);
+    print(line);
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef REDRAW_HEATMAP_HPP
+#define REDRAW_HEATMAP_HPP
+
+#include <lvgl.h>
+
+// 再描画のヒートマップ(デバッグ用)
+//
+// 画面を16x16のタイルに分け、1秒ごとに各タイルが無効化された回数と再描画された回数を数える
+// 無効化は領域を含む最も深いオブジェクトに割り当て、1秒に何度も無効化されるオブジェクトを
+// 無駄な再描画の候補として報告する
+// オーバーレイを表示すると、再描画の多いタイルほど赤く塗られる
+//
+// ファームウェアではUI_DEBUG_HEATMAPを定義した場合のみ有効にする
+
+// lv_initとディスプレイの登録の後に呼ぶ。1秒ごとの集計用のタイマーを作る
+void redrawHeatmapInit();
+// lv_disp_drv_t::rounder_cbに設定する。無効化された領域を記録する(領域は変更しない)
+void redrawHeatmapRounder(lv_disp_drv_t *disp_drv, lv_area_t *area);
+// flush_cbから呼ぶ。再描画された領域を記録する
+void redrawHeatmapAddRedraw(const lv_area_t *area);
+// オーバーレイの表示、非表示
+void redrawHeatmapShow(bool show);
+bool redrawHeatmapShown();
+// 直前の1秒間の集計を1行ずつprintに渡す
+void redrawHeatmapReport(void (*print)(const char *line));
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include "sensor_history.hpp"
+
+SensorHistory::SensorHistory(uint32_t capacity) {
+  uint32_t largest = blockSize(levelCount - 1);
+  sampleCapacity = (capacity + largest - 1) / largest * largest;
+}
+
+SensorHistory::~SensorHistory() {
+  free(samples);
+  for (int level = 0; level < levelCount; level++) {
+    free(blockMins[level]);
+    free(blockMaxs[level]);
+  }
+}
+
+// ESP32のArduinoでは4096バイトを超えるmallocはPSRAMに置かれる
+bool SensorHistory::begin() {
+  if (samples != NULL) {
+    return true;
+  }
+  samples = (int16_t *)malloc(sampleCapacity * sizeof(int16_t));
+  bool allocated = (samples != NULL);
+  for (int level = 0; level < levelCount; level++) {
+    uint32_t blocks = sampleCapacity / blockSize(level);
+    blockMins[level] = (int16_t *)malloc(blocks * sizeof(int16_t));
+    blockMaxs[level] = (int16_t *)malloc(blocks * sizeof(int16_t));
+    allocated = allocated && (blockMins[level] != NULL) && (blockMaxs[level] != NULL);
+  }
+  if (!allocated) {
+    free(samples);
+    samples = NULL;
+    for (int level = 0; level < levelCount; level++) {
+      free(blockMins[level]);
+      free(blockMaxs[level]);
+      blockMins[level] = NULL;
+      blockMaxs[level] = NULL;
+    }
+    return false;
+  }
+  total = 0;
+  return true;
+}
+
+// 容量はブロックの大きさの倍数なので、新しいブロックが始まる時にちょうど同じ位置の古いブロックが消える
+void SensorHistory::add(int16_t value) {
+  if (samples == NULL) {
+    return;
+  }
+  samples[total % sampleCapacity] = value;
+  for (int level = 0; level < levelCount; level++) {
+    uint32_t size = blockSize(level);
+    uint32_t block = (total / size) % (sampleCapacity / size);
+    if ((total & (size - 1)) == 0) {
+      blockMins[level][block] = INT16_MAX;
+      blockMaxs[level][block] = INT16_MIN;
+    }
+    if (value != noValue) {
+      if (value < blockMins[level][block]) {
+        blockMins[level][block] = value;
+      }
+      if (value > blockMaxs[level][block]) {
+        blockMaxs[level][block] = value;
+      }
+    }
+  }
+  total++;
+}
+
+// 範囲の端では標本や小さいブロックを、中ほどでは範囲に収まる最も大きいブロックを使う
+// 範囲に完全に含まれるブロックは、先頭の標本が残っていれば上書きされていない
+bool SensorHistory::minMax(uint32_t from, uint32_t to, int16_t *min, int16_t *max) const {
+  if (samples == NULL) {
+    return false;
+  }
+  if (from < first()) {
+    from = first();
+  }
+  if (to > total) {
+    to = total;
+  }
+
+  int16_t low = INT16_MAX;
+  int16_t high = INT16_MIN;
+  uint32_t i = from;
+  while (i < to) {
+    int level = levelCount - 1;
+    while ((level >= 0) && (((i & (blockSize(level) - 1)) != 0) || (to - i < blockSize(level)))) {
+      level--;
+    }
+    int16_t blockMin;
+    int16_t blockMax;
+    if (level < 0) {
+      blockMin = samples[i % sampleCapacity];
+      blockMax = blockMin;
+      i++;
+      if (blockMin == noValue) {
+        continue;
+      }
+    } else {
+      uint32_t size = blockSize(level);
+      uint32_t block = (i / size) % (sampleCapacity / size);
+      blockMin = blockMins[level][block];
+      blockMax = blockMaxs[level][block];
+      i += size;
+    }
+    if (blockMin < low) {
+      low = blockMin;
+    }
+    if (blockMax > high) {
+      high = blockMax;
+    }
+  }
+
+  if (low > high) {
+    return false;
+  }
+  *min = low;
+  *max = high;
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef SENSOR_HISTORY_HPP
+#define SENSOR_HISTORY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// センサの値の履歴
+//
+// 一定の周期で記録した値を固定容量のリングバッファに置き、古いものから上書きする
+// 標本には追加した順に番号を付け、範囲は番号で指定する
+// 8, 64, 512, 4096個ごとのブロックの最小値と最大値を記録しておき、任意の範囲の最小値と最大値を
+// 範囲の長さによらずほぼ一定の手間で求める(グラフの列ごとの間引きに使う)
+//
+class SensorHistory {
+public:
+  static const int16_t noValue = INT16_MIN;  // 値が無い(センサが準備できていない)
+  static const int levelCount = 4;
+  static const int levelShift = 3;           // ブロックは下の段の8個分
+
+  // capacityは最も大きいブロック(4096個)の倍数に切り上げる。メモリはbeginで確保する
+  explicit SensorHistory(uint32_t capacity);
+  ~SensorHistory();
+
+  // 履歴のメモリを確保する。確保できなければfalse
+  bool begin();
+
+  void add(int16_t value);
+
+  uint32_t capacity() const { return sampleCapacity; }
+  // 残っている最も古い標本の番号
+  uint32_t first() const { return (total > sampleCapacity) ? total - sampleCapacity : 0; }
+  // 次に追加する標本の番号
+  uint32_t end() const { return total; }
+
+  // 番号が[from, to)の標本の最小値と最大値。値が1つも無ければfalse
+  bool minMax(uint32_t from, uint32_t to, int16_t *min, int16_t *max) const;
+
+private:
+  static uint32_t blockSize(int level) { return 1UL << (levelShift * (level + 1)); }
+
+  uint32_t sampleCapacity;
+  uint32_t total = 0;
+  int16_t *samples = NULL;
+  int16_t *blockMins[levelCount] = {NULL};
+  int16_t *blockMaxs[levelCount] = {NULL};
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "settings.hpp"
+
+// WiFi
+char ssid[33] = {0};
+char pass[65] = {0};
+
+// Mobile
+int gsmPort = gsmPortNone;
+char apn[32] = {0};
+char apnUser[32] = {0};
+char apnPass[32] = {0};
+
+// MQTT
+char url[64] = {0};
+int port = 0;
+bool tls = true;
+char clientId[32] = {0};
+char topic[32] = {0};
+
+// Cert
+char *rootCA = NULL;
+char *cert = NULL;
+char *key = NULL;
+
+// NTP
+int ntpServerIndex = 0;
+
+// BLE
+bool scanEnable = true;
+bool activeScan = false;
+int rssiThreshold = -100;
+
+// Sensors
+int timerIntervalIndex = 0;
+int portAType = 0;
+
+static const char *gsmPorts = "None\nPortA";
+static const char *ntpServers = "ntp.nict.jp\nntp.jst.mfeed.ad.jp";  // main.cppのntpServerListと同じ順番
+static const char *timerIntervals = "None\n10 min\n30 min\n60 min";
+static const char *supportedUnits = "None\nGPS\nENV IV Unit";
+
+// 以前はタイマーの周期(us)をint32_tに切り詰めて保存していたので、同じ値で保存する
+static const int32_t timerIntervalValues[] = {0, 600000000, 1800000000, (int32_t)3600000000u};
+
+static constexpr SettingDescriptor stringSetting(const char *key, const char *label, uint8_t widget, char *value, uint16_t size) {
+  return {key, label, SETTING_STRING, widget, value, size, 0, 0, 0, NULL, NULL, NULL};
+}
+
+static constexpr SettingDescriptor fileSetting(const char *key, const char *label, char **value) {
+  return {key, label, SETTING_TEXT, WIDGET_FILE, value, 0, 0, 0, 0, NULL, NULL, NULL};
+}
+
+static constexpr SettingDescriptor intSetting(const char *key, const char *label, uint8_t widget, int *value, int32_t min, int32_t max, int32_t defaultValue) {
+  return {key, label, SETTING_INT, widget, value, 0, min, max, defaultValue, NULL, NULL, NULL};
+}
+
+static constexpr SettingDescriptor choiceSetting(const char *key, const char *label, int *value, const char *options, int32_t optionCount, const int32_t *optionValues = NULL, bool (*disabled)() = NULL) {
+  return {key, label, SETTING_INT, WIDGET_DROPDOWN, value, 0, 0, optionCount - 1, 0, options, optionValues, disabled};
+}
+
+static constexpr SettingDescriptor boolSetting(const char *key, const char *label, bool *value, bool defaultValue) {
+  return {key, label, SETTING_BOOL, WIDGET_SWITCH, value, 0, 0, 1, defaultValue, NULL, NULL, NULL};
+}
+
+// Port AはGSMモジュールが使っている場合は選べない
+static bool portAUsedByModem() {
+  return gsmPort == gsmPortA;
+}
+
+// キーは以前のPreferencesのキーと同じにする
+static const SettingDescriptor wifiSettings[] = {
+  stringSetting("ssid", "SSID", WIDGET_SSID, ssid, sizeof(ssid)),
+  stringSetting("pass", "PASS", WIDGET_PASSWORD, pass, sizeof(pass)),
+};
+
+static const SettingDescriptor gsmSettings[] = {
+  choiceSetting("apnPort", "PORT", &gsmPort, gsmPorts, 2),
+  stringSetting("apn", "APN", WIDGET_TEXTAREA, apn, sizeof(apn)),
+  stringSetting("apnUser", "USER", WIDGET_TEXTAREA, apnUser, sizeof(apnUser)),
+  stringSetting("apnPass", "PASS", WIDGET_TEXTAREA, apnPass, sizeof(apnPass)),
+};
+
+static const SettingDescriptor mqttSettings[] = {
+  stringSetting("url", "URL", WIDGET_TEXTAREA, url, sizeof(url)),
+  intSetting("port", "PORT", WIDGET_NUMBER, &port, 0, 65535, 0),
+  boolSetting("tls", "TLS", &tls, true),
+  stringSetting("clientId", "ID", WIDGET_TEXTAREA, clientId, sizeof(clientId)),
+  stringSetting("topic", "TOPIC", WIDGET_TEXTAREA, topic, sizeof(topic)),
+};
+
+static const SettingDescriptor certSettings[] = {
+  fileSetting("rootCA", "Root", &rootCA),
+  fileSetting("cert", "Cert", &cert),
+  fileSetting("key", "Key", &key),
+};
+
+static const SettingDescriptor ntpSettings[] = {
+  choiceSetting("ntp", "URL", &ntpServerIndex, ntpServers, 2),
+};
+
+static const SettingDescriptor bluetoothSettings[] = {
+  boolSetting("scanEnable", "Scan", &scanEnable, true),
+  boolSetting("activeScan", "Active", &activeScan, false),
+  intSetting("rssiThreshold", "RSSI", WIDGET_SLIDER, &rssiThreshold, -120, 0, -100),
+};
+
+static const SettingDescriptor sensorsSettings[] = {
+  choiceSetting("timerInterval", "Timer", &timerIntervalIndex, timerIntervals, 4, timerIntervalValues),
+  choiceSetting("portA", "Port A", &portAType, supportedUnits, 3, NULL, portAUsedByModem),
+};
+
+#define SETTINGS(settings) settings, sizeof(settings) / sizeof(settings[0])
+
+const SettingGroup settingGroups[] = {
+  {SETTING_PAGE_CONNECTION, "WiFi", "SSID and Password", SETTINGS(wifiSettings), applyWifiSettings},
+  {SETTING_PAGE_CONNECTION, "Mobile", "GSM settings", SETTINGS(gsmSettings), applyGsmSettings},
+  {SETTING_PAGE_CONNECTION, "MQTT", "MQTT settings", SETTINGS(mqttSettings), applyMqttSettings},
+  {SETTING_PAGE_CONNECTION, "Cert", "Certification files", SETTINGS(certSettings), applyCertSettings},
+  {SETTING_PAGE_CONNECTION, "NTP", "NTP server", SETTINGS(ntpSettings), applyNtpSettings},
+  {SETTING_PAGE_BLUETOOTH, "Bluetooth", "Bluetooth settings", SETTINGS(bluetoothSettings), NULL},
+  {SETTING_PAGE_SENSORS, "Sensors", "Sensors settings", SETTINGS(sensorsSettings), applySensorsSettings},
+};
+const int settingGroupCount = sizeof(settingGroups) / sizeof(settingGroups[0]);
+
+static_assert(sizeof(settingGroups) / sizeof(settingGroups[0]) <= maxSettingGroups, "maxSettingGroups is too small");
+static_assert(sizeof(mqttSettings) / sizeof(mqttSettings[0]) <= maxGroupSettings, "maxGroupSettings is too small");
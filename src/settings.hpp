@@ -0,0 +1,129 @@
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// 設定項目の表
+//
+// 設定はsettings.cppの表に1項目1行で書く。設定タブの入力部品(ui.cpp)と
+// 不揮発メモリへの読み書き(settings_nvs.cpp)は表から作るので、項目を増やす時は値の変数と表の行を追加するだけでよい
+//
+
+// 値の型
+enum {
+  SETTING_STRING = 0,  // char[size]
+  SETTING_TEXT,        // ヒープに確保したchar *。証明書などの長い文字列
+  SETTING_INT,         // int
+  SETTING_BOOL,        // bool
+};
+
+// 入力部品
+enum {
+  WIDGET_TEXTAREA = 0,
+  WIDGET_PASSWORD,
+  WIDGET_NUMBER,    // 数字だけのテキストエリア
+  WIDGET_SWITCH,
+  WIDGET_SLIDER,    // 値のラベル付き
+  WIDGET_DROPDOWN,  // optionsから選び、選択肢の番号を値にする
+  WIDGET_SSID,      // WiFiをスキャンして選び、SSIDを値にする
+  WIDGET_FILE,      // SDカードのファイルを選び、ファイルの内容を値にする
+};
+
+// 設定を表示するタブ
+enum {
+  SETTING_PAGE_CONNECTION = 0,
+  SETTING_PAGE_BLUETOOTH,
+  SETTING_PAGE_SENSORS,
+};
+
+struct SettingDescriptor {
+  const char *key;              // 不揮発メモリのキー(15文字以内)
+  const char *label;            // 画面の項目名
+  uint8_t type;
+  uint8_t widget;
+  void *value;                  // 値の変数
+  uint16_t size;                // SETTING_STRINGのバッファの大きさ
+  int32_t min;                  // SETTING_INTの範囲
+  int32_t max;
+  int32_t defaultValue;         // SETTING_INT/SETTING_BOOLの初期値。文字列の初期値は空
+  const char *options;          // WIDGET_DROPDOWNの選択肢("\n"区切り)
+  const int32_t *optionValues;  // 選択肢ごとに保存する値。NULLなら選択肢の番号を保存する
+  bool (*disabled)();           // trueを返す場合は入力できない。NULLなら常に入力できる
+};
+
+// 保存ボタン1つでまとめて保存する設定
+struct SettingGroup {
+  uint8_t page;
+  const char *title;
+  const char *confirmText;  // 保存の確認ダイアログ
+  const SettingDescriptor *settings;
+  uint8_t count;
+  void (*apply)();          // 保存ボタンで入力値を変数に書き込んだ後に呼ぶ。NULLなら何もしない
+};
+
+static const int maxSettingGroups = 8;
+static const int maxGroupSettings = 8;
+
+extern const SettingGroup settingGroups[];
+extern const int settingGroupCount;
+
+//
+// 設定値
+//
+
+// WiFi
+extern char ssid[33];
+extern char pass[65];
+
+// Mobile
+static const int gsmPortNone = 0;
+static const int gsmPortA = 1;
+
+extern int gsmPort;
+extern char apn[32];
+extern char apnUser[32];
+extern char apnPass[32];
+
+// MQTT
+extern char url[64];
+extern int port;
+extern bool tls;
+extern char clientId[32];
+extern char topic[32];
+
+// Cert
+extern char *rootCA;
+extern char *cert;
+extern char *key;
+
+// NTP 選択肢の番号
+extern int ntpServerIndex;
+
+// BLE
+extern bool scanEnable;
+extern bool activeScan;
+extern int rssiThreshold;
+
+// Sensors 選択肢の番号
+extern int timerIntervalIndex;
+extern int portAType;
+
+// 不揮発メモリから全ての設定を読み込む。保存されていない項目は初期値にする
+void loadSettings();
+// グループの設定を1回のトランザクションで保存する。変わっていない項目は書き込まない
+bool saveSettings(const SettingGroup &group);
+
+//
+// 保存ボタンで入力値を反映した後に呼ばれる処理
+// ファームウェアではmain.cpp、シミュレータではsim/sim_app.cppで実装する
+//
+void applyWifiSettings();
+void applyGsmSettings();
+void applyMqttSettings();
+void applyCertSettings();
+void applyNtpSettings();
+void applySensorsSettings();
+
+#endif
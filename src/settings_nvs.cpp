@@ -0,0 +1,185 @@
+//
+// 設定の不揮発メモリへの読み書き
+//
+// 以前のPreferencesと同じ名前空間、キー、型(int: i32、bool: u8、文字列: str)で保存するので、保存済みの設定をそのまま読める
+// Preferencesはput*のたびにコミットするので、保存ボタン1回で項目の数だけコミットしていた
+// ここではグループの項目を1回のnvs_open/nvs_commitで保存し、値が変わっていない項目は書き込まない
+//
+#include <Arduino.h>
+#include <nvs.h>
+#include <esp_timer.h>
+
+#include "settings.hpp"
+
+static const char *TAG = "settings";
+static const char *settingsNamespace = "m5core2_app";
+
+// 変数の値から保存する値を作る
+static int32_t storedInt(const SettingDescriptor &setting) {
+  int value = *(int *)setting.value;
+  if (setting.optionValues != NULL) {
+    return setting.optionValues[value];
+  }
+  return value;
+}
+
+// 保存されていた値から変数の値を作る。範囲外の値は初期値にする
+static int loadedInt(const SettingDescriptor &setting, int32_t stored) {
+  if (setting.optionValues != NULL) {
+    for (int32_t i = setting.min; i <= setting.max; i++) {
+      if (setting.optionValues[i] == stored) {
+        return i;
+      }
+    }
+    return setting.defaultValue;
+  }
+  if ((stored < setting.min) || (stored > setting.max)) {
+    return setting.defaultValue;
+  }
+  return stored;
+}
+
+// SETTING_TEXTの値をPSRAMに読み込む
+static char *loadText(nvs_handle_t handle, const char *key) {
+  size_t length = 0;
+  if ((nvs_get_str(handle, key, NULL, &length) != ESP_OK) || (length <= 1)) {
+    return NULL;
+  }
+  char *text = (char *)ps_malloc(length);
+  if ((text != NULL) && (nvs_get_str(handle, key, text, &length) != ESP_OK)) {
+    free(text);
+    text = NULL;
+  }
+  return text;
+}
+
+static void loadSetting(nvs_handle_t handle, bool opened, const SettingDescriptor &setting) {
+  switch (setting.type) {
+    case SETTING_STRING: {
+      char *value = (char *)setting.value;
+      size_t length = setting.size;
+      if (!opened || (nvs_get_str(handle, setting.key, value, &length) != ESP_OK)) {
+        value[0] = '\0';
+      }
+      break;
+    }
+    case SETTING_TEXT:
+      *(char **)setting.value = opened ? loadText(handle, setting.key) : NULL;
+      break;
+    case SETTING_INT: {
+      int32_t stored;
+      if (opened && (nvs_get_i32(handle, setting.key, &stored) == ESP_OK)) {
+        *(int *)setting.value = loadedInt(setting, stored);
+      } else {
+        *(int *)setting.value = setting.defaultValue;
+      }
+      break;
+    }
+    case SETTING_BOOL: {
+      uint8_t stored;
+      if (opened && (nvs_get_u8(handle, setting.key, &stored) == ESP_OK)) {
+        *(bool *)setting.value = (stored != 0);
+      } else {
+        *(bool *)setting.value = (setting.defaultValue != 0);
+      }
+      break;
+    }
+  }
+}
+
+void loadSettings() {
+  nvs_handle_t handle = 0;
+  // 初めて起動した時は名前空間が無いので開けない。全て初期値にする
+  bool opened = (nvs_open(settingsNamespace, NVS_READONLY, &handle) == ESP_OK);
+  for (int g = 0; g < settingGroupCount; g++) {
+    const SettingGroup &group = settingGroups[g];
+    for (int i = 0; i < group.count; i++) {
+      loadSetting(handle, opened, group.settings[i]);
+    }
+  }
+  if (opened) {
+    nvs_close(handle);
+  }
+}
+
+// 保存されている文字列と同じならtrue
+static bool sameString(nvs_handle_t handle, const char *key, const char *value) {
+  size_t length = 0;
+  if (nvs_get_str(handle, key, NULL, &length) != ESP_OK) {
+    return false;
+  }
+  if (length != strlen(value) + 1) {
+    return false;
+  }
+  char *stored = (char *)malloc(length);
+  if (stored == NULL) {
+    return false;
+  }
+  bool same = (nvs_get_str(handle, key, stored, &length) == ESP_OK) && (strcmp(stored, value) == 0);
+  free(stored);
+  return same;
+}
+
+// 値が変わっていれば書き込む。書き込んだらwrittenを増やす
+static esp_err_t saveSetting(nvs_handle_t handle, const SettingDescriptor &setting, int *written) {
+  esp_err_t err = ESP_OK;
+  switch (setting.type) {
+    case SETTING_STRING:
+    case SETTING_TEXT: {
+      const char *value = (setting.type == SETTING_STRING) ? (const char *)setting.value : *(char **)setting.value;
+      if (value == NULL) {
+        value = "";
+      }
+      if (!sameString(handle, setting.key, value)) {
+        err = nvs_set_str(handle, setting.key, value);
+        (*written)++;
+      }
+      break;
+    }
+    case SETTING_INT: {
+      int32_t value = storedInt(setting);
+      int32_t stored;
+      if ((nvs_get_i32(handle, setting.key, &stored) != ESP_OK) || (stored != value)) {
+        err = nvs_set_i32(handle, setting.key, value);
+        (*written)++;
+      }
+      break;
+    }
+    case SETTING_BOOL: {
+      uint8_t value = *(bool *)setting.value ? 1 : 0;
+      uint8_t stored;
+      if ((nvs_get_u8(handle, setting.key, &stored) != ESP_OK) || (stored != value)) {
+        err = nvs_set_u8(handle, setting.key, value);
+        (*written)++;
+      }
+      break;
+    }
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "%s : %s", setting.key, esp_err_to_name(err));
+  }
+  return err;
+}
+
+bool saveSettings(const SettingGroup &group) {
+  int64_t start = esp_timer_get_time();
+
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(settingsNamespace, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "nvs_open : %s", esp_err_to_name(err));
+    return false;
+  }
+
+  int written = 0;
+  for (int i = 0; (i < group.count) && (err == ESP_OK); i++) {
+    err = saveSetting(handle, group.settings[i], &written);
+  }
+  if ((err == ESP_OK) && (written > 0)) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  ESP_LOGD(TAG, "%s : %d/%d written in %lld us", group.title, written, group.count, esp_timer_get_time() - start);
+  return err == ESP_OK;
+}
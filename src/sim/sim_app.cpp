@@ -0,0 +1,42 @@
+//
+// シミュレータ用のUIからの操作
+// 無線や不揮発メモリは無いので、設定値は保存しない
+//
+#include <stdio.h>
+#include <lvgl.h>
+
+#include "../ui.hpp"
+#include "../settings.hpp"
+
+void scanWifi(lv_obj_t *dropdown) {
+  lv_dropdown_set_options(dropdown, "sim-ap-1\nsim-ap-2\nsim-ap-3");
+}
+
+char *readSettingFile(const char *path) {
+  return NULL;
+}
+
+void loadSettings() {
+}
+
+bool saveSettings(const SettingGroup &group) {
+  return true;
+}
+
+void applyWifiSettings() {
+}
+
+void applyGsmSettings() {
+}
+
+void applyMqttSettings() {
+}
+
+void applyCertSettings() {
+}
+
+void applyNtpSettings() {
+}
+
+void applySensorsSettings() {
+}
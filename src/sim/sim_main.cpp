@@ -0,0 +1,604 @@
+//
+// ホスト(PC)上で画面を描画するシミュレータ
+// 実機と同じUIをメモリ上のフレームバッファに描画し、決められた操作を順に再生して
+// 操作ごとの描画時間と転送画素数を計測する
+//
+// 使い方
+//   pio run -e native
+//   .pio/build/native/program --write-baseline src/sim/baseline.txt  基準値を保存する
+//   .pio/build/native/program --baseline src/sim/baseline.txt        基準値と比較する(悪化したら終了コード1、読めなければ2)
+//   .pio/build/native/program --bench-blend                          描画カーネルの速度をLVGLの処理と比較する
+//   .pio/build/native/program --heatmap                              操作ごとに無効化と再描画の集計を出力する
+//
+// 基準値は計測するPCに依存するのでリポジトリには含めない。比較する前に、基準にするコミットで--write-baselineを実行して作る
+// --baselineを付けなければ比較せず、常に終了コード0になる
+//
+// タッチから画面への反映までの時間(touch-to-photon)も計測する。時計は仮想時刻(フレームごとに進む)に
+// フレーム内で実際にかかった時間を足したもので、p90を基準値と比較する
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <lvgl.h>
+
+#include "../ui.hpp"
+#include "../settings.hpp"
+#include "../perf_stats.hpp"
+#include "lv_mem_psram.h"
+#include "../disp_fill.hpp"
+#include "../blend565.hpp"
+#include "../redraw_heatmap.hpp"
+#include "../device_list.hpp"
+#include "../sensor_history.hpp"
+#include "../touch_latency.hpp"
+#include "../cache_budget.hpp"
+#include "../glyph_index.hpp"
+#include "../glyph_cache.hpp"
+
+// ui.cppの診断タブが参照する
+PerfStats perfStats;
+
+// ui.cppのデバイスタブが参照する。容量より多いデバイスを入れて、入れ替えも再生する
+DeviceList deviceList(2048);
+static const int simDeviceCount = 3000;
+static const int deviceUpdatesPerFrame = 50;
+static uint32_t simRandom = 1;
+
+// ui.cppのホームタブのグラフが参照する。実機と同じ10秒周期の3日分を入れておく
+static const int historySamplesPerDay = 8640;
+SensorHistory temperatureHistory(3 * historySamplesPerDay);
+SensorHistory humidityHistory(3 * historySamplesPerDay);
+
+static const uint16_t screenWidth = 320;
+static const uint16_t screenHeight = 240;
+static const uint16_t bandHeight = 20;        // 実機の帯バッファと同じ高さ
+static const uint32_t frameMillis = LV_DISP_DEF_REFR_PERIOD;
+static const int settleFrames = 30;           // 操作後にアニメーションが終わるまで待つフレーム数
+static const int dragFrames = 10;             // ドラッグ1回にかけるフレーム数
+
+// 基準値との比較の許容幅
+static const double pixelTolerance = 0.05;    // 画素数は決定的なので小さく
+static const double timeTolerance = 0.50;     // 時間はホストの負荷で揺れるので大きく
+static const uint32_t timeFloorMicros = 200;  // これより短い平均時間は比較しない
+static const char *latencyBaselineName = "touch_to_photon_p90";
+
+// 画面の下にあるタブボタンの中心(6個を均等割り)
+static const lv_coord_t tabButtonY = screenHeight - 25;
+#define TAB_BUTTON_X(index) ((lv_coord_t)(screenWidth / 12 + (index) * screenWidth / 6))
+
+static lv_disp_draw_buf_t drawBuf;
+static lv_color_t drawBuffer[screenWidth * bandHeight];
+static lv_color_t frameBuffer[screenWidth * screenHeight];
+
+// 再生中の入力
+static lv_coord_t touchX = 0;
+static lv_coord_t touchY = 0;
+static bool touchPressed = false;
+static bool touchPressPending = false;  // 押した時刻をまだtouch_latencyに渡していない
+static int64_t touchPressMicros = 0;
+
+// 仮想時刻。runFrameの開始時の値と、その時のホストの時刻
+static int64_t virtualMicros = 0;
+static std::chrono::steady_clock::time_point frameStart;
+
+// フレーム内の経過時間を足した仮想時刻
+static int64_t simMicros() {
+  return virtualMicros + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frameStart).count();
+}
+
+// 1操作の計測値
+struct StepStats {
+  Histogram handlerMicros;
+  uint32_t pixels = 0;
+  uint32_t fillPixels = 0;  // うち単色の塗りつぶしとして送った画素数
+  uint32_t areas = 0;
+};
+
+static StepStats *currentStats = nullptr;
+static bool heatmap = false;
+
+static void disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) {
+  uint32_t w = (area->x2 - area->x1 + 1);
+  uint32_t h = (area->y2 - area->y1 + 1);
+
+  if (heatmap) {
+    redrawHeatmapAddRedraw(area);
+  }
+
+  // 実機と同じく、単色で塗りつぶされた行は描画バッファを使わずに埋める
+  lv_coord_t y = area->y1;
+  while (y <= area->y2) {
+    bool fill;
+    lv_color_t color;
+    int rows = dispFillTakeRows(disp, area, y, &fill, &color);
+    for (int i = 0; i < rows; i++, y++) {
+      lv_color_t *dest = &frameBuffer[y * screenWidth + area->x1];
+      if (fill) {
+        lv_color_fill(dest, color, w);
+      } else {
+        memcpy(dest, &color_p[(y - area->y1) * w], w * sizeof(lv_color_t));
+      }
+    }
+    if (fill && (currentStats != nullptr)) {
+      currentStats->fillPixels += w * rows;
+    }
+  }
+
+  if (currentStats != nullptr) {
+    currentStats->pixels += w * h;
+    currentStats->areas++;
+  }
+
+  touchLatencyFlushed(lv_disp_flush_is_last(disp), simMicros());
+  lv_disp_flush_ready(disp);
+}
+
+// タッチの状態を変える。押した時は、その時刻を記録する
+static void setTouch(bool pressed) {
+  if (pressed && !touchPressed) {
+    touchPressMicros = virtualMicros;
+    touchPressPending = true;
+  }
+  touchPressed = pressed;
+}
+
+static void touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data) {
+  touchLatencyRead(indev_driver);
+  if (touchPressed && touchPressPending) {
+    touchLatencyPress(touchPressMicros);
+    touchPressPending = false;
+  }
+  data->point.x = touchX;
+  data->point.y = touchY;
+  data->state = touchPressed ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+}
+
+// 1フレーム進める
+static void runFrame() {
+  lv_tick_inc(frameMillis);
+  virtualMicros += frameMillis * 1000;
+
+  auto start = std::chrono::steady_clock::now();
+  frameStart = start;
+  lv_timer_handler();
+  auto end = std::chrono::steady_clock::now();
+
+  if (currentStats != nullptr) {
+    currentStats->handlerMicros.add((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+  }
+}
+
+static void runFrames(int frames) {
+  for (int i = 0; i < frames; i++) {
+    runFrame();
+  }
+}
+
+static void tap(lv_coord_t x, lv_coord_t y) {
+  touchX = x;
+  touchY = y;
+  setTouch(true);
+  runFrames(2);
+  setTouch(false);
+  runFrames(1);
+}
+
+static void drag(lv_coord_t x0, lv_coord_t y0, lv_coord_t x1, lv_coord_t y1) {
+  touchX = x0;
+  touchY = y0;
+  setTouch(true);
+  for (int i = 0; i <= dragFrames; i++) {
+    touchX = x0 + (x1 - x0) * i / dragFrames;
+    touchY = y0 + (y1 - y0) * i / dragFrames;
+    runFrame();
+  }
+  setTouch(false);
+  runFrames(1);
+}
+
+// 画面内に見えているclassのindex番目のオブジェクトを探す
+static lv_obj_t *findVisible(lv_obj_t *parent, const lv_obj_class_t *objClass, int *index) {
+  uint32_t count = lv_obj_get_child_cnt(parent);
+  for (uint32_t i = 0; i < count; i++) {
+    lv_obj_t *child = lv_obj_get_child(parent, i);
+    if (lv_obj_has_flag(child, LV_OBJ_FLAG_HIDDEN)) {
+      continue;
+    }
+    if (lv_obj_check_type(child, objClass) && lv_obj_is_visible(child)) {
+      if ((*index)-- == 0) {
+        return child;
+      }
+    }
+    lv_obj_t *found = findVisible(child, objClass, index);
+    if (found != nullptr) {
+      return found;
+    }
+  }
+  return nullptr;
+}
+
+// 決定的な疑似乱数(xorshift)
+static uint32_t nextRandom() {
+  simRandom ^= simRandom << 13;
+  simRandom ^= simRandom >> 17;
+  simRandom ^= simRandom << 5;
+  return simRandom;
+}
+
+// 0からcount-1番目の疑似デバイスを受信したことにする
+static void updateSimDevices(int count, int updates) {
+  uint32_t now = lv_tick_get();
+  for (int i = 0; i < updates; i++) {
+    uint32_t id = nextRandom() % count;
+    uint8_t address[bluetoothAddressBytes] = {(uint8_t)id, (uint8_t)(id >> 8), 0x00, 0xa0, 0x50, 0xc4};
+    deviceList.update(address, -30 - (int)(nextRandom() % 70), now);
+  }
+}
+
+// 1日周期で変化する温度と湿度を記録したことにする
+static void addSimHistory(int samples) {
+  for (int i = 0; i < samples; i++) {
+    int32_t t = temperatureHistory.end() % historySamplesPerDay;
+    int32_t wave = (t < historySamplesPerDay / 2) ? t : historySamplesPerDay - t;
+    temperatureHistory.add((int16_t)(200 + wave * 100 / (historySamplesPerDay / 2) + (int32_t)(nextRandom() % 7) - 3));
+    humidityHistory.add((int16_t)(700 - wave * 300 / (historySamplesPerDay / 2) + (int32_t)(nextRandom() % 11) - 5));
+  }
+}
+
+static bool tapObject(const lv_obj_class_t *objClass, int index) {
+  lv_obj_t *obj = findVisible(lv_scr_act(), objClass, &index);
+  if (obj == nullptr) {
+    return false;
+  }
+
+  lv_area_t coords;
+  lv_obj_get_coords(obj, &coords);
+  tap((coords.x1 + coords.x2) / 2, (coords.y1 + coords.y2) / 2);
+  return true;
+}
+
+//
+// 再生する操作
+//
+enum StepType {
+  STEP_WAIT,
+  STEP_TAP,
+  STEP_TAP_TEXTAREA,
+  STEP_DRAG,
+  STEP_TAP_BUTTON,      // 見えているx0番目のボタンを押す
+  STEP_PRESS_BUTTON,    // 見えているx0番目のボタンを押し、touch-to-photonが計測されたことを確かめる
+  STEP_ADD_HISTORY,     // 1フレームごとに履歴に標本を追加する
+  STEP_UPDATE_DEVICES,  // 1フレームごとにデバイスの一覧を更新する
+};
+
+struct Step {
+  const char *name;
+  StepType type;
+  lv_coord_t x0, y0, x1, y1;
+  int repeat;
+};
+
+static const Step steps[] = {
+  {"boot",            STEP_WAIT,         0, 0, 0, 0, 1},
+  {"chart_zoom_out",  STEP_TAP_BUTTON,   1, 0, 0, 0, 4},
+  {"chart_pan",       STEP_DRAG,         60, 130, 200, 130, 6},
+  {"chart_zoom_in",   STEP_TAP_BUTTON,   0, 0, 0, 0, 2},
+  {"chart_update",    STEP_ADD_HISTORY,  0, 0, 0, 0, 120},
+  {"tab_connection",  STEP_TAP,          TAB_BUTTON_X(1), tabButtonY, 0, 0, 1},
+  {"keyboard_open",   STEP_TAP_TEXTAREA, 0, 0, 0, 0, 1},
+  {"keyboard_close",  STEP_TAP,          screenWidth - 10, 10, 0, 0, 1},
+  {"scroll_down",     STEP_DRAG,         160, 170, 160, 30, 6},
+  {"scroll_up",       STEP_DRAG,         160, 30, 160, 170, 6},
+  {"tab_bluetooth",   STEP_TAP,          TAB_BUTTON_X(2), tabButtonY, 0, 0, 1},
+  {"tab_sensors",     STEP_TAP,          TAB_BUTTON_X(3), tabButtonY, 0, 0, 1},
+  {"tab_diagnostics", STEP_TAP,          TAB_BUTTON_X(4), tabButtonY, 0, 0, 1},
+  {"tab_devices",     STEP_TAP,          TAB_BUTTON_X(5), tabButtonY, 0, 0, 1},
+  {"devices_scroll",  STEP_DRAG,         160, 170, 160, 40, 6},
+  {"devices_update",  STEP_UPDATE_DEVICES, 0, 0, 0, 0, 60},
+  {"tab_home",        STEP_TAP,          TAB_BUTTON_X(0), tabButtonY, 0, 0, 1},
+  {"button_press",    STEP_PRESS_BUTTON, 0, 0, 0, 0, 1},
+};
+static const int stepCount = sizeof(steps) / sizeof(steps[0]);
+
+static bool runStep(const Step &step) {
+  for (int i = 0; i < step.repeat; i++) {
+    switch (step.type) {
+    case STEP_WAIT:
+      break;
+    case STEP_TAP:
+      tap(step.x0, step.y0);
+      break;
+    case STEP_TAP_TEXTAREA:
+      if (!tapObject(&lv_textarea_class, 0)) {
+        fprintf(stderr, "%s: no visible textarea\n", step.name);
+        return false;
+      }
+      break;
+    case STEP_DRAG:
+      drag(step.x0, step.y0, step.x1, step.y1);
+      break;
+    case STEP_TAP_BUTTON:
+      if (!tapObject(&lv_btn_class, step.x0)) {
+        fprintf(stderr, "%s: no visible button\n", step.name);
+        return false;
+      }
+      break;
+    case STEP_PRESS_BUTTON: {
+      uint32_t count = touchLatencyCount();
+      if (!tapObject(&lv_btn_class, step.x0)) {
+        fprintf(stderr, "%s: no visible button\n", step.name);
+        return false;
+      }
+      if (touchLatencyCount() == count) {
+        fprintf(stderr, "%s: touch_to_photon was not measured (skipped %u)\n", step.name, touchLatencySkipped());
+        return false;
+      }
+      break;
+    }
+    case STEP_ADD_HISTORY:
+      addSimHistory(1);
+      runFrame();
+      break;
+    case STEP_UPDATE_DEVICES:
+      updateSimDevices(simDeviceCount, deviceUpdatesPerFrame);
+      runFrame();
+      break;
+    }
+  }
+  runFrames(settleFrames);
+  return true;
+}
+
+//
+// 基準値
+// 1行に "<name> <pixels> <average us>"
+//
+struct Baseline {
+  char name[32];
+  uint32_t pixels;
+  uint32_t averageMicros;
+};
+
+static int readBaseline(const char *path, Baseline *baseline, int size) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    return -1;
+  }
+
+  int count = 0;
+  while (count < size) {
+    Baseline &entry = baseline[count];
+    if (fscanf(file, "%31s %u %u", entry.name, &entry.pixels, &entry.averageMicros) != 3) {
+      break;
+    }
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+static const Baseline *findBaseline(const Baseline *baseline, int count, const char *name) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(baseline[i].name, name) == 0) {
+      return &baseline[i];
+    }
+  }
+  return nullptr;
+}
+
+static int64_t hostMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printLine(const char *line) {
+  printf("%s\n", line);
+}
+
+static bool exceeds(uint32_t value, uint32_t reference, double tolerance) {
+  return value > reference + (uint32_t)(reference * tolerance);
+}
+
+// シミュレータでは設定を保存しないので固定値で画面を作る
+static void createSimUi() {
+  static char systemBarText[32];
+  snprintf(systemBarText, sizeof(systemBarText), "%s %s %s %d%%", LV_SYMBOL_WIFI, LV_SYMBOL_BLUETOOTH, LV_SYMBOL_BATTERY_FULL, 100);
+
+  snprintf(ssid, sizeof(ssid), "%s", "sim-ap-1");
+  snprintf(pass, sizeof(pass), "%s", "password");
+  snprintf(url, sizeof(url), "%s", "broker.example.com");
+  port = 1883;
+  tls = false;
+  snprintf(clientId, sizeof(clientId), "%s", "m5core2-sim");
+  snprintf(topic, sizeof(topic), "%s", "m5core2/sim");
+  rssiThreshold = -80;
+
+  temperatureHistory.begin();
+  humidityHistory.begin();
+  addSimHistory(3 * historySamplesPerDay);
+  deviceList.begin();
+  updateSimDevices(simDeviceCount, simDeviceCount * 4);
+
+  UiSettings settings = {};
+  settings.systemBarText = systemBarText;
+  settings.files = "ca.pem\ncert.pem\nkey.pem";
+  createUi(settings);
+}
+
+// --bench-glyphで使うフォント(例: -DGLYPH_INDEX_BENCH_FONT=mplus1_regular_14)
+#ifdef GLYPH_INDEX_BENCH_FONT
+LV_FONT_DECLARE(GLYPH_INDEX_BENCH_FONT)
+#endif
+
+int main(int argc, char **argv) {
+  const char *baselinePath = nullptr;
+  bool writeBaseline = false;
+  bool benchBlend = false;
+#ifdef GLYPH_INDEX_BENCH_FONT
+  bool benchGlyph = false;
+#endif
+
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--baseline") == 0 || strcmp(argv[i], "--write-baseline") == 0) && i + 1 < argc) {
+      writeBaseline = (strcmp(argv[i], "--write-baseline") == 0);
+      baselinePath = argv[++i];
+    } else if (strcmp(argv[i], "--bench-blend") == 0) {
+      benchBlend = true;
+    } else if (strcmp(argv[i], "--heatmap") == 0) {
+      heatmap = true;
+#ifdef GLYPH_INDEX_BENCH_FONT
+    } else if (strcmp(argv[i], "--bench-glyph") == 0) {
+      benchGlyph = true;
+#endif
+    } else {
+      fprintf(stderr, "usage: %s [--baseline FILE | --write-baseline FILE | --bench-blend | --bench-glyph | --heatmap]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  lv_init();
+  cacheBudgetBegin(LV_CACHE_BUDGET_SIZE, simMicros);
+
+  lv_disp_draw_buf_init(&drawBuf, drawBuffer, NULL, screenWidth * bandHeight);
+
+  static lv_disp_drv_t disp_drv;
+  lv_disp_drv_init(&disp_drv);
+  disp_drv.hor_res = screenWidth;
+  disp_drv.ver_res = screenHeight;
+  disp_drv.flush_cb = disp_flush;
+  disp_drv.render_start_cb = [](lv_disp_drv_t *disp) { touchLatencyRefreshStart(); };
+  disp_drv.draw_ctx_init = dispFillInitCtx;
+  disp_drv.draw_ctx_deinit = dispFillDeinitCtx;
+  disp_drv.draw_ctx_size = dispFillCtxSize();
+  if (heatmap) {
+    disp_drv.rounder_cb = redrawHeatmapRounder;
+  }
+  disp_drv.draw_buf = &drawBuf;
+  lv_disp_drv_register(&disp_drv);
+  if (heatmap) {
+    redrawHeatmapInit();
+  }
+
+  static lv_indev_drv_t indev_drv;
+  lv_indev_drv_init(&indev_drv);
+  indev_drv.type = LV_INDEV_TYPE_POINTER;
+  indev_drv.read_cb = touchpad_read;
+  indev_drv.feedback_cb = touchLatencyFeedback;
+  lv_indev_drv_register(&indev_drv);
+
+  if (benchBlend) {
+    blend565Benchmark(hostMicros, printLine);
+    return 0;
+  }
+#ifdef GLYPH_INDEX_BENCH_FONT
+  if (benchGlyph) {
+    glyphIndexBenchmark(&GLYPH_INDEX_BENCH_FONT, hostMicros, printLine);
+    glyphCacheBenchmark(&GLYPH_INDEX_BENCH_FONT, hostMicros, printLine);
+    return 0;
+  }
+#endif
+
+  static StepStats stats[stepCount];
+
+  // 画面の構築も最初の操作に含める
+  currentStats = &stats[0];
+  auto start = std::chrono::steady_clock::now();
+  createSimUi();
+  auto end = std::chrono::steady_clock::now();
+  stats[0].handlerMicros.add((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+  // UI_LAZY_TABSの有無を比べるための、画面の構築にかかった時間と、その時点のlv_memの最大使用量
+  lv_mem_psram_stats_t buildMem;
+  lv_mem_psram_get_stats(&buildMem);
+  printf("ui build %lld us  lv_mem max used %zu bytes\n",
+         (long long)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), buildMem.max_used);
+
+  for (int i = 0; i < stepCount; i++) {
+    currentStats = &stats[i];
+    if (!runStep(steps[i])) {
+      return 1;
+    }
+    if (heatmap) {
+      // 最後の1秒間の集計
+      printf("%s\n", steps[i].name);
+      redrawHeatmapReport(printLine);
+    }
+  }
+  currentStats = nullptr;
+
+  printf("%-16s %8s %8s %8s %8s %8s %8s\n", "step", "frames", "avg_us", "max_us", "pixels", "filled", "areas");
+  for (int i = 0; i < stepCount; i++) {
+    const StepStats &s = stats[i];
+    printf("%-16s %8u %8u %8u %8u %8u %8u\n", steps[i].name, s.handlerMicros.count(), s.handlerMicros.average(), s.handlerMicros.max(), s.pixels, s.fillPixels, s.areas);
+  }
+
+  char latency[64];
+  touchLatencyFormat(latency, sizeof(latency));
+  printf("touch_to_photon_us (count p50 p90 p99 max) %s  skipped %u\n", latency, touchLatencySkipped());
+  uint32_t latencyP90 = touchLatencyPercentile(90);
+
+  lv_mem_psram_stats_t mem;
+  lv_mem_psram_get_stats(&mem);
+  printf("devices %u / %u  updates %u  evictions %u\n", deviceList.size(), deviceList.capacity(), deviceList.updateCount(), deviceList.evictionCount());
+  printf("lv_mem max used %zu / %zu bytes  biggest free %zu  frag %u%%\n", mem.max_used, mem.total_size, mem.free_biggest_size, mem.frag_pct);
+  char cache[96];
+  for (int i = 0; i < cacheTypeCount; i++) {
+    cacheBudgetFormat((CacheType)i, cache, sizeof(cache));
+    printf("cache %-8s %s\n", cacheTypeNames[i], cache);
+  }
+
+  if (baselinePath == nullptr) {
+    return 0;
+  }
+
+  if (writeBaseline) {
+    FILE *file = fopen(baselinePath, "w");
+    if (file == nullptr) {
+      fprintf(stderr, "cannot write %s\n", baselinePath);
+      return 2;
+    }
+    for (int i = 0; i < stepCount; i++) {
+      fprintf(file, "%s %u %u\n", steps[i].name, stats[i].pixels, stats[i].handlerMicros.average());
+    }
+    fprintf(file, "%s %u %u\n", latencyBaselineName, 0u, latencyP90);
+    fclose(file);
+    printf("baseline written to %s\n", baselinePath);
+    return 0;
+  }
+
+  static Baseline baseline[stepCount + 1];
+  int baselineCount = readBaseline(baselinePath, baseline, stepCount + 1);
+  if (baselineCount < 0) {
+    fprintf(stderr, "cannot read %s (create it with --write-baseline on the reference commit)\n", baselinePath);
+    return 2;
+  }
+
+  int regressions = 0;
+  for (int i = 0; i < stepCount; i++) {
+    const Baseline *reference = findBaseline(baseline, baselineCount, steps[i].name);
+    if (reference == nullptr) {
+      printf("%-16s no baseline\n", steps[i].name);
+      continue;
+    }
+
+    uint32_t average = stats[i].handlerMicros.average();
+    if (exceeds(stats[i].pixels, reference->pixels, pixelTolerance)) {
+      printf("%-16s REGRESSION pixels %u > %u\n", steps[i].name, stats[i].pixels, reference->pixels);
+      regressions++;
+    }
+    if (average > timeFloorMicros && exceeds(average, reference->averageMicros, timeTolerance)) {
+      printf("%-16s REGRESSION avg_us %u > %u\n", steps[i].name, average, reference->averageMicros);
+      regressions++;
+    }
+  }
+
+  const Baseline *latencyReference = findBaseline(baseline, baselineCount, latencyBaselineName);
+  if (latencyReference == nullptr) {
+    printf("%-16s no baseline\n", latencyBaselineName);
+  } else if (exceeds(latencyP90, latencyReference->averageMicros, timeTolerance)) {
+    printf("%-16s REGRESSION p90 %u > %u\n", latencyBaselineName, latencyP90, latencyReference->averageMicros);
+    regressions++;
+  }
+
+  printf("%d regression(s)\n", regressions);
+  return (regressions > 0) ? 1 : 0;
+}
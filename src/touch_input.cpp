@@ -0,0 +1,148 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+
+#include "touch_input.hpp"
+#include "perf_stats.hpp"
+#include "touch_latency.hpp"
+
+extern PerfStats perfStats;
+
+static const uint8_t touchPin = 39;
+static const uint8_t touchAddress = 0x38;
+static const uint8_t touchStatusRegister = 0x02;  // TD_STATUS, P1_XH, P1_XL, P1_YH, P1_YL の順に続く
+static const int touchEventCount = 16;            // 2のべき乗
+
+// 割り込みで記録するINTの変化
+struct TouchEvent {
+  int64_t micros;
+  bool pressed;
+};
+
+static TouchEvent touchEvents[touchEventCount];
+static volatile uint32_t eventHead;  // 割り込みだけが進める
+static volatile uint32_t eventTail;  // read_cbだけが進める
+static TaskHandle_t wakeTaskHandle;
+static lv_indev_t *touchIndev;
+static lv_timer_t *readTimer;
+
+static bool touchPressed;
+static lv_coord_t lastX;
+static lv_coord_t lastY;
+static int64_t pressMicros;
+static int64_t pendingPressMicros;  // まだLVGLに渡していない押下の時刻。0は無し
+static volatile uint32_t interruptCount;
+static volatile uint32_t droppedCount;
+static uint32_t readCount;
+
+static void IRAM_ATTR touch_isr() {
+  uint32_t head = eventHead;
+  interruptCount++;
+  if (head - eventTail < touchEventCount) {
+    TouchEvent &event = touchEvents[head & (touchEventCount - 1)];
+    event.micros = esp_timer_get_time();
+    event.pressed = (digitalRead(touchPin) == LOW);
+    eventHead = head + 1;
+  } else {
+    droppedCount++;
+  }
+  BaseType_t woken = pdFALSE;
+  if (wakeTaskHandle != NULL) {
+    vTaskNotifyGiveFromISR(wakeTaskHandle, &woken);
+  }
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void touchInputBegin(TaskHandle_t wakeTask) {
+  wakeTaskHandle = wakeTask;
+  pinMode(touchPin, INPUT);
+  attachInterrupt(touchPin, touch_isr, CHANGE);
+}
+
+void touchInputAttach(lv_indev_t *indev) {
+  touchIndev = indev;
+  readTimer = indev->driver->read_timer;
+}
+
+void touchInputResume() {
+  if ((readTimer != NULL) && readTimer->paused && (eventHead != eventTail)) {
+    lv_timer_resume(readTimer);
+    lv_timer_ready(readTimer);
+  }
+}
+
+int64_t touchInputPressMicros() {
+  return pressMicros;
+}
+
+void touchInputGetStats(TouchInputStats *stats) {
+  stats->interrupts = interruptCount;
+  stats->reads = readCount;
+  stats->dropped = droppedCount;
+}
+
+// 状態と1点目の座標を1回の読み取りで得る。触れていなければfalse
+static bool readTouchPoint(lv_coord_t *x, lv_coord_t *y) {
+  uint8_t data[5];
+  readCount++;
+  Wire1.beginTransmission(touchAddress);
+  Wire1.write(touchStatusRegister);
+  if (Wire1.endTransmission(false) != 0) {
+    return false;
+  }
+  if (Wire1.requestFrom(touchAddress, (uint8_t)sizeof(data)) != sizeof(data)) {
+    return false;
+  }
+  for (int i = 0; i < (int)sizeof(data); i++) {
+    data[i] = Wire1.read();
+  }
+  uint8_t points = data[0] & 0x0f;
+  if ((points == 0) || (points > 2)) {
+    return false;
+  }
+  *x = ((data[1] & 0x0f) << 8) | data[2];
+  *y = ((data[3] & 0x0f) << 8) | data[4];
+  return true;
+}
+
+void touchInputRead(lv_indev_drv_t *drv, lv_indev_data_t *data) {
+  touchLatencyRead(drv);
+
+  // 溜まっている変化を取り出す。押された時刻は最初の押下のものを使う
+  bool pressEvent = false;
+  while (eventTail != eventHead) {
+    const TouchEvent &event = touchEvents[eventTail & (touchEventCount - 1)];
+    if (event.pressed && !pressEvent && !touchPressed) {
+      pendingPressMicros = event.micros;
+      pressEvent = true;
+    }
+    eventTail = eventTail + 1;
+  }
+
+  // INTがLowの間か、前回の読み取りの後に押された場合だけI2Cで読む
+  bool pressed = false;
+  if (pressEvent || touchPressed || (digitalRead(touchPin) == LOW)) {
+    pressed = readTouchPoint(&lastX, &lastY);
+  }
+  if (pressed && (pendingPressMicros != 0)) {
+    pressMicros = pendingPressMicros;
+    perfStats.touchMicros.add(esp_timer_get_time() - pendingPressMicros);
+    touchLatencyPress(pendingPressMicros);
+    pendingPressMicros = 0;
+  }
+
+  touchPressed = pressed;
+  data->point.x = lastX;
+  data->point.y = lastY;
+  data->state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+
+  // 離れていて次の変化も無ければ、割り込みが来るまで読み取りを止める
+  // スクロールの慣性とスナップ、LV_EVENT_SCROLL_ENDは離した後の読み取りで進むので、スクロールが終わるまでは止めない
+  bool scrolling = (touchIndev != NULL) && (touchIndev->proc.types.pointer.scroll_obj != NULL);
+  if (!pressed && !scrolling && (eventTail == eventHead) && (readTimer != NULL)) {
+    pendingPressMicros = 0;
+    lv_timer_pause(readTimer);
+  }
+}
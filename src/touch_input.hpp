@@ -0,0 +1,37 @@
+#ifndef TOUCH_INPUT_HPP
+#define TOUCH_INPUT_HPP
+
+#include <stdint.h>
+#include <lvgl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+//
+// タッチパネル(FT6336U)の割り込みを使う入力ドライバ
+//
+// タッチパネルのINT(GPIO39)は指が触れている間Lowになる。その変化を割り込みで時刻付きのリングバッファに入れ、
+// LVGLのread_cbで取り出す。I2Cで座標を読むのは指が触れている間だけで、1回の読み取りで状態と座標をまとめて読む
+// 指が離れたらLVGLの入力の読み取りタイマーを止め、次の割り込みでGUIタスクを起こして再開する
+//
+// タッチパネルとAXPは同じI2Cバス(Wire1)なので、read_cbはGUIのロック中に呼ばれること
+//
+
+struct TouchInputStats {
+  uint32_t interrupts;  // 割り込みの回数
+  uint32_t reads;       // I2Cの読み取りの回数
+  uint32_t dropped;     // リングバッファが一杯で捨てた変化の数
+};
+
+// 割り込みを登録する。M5.beginの後に呼ぶ。割り込みがあるとwakeTaskに通知する
+void touchInputBegin(TaskHandle_t wakeTask);
+// lv_indev_drv_t::read_cbに設定する
+void touchInputRead(lv_indev_drv_t *drv, lv_indev_data_t *data);
+// lv_indev_drv_registerの後に呼ぶ。読み取りタイマーを止められるようにする
+void touchInputAttach(lv_indev_t *indev);
+// GUIタスクでlv_timer_handlerの前に呼ぶ。止めている間に割り込みがあれば読み取りタイマーを再開する
+void touchInputResume();
+// 最後に押された時の割り込みの時刻(esp_timer_get_time)
+int64_t touchInputPressMicros();
+void touchInputGetStats(TouchInputStats *stats);
+
+#endif
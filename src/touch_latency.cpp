@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "touch_latency.hpp"
+
+static const int sampleCapacity = 128;
+
+enum {
+  LATENCY_IDLE,
+  LATENCY_PRESSED,    // 押下をLVGLに渡した
+  LATENCY_DISPATCHED, // LV_EVENT_PRESSEDを配った。画面が変わったかは次のリフレッシュか読み取りで決める
+  LATENCY_REFRESHING, // その変化を描画している
+};
+
+static int state = LATENCY_IDLE;
+static int64_t pressMicros;
+static uint32_t samples[sampleCapacity];
+static uint32_t sampleCount;
+static uint32_t skippedCount;
+
+void touchLatencyPress(int64_t micros) {
+  pressMicros = micros;
+  state = LATENCY_PRESSED;
+}
+
+void touchLatencyFeedback(lv_indev_drv_t *drv, uint8_t code) {
+  // feedback_cbはオブジェクトがLV_STATE_PRESSEDになる前に呼ばれるので、ここではまだ無効化を調べない
+  if ((state == LATENCY_PRESSED) && (code == LV_EVENT_PRESSED)) {
+    state = LATENCY_DISPATCHED;
+  }
+}
+
+void touchLatencyRead(lv_indev_drv_t *drv) {
+  if (state != LATENCY_DISPATCHED) {
+    return;
+  }
+  // 配った後にリフレッシュが始まらず、無効化された領域も無いなら、押下で画面は変わらなかった
+  lv_disp_t *disp = (drv->disp != NULL) ? drv->disp : lv_disp_get_default();
+  if ((disp == NULL) || (disp->inv_p == 0)) {
+    state = LATENCY_IDLE;
+    skippedCount++;
+  }
+}
+
+void touchLatencyRefreshStart() {
+  if (state == LATENCY_DISPATCHED) {
+    state = LATENCY_REFRESHING;
+  }
+}
+
+void touchLatencyFlushed(bool last, int64_t micros) {
+  if ((state != LATENCY_REFRESHING) || !last) {
+    return;
+  }
+  state = LATENCY_IDLE;
+  int64_t elapsed = micros - pressMicros;
+  samples[sampleCount % sampleCapacity] = (elapsed > 0) ? (uint32_t)elapsed : 0;
+  sampleCount++;
+}
+
+void touchLatencyClear() {
+  state = LATENCY_IDLE;
+  sampleCount = 0;
+  skippedCount = 0;
+}
+
+uint32_t touchLatencyCount() {
+  return sampleCount;
+}
+
+uint32_t touchLatencySkipped() {
+  return skippedCount;
+}
+
+// 計測値は最大128個なので、呼ぶたびに並べ替える
+uint32_t touchLatencyPercentile(int percent) {
+  int count = (sampleCount < (uint32_t)sampleCapacity) ? (int)sampleCount : sampleCapacity;
+  if (count == 0) {
+    return 0;
+  }
+  uint32_t sorted[sampleCapacity];
+  memcpy(sorted, samples, count * sizeof(uint32_t));
+  std::sort(sorted, sorted + count);
+  int index = (count * percent + 99) / 100 - 1;
+  return sorted[std::max(0, std::min(index, count - 1))];
+}
+
+int touchLatencyFormat(char *buffer, size_t size) {
+  return snprintf(buffer, size, "%u %u %u %u %u", (unsigned)sampleCount, (unsigned)touchLatencyPercentile(50), (unsigned)touchLatencyPercentile(90),
+                  (unsigned)touchLatencyPercentile(99), (unsigned)touchLatencyPercentile(100));
+}
@@ -0,0 +1,39 @@
+#ifndef TOUCH_LATENCY_HPP
+#define TOUCH_LATENCY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <lvgl.h>
+
+// タッチから画面への反映までの時間(touch-to-photon)の計測
+//
+// 押された時刻から、押下のイベントで変化した画面の最後の転送が終わるまでを計る
+//   1. touchLatencyPress   : read_cbが押下をLVGLに渡す時に、押された時刻を渡す
+//   2. touchLatencyFeedback: indev_drv.feedback_cbに設定する。LV_EVENT_PRESSEDを配ったことを記録する
+//   3. touchLatencyRefreshStart: render_start_cbから呼ぶ。押下を配った後の最初のリフレッシュを計測する
+//   4. touchLatencyFlushed : 転送が終わった時に呼ぶ。計測中のリフレッシュの最後の転送なら記録する
+//   touchLatencyRead       : read_cbの最初に呼ぶ。配った後にリフレッシュが始まらず、無効化された
+//                            領域も無ければ、押下で画面が変わらなかったとして計測をやめる
+// feedback_cbはオブジェクトの押下の処理より前に呼ばれるので、無効化されたかは配った後で調べる
+// 無効化された領域は押下によるものとは限らない(同じ周期のアニメーションなど)ので、目安の値である
+// 時刻はマイクロ秒で、全て同じ時計のものを渡すこと(実機はesp_timer_get_time、シミュレータは仮想時刻)
+//
+// 最近の計測値を固定長のリングに残し、そこからパーセンタイルを求める
+
+void touchLatencyPress(int64_t micros);
+void touchLatencyFeedback(lv_indev_drv_t *drv, uint8_t code);
+void touchLatencyRefreshStart();
+void touchLatencyRead(lv_indev_drv_t *drv);
+void touchLatencyFlushed(bool last, int64_t micros);
+
+void touchLatencyClear();
+// 計測した回数(リングから溢れたものを含む)
+uint32_t touchLatencyCount();
+// 押下で画面が変わらなかったので計測しなかった回数
+uint32_t touchLatencySkipped();
+// 残っている計測値のパーセンタイル(us)。計測値が無ければ0
+uint32_t touchLatencyPercentile(int percent);
+// "count p50 p90 p99 max" の1行
+int touchLatencyFormat(char *buffer, size_t size);
+
+#endif
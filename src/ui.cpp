@@ -0,0 +1,681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ui.hpp"
+#include "settings.hpp"
+#include "perf_stats.hpp"
+#include "device_list.hpp"
+#include "sensor_history.hpp"
+#include "history_chart.hpp"
+
+extern PerfStats perfStats;
+extern DeviceList deviceList;
+extern SensorHistory temperatureHistory;
+extern SensorHistory humidityHistory;
+
+// 1: 設定タブは最初に選択された時に作る、0: 起動時に全てのタブを作る
+#ifndef UI_LAZY_TABS
+#define UI_LAZY_TABS 1
+#endif
+// 1: ホームタブ以外は離れる時に削除する(UI_LAZY_TABSが1の場合のみ)
+#ifndef UI_DESTROY_HIDDEN_TABS
+#define UI_DESTROY_HIDDEN_TABS 0
+#endif
+
+static const uint16_t tabWidth = 50;
+static const uint16_t homeTabIndex = 0;
+
+static const char *booting = "Booting...";
+static const char *saveText = "Save";
+static const char *okText = "OK";
+static const char *cancelText = "Cancel";
+
+// 設定タブの行の間隔と入力部品の位置
+static const lv_coord_t settingRowHeight = 50;
+static const lv_coord_t settingWidgetX = 50;
+static const lv_coord_t settingWidgetWidth = 140;
+
+// ホームタブの履歴のグラフ
+static const lv_coord_t historyChartY = 62;
+static const lv_coord_t zoomButtonWidth = 36;
+static const uint32_t historyChartInterval = 1000;
+
+// 診断タブ
+static const uint16_t diagnosticsTabIndex = 4;
+static const uint32_t diagnosticsInterval = 1000;
+static char diagnosticsText[512];
+
+// デバイスタブ
+// lv_coord_tは8191までなので、数千行の一覧はLVGLのスクロールでは表せない。スクロール位置は自前で持つ
+static const uint16_t devicesTabIndex = 5;
+static const uint32_t devicesInterval = 500;
+static const lv_coord_t deviceHeaderHeight = 24;
+static const lv_coord_t deviceRowHeight = 24;
+static const int maxDeviceRows = 16;
+
+static UiSettings uiSettings;
+
+lv_obj_t *rootScreen;
+lv_obj_t *systemBar;
+lv_obj_t *connectionStatus;
+lv_obj_t *dashboardTempertature;
+lv_obj_t *dashboardHumidity;
+static lv_obj_t *keyboard;
+static lv_obj_t *messageBox;
+
+static lv_obj_t *tabView;
+static uint16_t activeTabIndex = homeTabIndex;
+
+// 設定タブの入力部品。settingGroupsと同じ並び
+static lv_obj_t *settingWidgets[maxSettingGroups][maxGroupSettings];
+
+// 診断タブ
+static lv_obj_t *diagnosticsLabel;
+static lv_timer_t *diagnosticsTimer;
+
+// デバイスタブ
+// 行のラベルは見えている行数+1個だけ作り、rank % deviceRowCount番目のラベルにrank番目のデバイスを表示する
+struct DeviceRow {
+  lv_obj_t *label;
+  int32_t rank;  // 表示しているデバイスの位置。-1は非表示
+  char text[32];
+};
+
+static lv_obj_t *devicesHeader;
+static lv_obj_t *devicesList;
+static lv_obj_t *devicesScrollbar;
+static lv_timer_t *devicesTimer;
+static DeviceRow deviceRows[maxDeviceRows];
+static int deviceRowCount;
+static lv_coord_t devicesViewHeight;
+static int32_t devicesScrollY;
+static int32_t devicesShownCount;
+static char devicesHeaderText[32];
+
+static void open_keyboard() {
+  if (keyboard == NULL) {
+    keyboard = lv_keyboard_create(rootScreen);
+  }
+}
+
+static void textarea_event_cb(lv_event_t *event) {
+  lv_event_code_t code = lv_event_get_code(event);
+  lv_obj_t *textarea = lv_event_get_target(event);
+  if (code == LV_EVENT_FOCUSED) {
+    open_keyboard();
+    lv_keyboard_set_textarea(keyboard, textarea);
+    lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+  }
+
+  if (code == LV_EVENT_DEFOCUSED) {
+    lv_keyboard_set_textarea(keyboard, NULL);
+    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+  }
+}
+
+// 確認ダイアログを表示し、OKが押されたらグループの設定を保存する
+static void confirmSave(const SettingGroup *group) {
+  static const char *buttons[] = {okText, cancelText, ""};
+  messageBox = lv_msgbox_create(NULL, saveText, group->confirmText, buttons, true);
+  lv_obj_center(messageBox);
+  lv_obj_add_event_cb(
+      messageBox,
+      [](lv_event_t *event) {
+        lv_obj_t *obj = lv_event_get_current_target(event);
+        const char *buttonText = lv_msgbox_get_active_btn_text(obj);
+        const SettingGroup *group = (const SettingGroup *)lv_event_get_user_data(event);
+        if (strcmp(buttonText, okText) == 0) {
+          saveSettings(*group);
+        }
+        lv_msgbox_close(messageBox);
+      },
+      LV_EVENT_VALUE_CHANGED, (void *)group);
+}
+
+static lv_obj_t *createLabel(lv_obj_t *parent, const char *text, lv_coord_t y) {
+  lv_obj_t *label = lv_label_create(parent);
+  lv_label_set_text(label, text);
+  lv_obj_set_pos(label, 0, y);
+  return label;
+}
+
+static lv_obj_t *createTextarea(lv_obj_t *parent, const char *text, uint32_t maxLength, lv_coord_t y) {
+  lv_obj_t *textarea = lv_textarea_create(parent);
+  lv_textarea_set_text(textarea, text);
+  lv_textarea_set_one_line(textarea, true);
+  if (maxLength > 0) {
+    lv_textarea_set_max_length(textarea, maxLength);
+  }
+  lv_obj_set_width(textarea, settingWidgetWidth);
+  lv_obj_set_pos(textarea, settingWidgetX, y);
+  lv_obj_add_event_cb(textarea, textarea_event_cb, LV_EVENT_ALL, NULL);
+  return textarea;
+}
+
+static lv_obj_t *createDropdown(lv_obj_t *parent, const char *options, lv_coord_t y) {
+  lv_obj_t *dropdown = lv_dropdown_create(parent);
+  lv_dropdown_set_options(dropdown, options);
+  lv_obj_set_width(dropdown, settingWidgetWidth);
+  lv_obj_set_pos(dropdown, settingWidgetX, y);
+  return dropdown;
+}
+
+static lv_obj_t *createSaveButton(lv_obj_t *parent, lv_coord_t y, lv_event_cb_t onClicked, void *userData) {
+  lv_obj_t *button = lv_btn_create(parent);
+  lv_obj_t *buttonLabel = lv_label_create(button);
+  lv_label_set_text(buttonLabel, saveText);
+  lv_obj_set_pos(button, settingWidgetX, y);
+  lv_obj_add_event_cb(button, onClicked, LV_EVENT_CLICKED, userData);
+  return button;
+}
+
+static void setChecked(lv_obj_t *obj, bool checked) {
+  if (checked) {
+    lv_obj_add_state(obj, LV_STATE_CHECKED);
+  } else {
+    lv_obj_clear_state(obj, LV_STATE_CHECKED);
+  }
+}
+
+// ホームタブ
+static void createHomeTab(lv_obj_t *tab) {
+  lv_obj_t *homeTabContainer = lv_obj_create(tab);
+  lv_gridnav_add(homeTabContainer, LV_GRIDNAV_CTRL_NONE);
+  lv_obj_set_size(homeTabContainer, lv_pct(100), lv_pct(100));
+
+  systemBar = lv_label_create(homeTabContainer);
+  lv_label_set_text(systemBar, uiSettings.systemBarText);
+  lv_obj_align(systemBar, LV_ALIGN_TOP_RIGHT, 0, 0);
+
+  connectionStatus = lv_label_create(homeTabContainer);
+  lv_label_set_text(connectionStatus, booting);
+  lv_obj_set_pos(connectionStatus, 0, 0);
+
+  // ダッシュボード
+  static lv_style_t dashboardLabelStyle;
+  lv_style_init(&dashboardLabelStyle);
+  lv_style_set_text_font(&dashboardLabelStyle, &lv_font_montserrat_34);
+
+  dashboardTempertature = lv_label_create(homeTabContainer);
+  lv_label_set_text(dashboardTempertature, "--.- °C");
+  lv_obj_set_pos(dashboardTempertature, 15, 20);
+  lv_obj_add_style(dashboardTempertature, &dashboardLabelStyle, 0);
+
+  dashboardHumidity = lv_label_create(homeTabContainer);
+  lv_label_set_text(dashboardHumidity, "--.- %");
+  lv_obj_set_pos(dashboardHumidity, 150, 20);
+  lv_obj_add_style(dashboardHumidity, &dashboardLabelStyle, 0);
+
+  // 温度と湿度の履歴。横のドラッグで動かし、+/-で拡大、縮小する
+  static const HistoryChartSeries historySeries[] = {
+    {&temperatureHistory, lv_palette_main(LV_PALETTE_RED), LV_CHART_AXIS_PRIMARY_Y, 50},
+    {&humidityHistory, lv_palette_main(LV_PALETTE_BLUE), LV_CHART_AXIS_SECONDARY_Y, 100},
+  };
+  lv_obj_update_layout(homeTabContainer);
+  lv_coord_t chartWidth = lv_obj_get_content_width(homeTabContainer) - zoomButtonWidth - 4;
+  lv_coord_t chartHeight = lv_obj_get_content_height(homeTabContainer) - historyChartY;
+  lv_obj_t *chart = historyChartCreate(homeTabContainer, chartWidth, chartHeight, historySeries, 2);
+  lv_obj_set_pos(chart, 0, historyChartY);
+
+  static const char *zoomSymbols[] = {LV_SYMBOL_PLUS, LV_SYMBOL_MINUS};
+  for (int i = 0; i < 2; i++) {
+    lv_obj_t *button = lv_btn_create(homeTabContainer);
+    lv_obj_set_size(button, zoomButtonWidth, chartHeight / 2 - 2);
+    lv_obj_set_pos(button, chartWidth + 4, historyChartY + i * (chartHeight / 2 + 2));
+    lv_obj_t *buttonLabel = lv_label_create(button);
+    lv_label_set_text_static(buttonLabel, zoomSymbols[i]);
+    lv_obj_center(buttonLabel);
+    lv_obj_add_event_cb(
+        button,
+        [](lv_event_t *event) {
+          historyChartZoom((lv_event_get_user_data(event) == NULL) ? 1 : -1);
+        },
+        LV_EVENT_CLICKED, (void *)(intptr_t)i);
+  }
+
+  lv_timer_create(
+      [](lv_timer_t *timer) {
+        if (lv_tabview_get_tab_act(tabView) == homeTabIndex) {
+          historyChartRefresh();
+        }
+      },
+      historyChartInterval, NULL);
+}
+
+static void slider_event_cb(lv_event_t *event) {
+  lv_obj_t *slider = lv_event_get_target(event);
+  lv_obj_t *valueLabel = (lv_obj_t *)lv_event_get_user_data(event);
+  lv_label_set_text_fmt(valueLabel, "%d", (int)lv_slider_get_value(slider));
+}
+
+// 設定項目の入力部品を作る。yは項目名のラベルの位置
+static lv_obj_t *createSettingWidget(lv_obj_t *parent, const SettingDescriptor &setting, lv_coord_t y) {
+  lv_coord_t widgetY = y - 10;
+  lv_obj_t *widget = NULL;
+  switch (setting.widget) {
+    case WIDGET_TEXTAREA:
+    case WIDGET_PASSWORD:
+      widget = createTextarea(parent, (const char *)setting.value, setting.size - 1, widgetY);
+      lv_textarea_set_password_mode(widget, setting.widget == WIDGET_PASSWORD);
+      break;
+    case WIDGET_NUMBER: {
+      char text[12];
+      char maxText[12];
+      snprintf(text, sizeof(text), "%d", *(int *)setting.value);
+      snprintf(maxText, sizeof(maxText), "%d", (int)setting.max);
+      widget = createTextarea(parent, text, strlen(maxText), widgetY);
+      lv_textarea_set_accepted_chars(widget, "0123456789");
+      break;
+    }
+    case WIDGET_SWITCH:
+      widget = lv_switch_create(parent);
+      lv_obj_set_pos(widget, settingWidgetX, widgetY);
+      setChecked(widget, *(bool *)setting.value);
+      break;
+    case WIDGET_SLIDER: {
+      lv_obj_t *valueLabel = lv_label_create(parent);
+      lv_label_set_text_fmt(valueLabel, "%d", *(int *)setting.value);
+      lv_obj_set_pos(valueLabel, 210, y);
+
+      widget = lv_slider_create(parent);
+      lv_obj_set_width(widget, 130);
+      lv_slider_set_range(widget, setting.min, setting.max);
+      lv_slider_set_value(widget, *(int *)setting.value, LV_ANIM_OFF);
+      lv_obj_set_pos(widget, 60, y);
+      lv_obj_add_event_cb(widget, slider_event_cb, LV_EVENT_VALUE_CHANGED, valueLabel);
+      break;
+    }
+    case WIDGET_DROPDOWN:
+      widget = createDropdown(parent, setting.options, widgetY);
+      lv_dropdown_set_selected(widget, *(int *)setting.value);
+      break;
+    case WIDGET_SSID:
+      // 今のSSIDだけを表示し、押されたらスキャンする
+      widget = createDropdown(parent, (const char *)setting.value, widgetY);
+      lv_obj_add_event_cb(
+          widget,
+          [](lv_event_t *event) {
+            scanWifi(lv_event_get_target(event));
+          },
+          LV_EVENT_CLICKED, NULL);
+      break;
+    case WIDGET_FILE:
+      widget = createDropdown(parent, uiSettings.files, widgetY);
+      break;
+  }
+
+  if ((setting.disabled != NULL) && setting.disabled()) {
+    if (setting.widget == WIDGET_DROPDOWN) {
+      lv_dropdown_set_selected(widget, 0);
+    }
+    lv_obj_add_state(widget, LV_STATE_DISABLED);
+  }
+  return widget;
+}
+
+// 入力部品の値を設定の変数に書き込む
+static void applySetting(const SettingDescriptor &setting, lv_obj_t *widget) {
+  switch (setting.widget) {
+    case WIDGET_TEXTAREA:
+    case WIDGET_PASSWORD:
+      snprintf((char *)setting.value, setting.size, "%s", lv_textarea_get_text(widget));
+      break;
+    case WIDGET_NUMBER:
+      *(int *)setting.value = LV_CLAMP(setting.min, atoi(lv_textarea_get_text(widget)), setting.max);
+      break;
+    case WIDGET_SWITCH:
+      *(bool *)setting.value = lv_obj_has_state(widget, LV_STATE_CHECKED);
+      break;
+    case WIDGET_SLIDER:
+      *(int *)setting.value = lv_slider_get_value(widget);
+      break;
+    case WIDGET_DROPDOWN:
+      *(int *)setting.value = lv_dropdown_get_selected(widget);
+      break;
+    case WIDGET_SSID:
+      lv_dropdown_get_selected_str(widget, (char *)setting.value, setting.size);
+      break;
+    case WIDGET_FILE: {
+      char path[64];
+      lv_dropdown_get_selected_str(widget, path, sizeof(path));
+      char *text = readSettingFile(path);
+      // 前の内容はWiFiClientSecureが参照している場合があるので解放しない
+      if (text != NULL) {
+        *(char **)setting.value = text;
+      }
+      break;
+    }
+  }
+}
+
+static void save_button_event_cb(lv_event_t *event) {
+  int groupIndex = (int)(intptr_t)lv_event_get_user_data(event);
+  const SettingGroup &group = settingGroups[groupIndex];
+  for (int i = 0; i < group.count; i++) {
+    applySetting(group.settings[i], settingWidgets[groupIndex][i]);
+  }
+  if (group.apply != NULL) {
+    group.apply();
+  }
+  confirmSave(&group);
+}
+
+// settings.cppの表から設定タブを作る
+static void createSettingsPage(lv_obj_t *tab, uint8_t page, lv_coord_t height) {
+  lv_obj_t *container = lv_obj_create(tab);
+  lv_gridnav_add(container, LV_GRIDNAV_CTRL_NONE);
+  lv_obj_set_size(container, lv_pct(100), height);
+
+  lv_coord_t y = 0;
+  for (int g = 0; g < settingGroupCount; g++) {
+    const SettingGroup &group = settingGroups[g];
+    if (group.page != page) {
+      continue;
+    }
+    createLabel(container, group.title, y);
+    for (int i = 0; i < group.count; i++) {
+      y += settingRowHeight;
+      createLabel(container, group.settings[i].label, y);
+      settingWidgets[g][i] = createSettingWidget(container, group.settings[i], y);
+    }
+    y += settingRowHeight;
+    createSaveButton(container, y - 10, save_button_event_cb, (void *)(intptr_t)g);
+    y += settingRowHeight;
+  }
+}
+
+// タブを削除した後に、削除されたオブジェクトを参照しないようにする
+static void forgetSettingsPage(uint8_t page) {
+  for (int g = 0; g < settingGroupCount; g++) {
+    if (settingGroups[g].page == page) {
+      for (int i = 0; i < maxGroupSettings; i++) {
+        settingWidgets[g][i] = NULL;
+      }
+    }
+  }
+}
+
+// WiFi/MQTT/証明書タブ
+static void createConnectionTab(lv_obj_t *tab) {
+  createSettingsPage(tab, SETTING_PAGE_CONNECTION, lv_pct(300));
+}
+
+static void forgetConnectionTab() {
+  forgetSettingsPage(SETTING_PAGE_CONNECTION);
+}
+
+// Bluetoothタブ
+static void createBluetoothTab(lv_obj_t *tab) {
+  createSettingsPage(tab, SETTING_PAGE_BLUETOOTH, lv_pct(100));
+}
+
+static void forgetBluetoothTab() {
+  forgetSettingsPage(SETTING_PAGE_BLUETOOTH);
+}
+
+// GPS/内蔵センサタブ
+static void createSensorsTab(lv_obj_t *tab) {
+  createSettingsPage(tab, SETTING_PAGE_SENSORS, lv_pct(450));
+}
+
+static void forgetSensorsTab() {
+  forgetSettingsPage(SETTING_PAGE_SENSORS);
+}
+
+// 診断タブ
+static void createDiagnosticsTab(lv_obj_t *tab) {
+  lv_obj_t *diagnosticsTabContainer = lv_obj_create(tab);
+  lv_obj_set_size(diagnosticsTabContainer, lv_pct(100), LV_SIZE_CONTENT);
+
+  diagnosticsLabel = lv_label_create(diagnosticsTabContainer);
+  lv_label_set_text(diagnosticsLabel, "");
+  lv_obj_set_pos(diagnosticsLabel, 0, 0);
+  diagnosticsTimer = lv_timer_create(
+      [](lv_timer_t *timer) {
+        if (lv_tabview_get_tab_act(tabView) == diagnosticsTabIndex) {
+          perfStats.formatSummary(diagnosticsText, sizeof(diagnosticsText));
+          lv_label_set_text(diagnosticsLabel, diagnosticsText);
+        }
+      },
+      diagnosticsInterval, NULL);
+}
+
+static void forgetDiagnosticsTab() {
+  lv_timer_del(diagnosticsTimer);
+  diagnosticsTimer = NULL;
+  diagnosticsLabel = NULL;
+}
+
+// 内容が変わった場合だけラベルを更新する
+static void setDeviceRowText(DeviceRow &row, const DeviceEntry &entry) {
+  char text[sizeof(row.text)];
+  const uint8_t *address = entry.address;
+  snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x %4d dBm",
+           address[5], address[4], address[3], address[2], address[1], address[0], entry.rssi);
+  if (strcmp(text, row.text) != 0) {
+    strcpy(row.text, text);
+    lv_label_set_text_static(row.label, row.text);
+  }
+}
+
+// 見えている範囲の行にデバイスを割り当てる。rankが[first, last]の行は内容が変わっている
+static void layoutDeviceRows(int32_t first, int32_t last) {
+  int32_t count = deviceList.size();
+  int32_t top = devicesScrollY / deviceRowHeight;
+  for (int32_t rank = top; rank < top + deviceRowCount; rank++) {
+    DeviceRow &row = deviceRows[rank % deviceRowCount];
+    if (rank >= count) {
+      if (row.rank >= 0) {
+        lv_obj_add_flag(row.label, LV_OBJ_FLAG_HIDDEN);
+        row.rank = -1;
+      }
+      continue;
+    }
+    if (row.rank < 0) {
+      lv_obj_clear_flag(row.label, LV_OBJ_FLAG_HIDDEN);
+    }
+    bool moved = (row.rank != rank);
+    row.rank = rank;
+    lv_obj_set_y(row.label, (lv_coord_t)(rank * deviceRowHeight - devicesScrollY));
+    if (moved || ((rank >= first) && (rank <= last))) {
+      setDeviceRowText(row, deviceList.at(rank));
+    }
+  }
+}
+
+// スクロール位置を範囲内に収めて、スクロールバーを合わせる
+static void clampDevicesScroll() {
+  int32_t contentHeight = deviceList.size() * deviceRowHeight;
+  int32_t maxScrollY = LV_MAX(contentHeight - devicesViewHeight, 0);
+  devicesScrollY = LV_CLAMP(0, devicesScrollY, maxScrollY);
+
+  if (maxScrollY == 0) {
+    lv_obj_add_flag(devicesScrollbar, LV_OBJ_FLAG_HIDDEN);
+    return;
+  }
+  lv_coord_t height = LV_MAX((lv_coord_t)((int64_t)devicesViewHeight * devicesViewHeight / contentHeight), 8);
+  lv_coord_t y = (lv_coord_t)((int64_t)(devicesViewHeight - height) * devicesScrollY / maxScrollY);
+  lv_obj_set_size(devicesScrollbar, 4, height);
+  lv_obj_set_y(devicesScrollbar, y);
+  lv_obj_clear_flag(devicesScrollbar, LV_OBJ_FLAG_HIDDEN);
+}
+
+static void updateDevicesHeader() {
+  int32_t count = deviceList.size();
+  if (count == devicesShownCount) {
+    return;
+  }
+  devicesShownCount = count;
+  snprintf(devicesHeaderText, sizeof(devicesHeaderText), "Nearby devices : %ld", (long)count);
+  lv_label_set_text_static(devicesHeader, devicesHeaderText);
+}
+
+static void devices_list_event_cb(lv_event_t *event) {
+  lv_point_t vect;
+  lv_indev_get_vect(lv_indev_get_act(), &vect);
+  if (vect.y == 0) {
+    return;
+  }
+  int32_t top = devicesScrollY / deviceRowHeight;
+  devicesScrollY -= vect.y;
+  clampDevicesScroll();
+  // 行の境界を跨いだ場合だけ行の割り当てが変わる。それ以外は位置だけ動かす
+  if (top == devicesScrollY / deviceRowHeight) {
+    for (int i = 0; i < deviceRowCount; i++) {
+      if (deviceRows[i].rank >= 0) {
+        lv_obj_set_y(deviceRows[i].label, (lv_coord_t)(deviceRows[i].rank * deviceRowHeight - devicesScrollY));
+      }
+    }
+    return;
+  }
+  layoutDeviceRows(-1, -1);
+}
+
+// デバイスタブ
+// 一覧の並びが変わった範囲のうち、見えている行だけを更新する
+static void createDevicesTab(lv_obj_t *tab) {
+  devicesHeader = lv_label_create(tab);
+  lv_obj_set_pos(devicesHeader, 0, 0);
+  devicesShownCount = -1;
+  updateDevicesHeader();
+
+  lv_obj_update_layout(tab);
+  devicesViewHeight = lv_obj_get_content_height(tab) - deviceHeaderHeight;
+  devicesList = lv_obj_create(tab);
+  lv_obj_set_pos(devicesList, 0, deviceHeaderHeight);
+  lv_obj_set_size(devicesList, lv_pct(100), devicesViewHeight);
+  lv_obj_set_style_pad_all(devicesList, 0, 0);
+  lv_obj_set_style_border_width(devicesList, 0, 0);
+  lv_obj_clear_flag(devicesList, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_event_cb(devicesList, devices_list_event_cb, LV_EVENT_PRESSING, NULL);
+
+  deviceRowCount = LV_MIN(devicesViewHeight / deviceRowHeight + 1, maxDeviceRows);
+  for (int i = 0; i < deviceRowCount; i++) {
+    DeviceRow &row = deviceRows[i];
+    row.label = lv_label_create(devicesList);
+    row.rank = -1;
+    row.text[0] = '\0';
+    lv_label_set_text_static(row.label, row.text);
+    lv_obj_add_flag(row.label, LV_OBJ_FLAG_HIDDEN);
+  }
+
+  devicesScrollbar = lv_obj_create(devicesList);
+  lv_obj_remove_style_all(devicesScrollbar);
+  lv_obj_set_style_bg_opa(devicesScrollbar, LV_OPA_50, 0);
+  lv_obj_set_style_bg_color(devicesScrollbar, lv_palette_main(LV_PALETTE_GREY), 0);
+  lv_obj_set_align(devicesScrollbar, LV_ALIGN_TOP_RIGHT);
+  lv_obj_clear_flag(devicesScrollbar, LV_OBJ_FLAG_CLICKABLE);
+
+  devicesScrollY = 0;
+  clampDevicesScroll();
+  layoutDeviceRows(-1, -1);
+  // 作るまでの変化は上で全て反映した
+  uint16_t first, last;
+  deviceList.takeChanges(&first, &last);
+
+  devicesTimer = lv_timer_create(
+      [](lv_timer_t *timer) {
+        uint16_t first, last;
+        if ((lv_tabview_get_tab_act(tabView) != devicesTabIndex) || !deviceList.takeChanges(&first, &last)) {
+          return;
+        }
+        updateDevicesHeader();
+        clampDevicesScroll();
+        layoutDeviceRows(first, last);
+      },
+      devicesInterval, NULL);
+}
+
+static void forgetDevicesTab() {
+  lv_timer_del(devicesTimer);
+  devicesTimer = NULL;
+  devicesHeader = NULL;
+  devicesList = NULL;
+  devicesScrollbar = NULL;
+  deviceRowCount = 0;
+}
+
+struct TabBuilder {
+  const char *symbol;
+  void (*create)(lv_obj_t *tab);
+  void (*forget)();
+  lv_obj_t *tab;
+  bool built;
+};
+
+static TabBuilder tabBuilders[] = {
+  {LV_SYMBOL_HOME, createHomeTab, NULL, NULL, false},
+  {LV_SYMBOL_WIFI, createConnectionTab, forgetConnectionTab, NULL, false},
+  {LV_SYMBOL_BLUETOOTH, createBluetoothTab, forgetBluetoothTab, NULL, false},
+  {LV_SYMBOL_PLUS, createSensorsTab, forgetSensorsTab, NULL, false},
+  {LV_SYMBOL_LIST, createDiagnosticsTab, forgetDiagnosticsTab, NULL, false},
+  {LV_SYMBOL_EYE_OPEN, createDevicesTab, forgetDevicesTab, NULL, false},
+};
+static const uint16_t tabCount = sizeof(tabBuilders) / sizeof(tabBuilders[0]);
+
+static void buildTab(uint16_t index) {
+  TabBuilder &builder = tabBuilders[index];
+  if (!builder.built) {
+    builder.create(builder.tab);
+    builder.built = true;
+  }
+}
+
+#if UI_DESTROY_HIDDEN_TABS
+static void destroyTab(uint16_t index) {
+  TabBuilder &builder = tabBuilders[index];
+  if (!builder.built || (builder.forget == NULL)) {
+    return;
+  }
+  // キーボードが削除するテキストエリアを指していれば外す
+  if (keyboard != NULL) {
+    lv_obj_t *textarea = lv_keyboard_get_textarea(keyboard);
+    if ((textarea != NULL) && (lv_obj_get_parent(lv_obj_get_parent(textarea)) == builder.tab)) {
+      lv_keyboard_set_textarea(keyboard, NULL);
+      lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    }
+  }
+  lv_obj_clean(builder.tab);
+  builder.forget();
+  builder.built = false;
+}
+#endif
+
+#if UI_LAZY_TABS
+static void tabview_event_cb(lv_event_t *event) {
+  uint16_t index = lv_tabview_get_tab_act(tabView);
+  if (index == activeTabIndex) {
+    return;
+  }
+  buildTab(index);
+#if UI_DESTROY_HIDDEN_TABS
+  destroyTab(activeTabIndex);
+#endif
+  activeTabIndex = index;
+}
+#endif
+
+void createUi(const UiSettings &settings) {
+  uiSettings = settings;
+
+  // static lv_obj_t* loginScreen = lv_scr_act();
+  // lv_obj_t* loginPage = lv_obj_create(loginScreen);
+
+  rootScreen = lv_scr_act();
+
+  tabView = lv_tabview_create(rootScreen, LV_DIR_BOTTOM, tabWidth);
+  for (uint16_t i = 0; i < tabCount; i++) {
+    tabBuilders[i].tab = lv_tabview_add_tab(tabView, tabBuilders[i].symbol);
+  }
+
+  // ホームタブ以外は最初に選択された時に作る
+  buildTab(homeTabIndex);
+#if UI_LAZY_TABS
+  lv_obj_add_event_cb(tabView, tabview_event_cb, LV_EVENT_VALUE_CHANGED, NULL);
+#else
+  for (uint16_t i = 0; i < tabCount; i++) {
+    buildTab(i);
+  }
+#endif
+}
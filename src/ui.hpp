@@ -0,0 +1,35 @@
+#ifndef UI_HPP
+#define UI_HPP
+
+#include <stdint.h>
+#include <lvgl.h>
+
+// 画面の構築に使う値
+// 設定値はsettings.hppの変数から読むので、ここには設定以外の値だけを置く
+// 文字列はUIが存在する間は有効であること
+struct UiSettings {
+  const char *systemBarText;
+
+  // Cert SDカードのファイル一覧("\n"区切り)
+  const char *files;
+};
+
+extern lv_obj_t *rootScreen;
+extern lv_obj_t *systemBar;
+extern lv_obj_t *connectionStatus;
+extern lv_obj_t *dashboardTempertature;
+extern lv_obj_t *dashboardHumidity;
+
+// 画面を構築する。lv_initとドライバの登録の後に呼ぶこと
+void createUi(const UiSettings &settings);
+
+//
+// UIから呼ばれる処理
+// ファームウェアではmain.cpp、シミュレータではsim/sim_app.cppで実装する
+// 設定の反映と保存はsettings.hppを参照
+//
+void scanWifi(lv_obj_t *dropdown);
+// SDカードのファイルを読み込む。読めなければNULL
+char *readSettingFile(const char *path);
+
+#endif
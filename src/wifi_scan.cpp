@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "wifi_scan.hpp"
+
+static const char *TAG = "wifi_scan";
+
+static const uint8_t firstChannel = 1;
+static const uint8_t lastChannel = 13;
+static const uint32_t channelScanMillis = 120;  // 1チャンネルのアクティブスキャンの時間
+static const int maxNetworks = 32;
+
+static WifiNetwork networks[maxNetworks];
+static int networkCount;
+static uint8_t scanningChannel;  // 0はスキャンしていない
+static bool reordered;
+static bool restartPending;  // スキャン中に始め直すよう言われた。今のチャンネルが終わってから始める
+
+static void startChannel(uint8_t channel) {
+  scanningChannel = channel;
+  // async=trueなのですぐに戻る。結果はscanCompleteで確認する
+  if (WiFi.scanNetworks(true, false, false, channelScanMillis, channel) == WIFI_SCAN_FAILED) {
+    ESP_LOGW(TAG, "channel %u : scan failed", channel);
+  }
+}
+
+// RSSIの降順の位置に入れる。既にあるSSIDは強い方のRSSIにして位置を直す。一覧が変わればtrue
+static bool addNetwork(const String &ssid, int rssi, uint8_t channel) {
+  if (ssid.length() == 0) {
+    return false;
+  }
+  int index = 0;
+  while ((index < networkCount) && (strcmp(networks[index].ssid, ssid.c_str()) != 0)) {
+    index++;
+  }
+
+  if (index < networkCount) {
+    if (rssi <= networks[index].rssi) {
+      return false;
+    }
+  } else {
+    if (networkCount == maxNetworks) {
+      // 最も弱いものより弱ければ捨てる
+      if (rssi <= networks[networkCount - 1].rssi) {
+        return false;
+      }
+      if (networks[networkCount - 1].shown) {
+        reordered = true;
+      }
+      networkCount--;
+    }
+    index = networkCount++;
+    WifiNetwork &network = networks[index];
+    snprintf(network.ssid, sizeof(network.ssid), "%s", ssid.c_str());
+    network.shown = false;
+  }
+  networks[index].rssi = (int8_t)rssi;
+  networks[index].channel = channel;
+
+  // 前に移動する。表示済みのものが表示済みのものを追い越したら並べ直しが必要
+  WifiNetwork moving = networks[index];
+  while ((index > 0) && (networks[index - 1].rssi < moving.rssi)) {
+    if (moving.shown && networks[index - 1].shown) {
+      reordered = true;
+    }
+    networks[index] = networks[index - 1];
+    index--;
+  }
+  networks[index] = moving;
+  return true;
+}
+
+void wifiScanStart() {
+  if ((WiFi.getMode() & WIFI_MODE_STA) == 0) {
+    WiFi.mode(WIFI_STA);
+  }
+  networkCount = 0;
+  reordered = false;
+  // スキャン中に次を始めると、前のチャンネルの結果を新しいチャンネルのものとして取り込んでしまう
+  if (scanningChannel != 0) {
+    restartPending = true;
+    return;
+  }
+  WiFi.scanDelete();
+  startChannel(firstChannel);
+}
+
+bool wifiScanRunning() {
+  return scanningChannel != 0;
+}
+
+bool wifiScanPoll() {
+  if (scanningChannel == 0) {
+    return false;
+  }
+  int16_t result = WiFi.scanComplete();
+  if (result == WIFI_SCAN_RUNNING) {
+    return false;
+  }
+  if (restartPending) {
+    // 始め直す前のスキャンの結果は捨てる
+    restartPending = false;
+    WiFi.scanDelete();
+    startChannel(firstChannel);
+    return false;
+  }
+
+  bool changed = false;
+  for (int i = 0; i < result; i++) {
+    changed |= addNetwork(WiFi.SSID(i), WiFi.RSSI(i), WiFi.channel(i));
+  }
+  ESP_LOGD(TAG, "channel %u : %d networks", scanningChannel, (result > 0) ? result : 0);
+  WiFi.scanDelete();
+
+  if (scanningChannel < lastChannel) {
+    startChannel(scanningChannel + 1);
+  } else {
+    scanningChannel = 0;
+  }
+  return changed;
+}
+
+int wifiScanNetworkCount() {
+  return networkCount;
+}
+
+WifiNetwork &wifiScanNetwork(int index) {
+  return networks[index];
+}
+
+bool wifiScanTakeReordered() {
+  bool result = reordered;
+  reordered = false;
+  return result;
+}
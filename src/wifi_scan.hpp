@@ -0,0 +1,33 @@
+#ifndef WIFI_SCAN_HPP
+#define WIFI_SCAN_HPP
+
+#include <stdint.h>
+
+//
+// WiFiのネットワークの非同期スキャン
+//
+// 1チャンネルずつ非同期にスキャンし、終わったチャンネルの結果をすぐに一覧に取り込む
+// 接続中でも切断しないので、MQTTの接続は保たれる(スキャン中のチャンネルにいる間だけ通信が止まる)
+// 一覧はSSIDで重複を除き、同じSSIDの中で最も強いRSSIの降順に並べる
+//
+
+struct WifiNetwork {
+  char ssid[33];
+  int8_t rssi;
+  uint8_t channel;
+  bool shown;  // 表示側が表示済みにする
+};
+
+// スキャンを始める。一覧は空にする
+// スキャン中なら、今のチャンネルが終わった後のwifiScanPollで最初のチャンネルからやり直す
+void wifiScanStart();
+bool wifiScanRunning();
+// 終わったチャンネルの結果を取り込み、次のチャンネルを始める。loopから呼ぶ。一覧が変わればtrue
+bool wifiScanPoll();
+
+int wifiScanNetworkCount();
+WifiNetwork &wifiScanNetwork(int index);
+// 表示済みのネットワークの順番が変わった場合はtrueを返して記録を消す。表示側は全て作り直す
+bool wifiScanTakeReordered();
+
+#endif